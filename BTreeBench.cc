@@ -0,0 +1,146 @@
+/*
+ * Multithreaded benchmark for BTreeIndex.
+ * A shared index is preloaded with keys, then 1, 2, 4, ... threads run a
+ * mix of point lookups and inserts on it at the same time.
+ * Every run is repeated with the index opened in resident mode, where
+ * only leaves are read from the page file; the page reads of each run
+ * are reported next to its throughput.
+ *
+ * usage: bench [preload keys] [operations per thread] [insert percentage]
+ *              [max threads, default: # cores]
+ */
+
+#include "BTreeIndex.h"
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+using namespace std;
+
+static const char* BENCH_INDEX = "bench.idx";
+
+static int preloadCount = 50000;  // # keys in the index before the run
+static int opCount = 20000;       // # operations done by each thread
+static int insertPercent = 10;    // % of operations that are inserts
+
+// arguments and results of one benchmark thread
+struct BenchThread {
+  pthread_t   thread;
+  BTreeIndex* tree;
+  int         id;
+  int         threadCount;
+  int         misses;     // lookups that did not find their key
+  int         errors;     // operations that returned an error code
+};
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// preloaded keys are odd, keys inserted during the run are even
+static int preloadKey(int i) { return 2 * i + 1; }
+
+static void* runBenchThread(void* arg)
+{
+  BenchThread* bt = (BenchThread*) arg;
+  unsigned int seed = bt->id + 1;
+  int inserted = 0;
+
+  for (int i = 0; i < opCount; i++) {
+    RecordId rid;
+    int key;
+
+    if ((int)(rand_r(&seed) % 100) < insertPercent) {
+      // every thread inserts its own set of even keys
+      key = 2 * (bt->id + bt->threadCount * inserted++) + 2;
+      rid.pid = key / RecordFile::RECORDS_PER_PAGE;
+      rid.sid = key % RecordFile::RECORDS_PER_PAGE;
+      if (bt->tree->insert(key, rid) != 0) bt->errors++;
+    } else {
+      IndexCursor cursor;
+      int searchKey = preloadKey(rand_r(&seed) % preloadCount);
+      if (bt->tree->locate(searchKey, cursor) != 0 ||
+          bt->tree->readForward(cursor, key, rid) != 0) {
+        bt->errors++;
+      } else if (key != searchKey) {
+        bt->misses++;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+// build a fresh index, then run threadCount threads on it
+static void runBench(int threadCount, bool resident)
+{
+  BTreeIndex tree;
+  BenchThread* threads = new BenchThread[threadCount];
+  int misses = 0, errors = 0;
+
+  unlink(BENCH_INDEX);
+  if (tree.open(BENCH_INDEX, 'w', resident) != 0) {
+    fprintf(stderr, "Error: cannot create %s\n", BENCH_INDEX);
+    exit(1);
+  }
+
+  // preload the keys in a scattered order
+  for (int i = 0; i < preloadCount; i++) {
+    int j = (int)(((long long) i * 7919) % preloadCount);
+    RecordId rid;
+    rid.pid = j / RecordFile::RECORDS_PER_PAGE;
+    rid.sid = j % RecordFile::RECORDS_PER_PAGE;
+    tree.insert(preloadKey(j), rid);
+  }
+
+  int breads = PageFile::getPageReadCount();
+  double btime = now();
+  for (int t = 0; t < threadCount; t++) {
+    threads[t].tree = &tree;
+    threads[t].id = t;
+    threads[t].threadCount = threadCount;
+    threads[t].misses = threads[t].errors = 0;
+    pthread_create(&threads[t].thread, NULL, runBenchThread, &threads[t]);
+  }
+  for (int t = 0; t < threadCount; t++) {
+    pthread_join(threads[t].thread, NULL);
+    misses += threads[t].misses;
+    errors += threads[t].errors;
+  }
+  double etime = now();
+  int reads = PageFile::getPageReadCount() - breads;
+
+  double ops = (double) opCount * threadCount;
+  fprintf(stdout, "%3d threads%-10s: %10.0f ops/sec (%.3f seconds, %.2f page reads/op, %d misses, %d errors)\n",
+          threadCount, resident ? ", resident" : "", ops / (etime - btime),
+          etime - btime, reads / ops, misses, errors);
+
+  tree.close();
+  unlink(BENCH_INDEX);
+  delete [] threads;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc > 1) preloadCount = atoi(argv[1]);
+  if (argc > 2) opCount = atoi(argv[2]);
+  if (argc > 3) insertPercent = atoi(argv[3]);
+
+  int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (argc > 4) cores = atoi(argv[4]);
+
+  fprintf(stdout, "%d preloaded keys, %d operations per thread, %d%% inserts\n",
+          preloadCount, opCount, insertPercent);
+
+  for (int threadCount = 1; threadCount <= cores; threadCount *= 2) {
+    runBench(threadCount, false);
+    runBench(threadCount, true);
+  }
+
+  return 0;
+}
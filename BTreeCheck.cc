@@ -0,0 +1,266 @@
+/*
+ * Consistency check for BTreeIndex::insert() and remove().
+ * A random mix of inserts and removes is applied both to an index and to
+ * a std::multiset of the same (key, rid) pairs, and the two are compared
+ * every few thousand operations: a full leaf scan, locate() and rank() on
+ * random keys, and the entry count. A few hot keys get enough RecordIds
+ * to spill to posting pages. The index is then shrunk to a few entries
+ * and grown back, and the file must not grow while the free list still
+ * has pages. The check is repeated after the index is closed and opened.
+ *
+ * usage: btreecheck [operations, default: 100000] [seed]
+ */
+
+#include "BTreeIndex.h"
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+
+using namespace std;
+
+static const char* CHECK_INDEX = "check.idx";
+
+static const int KEY_RANGE = 20000;  // keys are drawn from [0, KEY_RANGE)
+static const int HOT_KEYS = 4;       // keys [0, HOT_KEYS) get most of the duplicates
+
+// a (key, rid) pair, ordered by key, then pid, then sid
+struct Entry {
+  int key;
+  int pid;
+  int sid;
+  bool operator<(const Entry& e) const {
+    if (key != e.key) return key < e.key;
+    if (pid != e.pid) return pid < e.pid;
+    return sid < e.sid;
+  }
+  bool operator==(const Entry& e) const {
+    return key == e.key && pid == e.pid && sid == e.sid;
+  }
+};
+
+typedef multiset<Entry> Reference;
+
+static int failures = 0;
+static int nextRid = 0;  // every insert gets a new RecordId
+
+static void fail(const char* what, int a, int b)
+{
+  fprintf(stderr, "FAIL: %s (%d, %d)\n", what, a, b);
+  failures++;
+}
+
+static RecordId ridOf(const Entry& e)
+{
+  RecordId rid;
+  rid.pid = e.pid;
+  rid.sid = e.sid;
+  return rid;
+}
+
+static Entry newEntry(unsigned int& seed)
+{
+  Entry e;
+  if (rand_r(&seed) % 4 == 0) {
+    e.key = rand_r(&seed) % HOT_KEYS;
+  } else {
+    e.key = rand_r(&seed) % KEY_RANGE;
+  }
+  e.pid = nextRid / RecordFile::RECORDS_PER_PAGE;
+  e.sid = nextRid % RecordFile::RECORDS_PER_PAGE;
+  nextRid++;
+  return e;
+}
+
+// pick a random entry of the reference
+static Reference::iterator pickEntry(Reference& ref, unsigned int& seed)
+{
+  Entry probe;
+  probe.key = rand_r(&seed) % KEY_RANGE;
+  probe.pid = probe.sid = -1;
+  Reference::iterator it = ref.lower_bound(probe);
+  if (it == ref.end()) it = ref.begin();
+  return it;
+}
+
+// compare every entry of the index and a sample of locate()/rank() with ref
+static void verify(BTreeIndex& tree, const Reference& ref, unsigned int& seed)
+{
+  vector<Entry> scanned;
+  IndexCursor cursor;
+  int key;
+  RecordId rid;
+
+  if (tree.getEntryCount() != (int) ref.size()) {
+    fail("entry count", tree.getEntryCount(), (int) ref.size());
+  }
+
+  if (!ref.empty()) {
+    if (tree.locate(INT_MIN, cursor) != 0) {
+      fail("locate of the first entry", 0, 0);
+      return;
+    }
+    while (tree.readForward(cursor, key, rid) == 0) {
+      Entry e;
+      e.key = key;
+      e.pid = rid.pid;
+      e.sid = rid.sid;
+      scanned.push_back(e);
+    }
+  }
+
+  // RecordIds of a key need not come back in order
+  sort(scanned.begin(), scanned.end());
+  if (scanned.size() != ref.size() ||
+      !equal(scanned.begin(), scanned.end(), ref.begin())) {
+    fail("leaf scan differs from the reference", (int) scanned.size(), (int) ref.size());
+  }
+
+  for (int i = 0; i < 200 && !ref.empty(); i++) {
+    Entry probe;
+    probe.key = rand_r(&seed) % KEY_RANGE;
+    probe.pid = probe.sid = -1;
+    Reference::const_iterator it = ref.lower_bound(probe);
+
+    int below;
+    if (tree.rank(probe.key, below) != 0 ||
+        below != (int) distance(ref.begin(), it)) {
+      fail("rank", probe.key, below);
+    }
+
+    if (it == ref.end()) continue;
+    if (tree.locate(probe.key, cursor) != 0 ||
+        tree.readForward(cursor, key, rid) != 0 || key != it->key) {
+      fail("locate", probe.key, key);
+    }
+  }
+}
+
+// apply count random operations, removing with probability removePercent
+static void mix(BTreeIndex& tree, Reference& ref, int count, int removePercent, unsigned int& seed)
+{
+  for (int i = 0; i < count; i++) {
+    if (!ref.empty() && (int)(rand_r(&seed) % 100) < removePercent) {
+      Reference::iterator it = pickEntry(ref, seed);
+      if (tree.remove(it->key, ridOf(*it)) != 0) {
+        fail("remove of an indexed entry", it->key, it->pid);
+      }
+      ref.erase(it);
+    } else {
+      Entry e = newEntry(seed);
+      if (tree.insert(e.key, ridOf(e)) != 0) {
+        fail("insert", e.key, e.pid);
+      }
+      ref.insert(e);
+    }
+
+    // a pair that is not in the index must not be found
+    if (i % 97 == 0) {
+      Entry e;
+      e.key = rand_r(&seed) % KEY_RANGE;
+      e.pid = 1000000;  // far beyond the RecordIds handed out
+      e.sid = 0;
+      if (tree.remove(e.key, ridOf(e)) != RC_NO_SUCH_RECORD) {
+        fail("remove of a missing entry", e.key, 0);
+      }
+    }
+
+    if ((i + 1) % 5000 == 0) verify(tree, ref, seed);
+  }
+}
+
+// shrink the index to a few entries, then grow it back; freed pages
+// must be reused before the file grows
+static void checkReuse(BTreeIndex& tree, Reference& ref, unsigned int& seed)
+{
+  int target = (int) ref.size();
+
+  while (ref.size() > 100) {
+    Reference::iterator it = pickEntry(ref, seed);
+    if (tree.remove(it->key, ridOf(*it)) != 0) {
+      fail("remove while shrinking", it->key, it->pid);
+    }
+    ref.erase(it);
+  }
+  verify(tree, ref, seed);
+
+  int pages = tree.getPageCount();
+  int freePages = tree.getFreePageCount();
+  fprintf(stdout, "shrunk to %d entries: %d pages, %d on the free list\n",
+          (int) ref.size(), pages, freePages);
+  if (freePages == 0) fail("no page was freed", pages, 0);
+
+  // grow until the free list is used up; the file must not grow meanwhile
+  while (tree.getFreePageCount() > 0 && (int) ref.size() < 4 * target) {
+    Entry e = newEntry(seed);
+    if (tree.insert(e.key, ridOf(e)) != 0) fail("insert while growing", e.key, e.pid);
+    ref.insert(e);
+    if (tree.getPageCount() != pages) {
+      fail("file grew while the free list had pages", tree.getPageCount(), tree.getFreePageCount());
+      break;
+    }
+  }
+  fprintf(stdout, "free list used up at %d entries, still %d pages\n",
+          (int) ref.size(), tree.getPageCount());
+
+  while ((int) ref.size() < target) {
+    Entry e = newEntry(seed);
+    if (tree.insert(e.key, ridOf(e)) != 0) fail("insert while growing", e.key, e.pid);
+    ref.insert(e);
+  }
+  verify(tree, ref, seed);
+}
+
+int main(int argc, char* argv[])
+{
+  int opCount = 100000;
+  unsigned int seed = 1;
+  if (argc > 1) opCount = atoi(argv[1]);
+  if (argc > 2) seed = (unsigned int) atoi(argv[2]);
+
+  BTreeIndex tree;
+  Reference ref;
+
+  unlink(CHECK_INDEX);
+  if (tree.open(CHECK_INDEX, 'w') != 0) {
+    fprintf(stderr, "Error: cannot create %s\n", CHECK_INDEX);
+    return 1;
+  }
+
+  // grow, then churn at a steady size, then shrink
+  mix(tree, ref, opCount / 2, 30, seed);
+  mix(tree, ref, opCount / 4, 50, seed);
+  mix(tree, ref, opCount / 4, 70, seed);
+  fprintf(stdout, "%d operations: %d entries, %d pages, %d on the free list\n",
+          opCount, (int) ref.size(), tree.getPageCount(), tree.getFreePageCount());
+
+  mix(tree, ref, opCount / 4, 30, seed);
+  checkReuse(tree, ref, seed);
+
+  // the free list and the statistics must survive close() and open()
+  int freePages = tree.getFreePageCount();
+  tree.close();
+  if (tree.open(CHECK_INDEX, 'w') != 0) {
+    fprintf(stderr, "Error: cannot open %s again\n", CHECK_INDEX);
+    return 1;
+  }
+  if (tree.getFreePageCount() != freePages) {
+    fail("free list size after open", tree.getFreePageCount(), freePages);
+  }
+  verify(tree, ref, seed);
+  mix(tree, ref, opCount / 4, 60, seed);
+  checkReuse(tree, ref, seed);
+
+  tree.close();
+  unlink(CHECK_INDEX);
+
+  if (failures > 0) {
+    fprintf(stdout, "%d checks failed\n", failures);
+    return 1;
+  }
+  fprintf(stdout, "all checks passed\n");
+  return 0;
+}
@@ -10,6 +10,9 @@
 #include "BTreeIndex.h"
 #include "BTreeNode.h"
 #include <iostream>
+#include <algorithm>
+#include <sched.h>
+#include <climits>
 
 using namespace std;
 
@@ -21,75 +24,550 @@ BTreeIndex::BTreeIndex()
     rootPid = -1;
     //  tree height is 0 on creation
 	treeHeight = 0; 
+	entryCount = 0;
+	distinctKeys = 0;
+	minKey = maxKey = 0;
+	leafCount = 0;
+	leafBytes = 0;
+	buildTime = 0;
+	writable = false;
+	modified = false;
+	freeList = 0;
+	freePages = 0;
+	rebalanceEpoch = 0;
+	resident = false;
+	nextPid = 0;
 	
 	std::fill(buffer, buffer + PageFile::PAGE_SIZE, 0); // clear the buffer if necessary
+	
+	pthread_mutex_init(&rootLatch.lock, NULL);
+	rootLatch.version = 0;
+	pthread_mutex_init(&latchMutex, NULL);
+	pthread_mutex_init(&allocMutex, NULL);
+	pthread_mutex_init(&residentMutex, NULL);
+	pthread_mutex_init(&statsMutex, NULL);
+}
+
+/*
+ * BTreeIndex destructor
+ */
+BTreeIndex::~BTreeIndex()
+{
+	freeLatches();
+	
+	pthread_mutex_destroy(&rootLatch.lock);
+	pthread_mutex_destroy(&latchMutex);
+	pthread_mutex_destroy(&allocMutex);
+	pthread_mutex_destroy(&residentMutex);
+	pthread_mutex_destroy(&statsMutex);
 }
 
 /*
  * Open the index file in read or write mode.
  * Under 'w' mode, the index file should be created if it does not exist.
+ * In resident mode every non-leaf node is also loaded into memory.
  * @param indexname[IN] the name of the index file
  * @param mode[IN] 'r' for read, 'w' for write
+ * @param resident[IN] true to keep all non-leaf nodes in memory
  * @return rc code. 0 if no rc
  */
-RC BTreeIndex::open(const string& indexname, char mode)
+RC BTreeIndex::open(const string& indexname, char mode, bool resident)
 {
     RC rc = pf.open(indexname, mode);
 
 	if(rc!=0)
 		return rc;
 	
+	this->resident = resident;
+	innerNodes.clear();
+	nextPid = 0;
+	writable = (mode=='w' || mode=='W');
+	modified = false;
+	
+	rootPid = -1;
+	treeHeight = 0;
+	entryCount = 0;
+	distinctKeys = 0;
+	minKey = maxKey = 0;
+	leafCount = 0;
+	leafBytes = 0;
+	buildTime = 0;
+	freeList = 0;
+	freePages = 0;
+	
+	//  a new index file starts with its metadata page
 	if(pf.endPid()==0)
 	{
-		rootPid = -1;
-		treeHeight = 0;
-		RC rc = pf.write(0, buffer);
+		rc = writeHeader();
+		
 		if(rc!=0)
-			return rc;
-		return 0;
+			pf.close();
+		
+		return rc;
 	}
 	
-	//  read current Pid and height from metadata
+	//  read the metadata page
 	rc = pf.read(0, buffer);
 
 	if(rc!=0)
+	{
+		pf.close();
 		return rc;
+	}
 	
-	int currPid;
-	int currHeight;
-	memcpy(&currPid, buffer, sizeof(int));
-	memcpy(&currHeight, buffer+4, sizeof(int));
+	IndexHeader header;
+	memcpy(&header, buffer, sizeof(IndexHeader));
+	
+	//  the file must have been written with the same node layout
+	if(header.formatVersion!=FORMAT_VERSION || header.pageSize!=PageFile::PAGE_SIZE)
+	{
+		pf.close();
+		return RC_INVALID_FILE_FORMAT;
+	}
 	
 	//  check if saved pid and height are valid and assign them	
-	if(currPid>0 && currHeight>=0)
+	if(header.rootPid>0 && header.treeHeight>=0)
 	{
-		rootPid = currPid;
-		treeHeight = currHeight;
+		rootPid = header.rootPid;
+		treeHeight = header.treeHeight;
 	}
 	
+	entryCount = header.entryCount;
+	distinctKeys = header.distinctKeys;
+	minKey = header.minKey;
+	maxKey = header.maxKey;
+	leafCount = header.leafCount;
+	leafBytes = header.leafBytes;
+	buildTime = header.buildTime;
+	freeList = header.freeList;
+	freePages = header.freePages;
+	
+	if(resident)
+		return loadInnerNodes();
+	
 	return 0;
 }
 
 /*
  * Close the index file.
+ * In 'w' mode the metadata page is written back first.
  * @return rc code. 0 if no rc
  */
 RC BTreeIndex::close()
 {
-	//  Save pid and height to PageFile
-	memcpy(buffer, &rootPid, sizeof(int));
-	memcpy(buffer+4, &treeHeight, sizeof(int));
+	RC rc = 0;
+	
+	if(writable)
+	{
+		if(modified)
+			buildTime = time(NULL);
+		
+		rc = writeHeader();
+	}
+	
+	innerNodes.clear();
+	freeLatches();
+	
+	RC closeRc = pf.close();
+	
+	if(rc!=0)
+		return rc;
+	
+	return closeRc;
+}
+
+/*
+ * Write rootPid, treeHeight and the statistics to the metadata page.
+ * @return rc code. 0 if no rc
+ */
+RC BTreeIndex::writeHeader()
+{
+	IndexHeader header;
+	
+	header.rootPid = rootPid;
+	header.treeHeight = treeHeight;
+	header.entryCount = entryCount;
+	header.formatVersion = FORMAT_VERSION;
+	header.pageSize = PageFile::PAGE_SIZE;
+	header.distinctKeys = distinctKeys;
+	header.minKey = minKey;
+	header.maxKey = maxKey;
+	header.leafCount = leafCount;
+	header.fillPerMille = (int)(getFillFactor()*1000 + 0.5);
+	header.buildTime = buildTime;
+	header.freeList = freeList;
+	header.freePages = freePages;
+	header.leafBytes = leafBytes;
+	
+	std::fill(buffer, buffer + PageFile::PAGE_SIZE, 0);
+	memcpy(buffer, &header, sizeof(IndexHeader));
+	
+	return pf.write(0, buffer);
+}
+
+/*
+ * Update the statistics after a (key, rid) pair was inserted.
+ * @param key[IN] the inserted key
+ * @param newKey[IN] false if the leaf already held the key
+ * @param newLeaves[IN] the number of leaf nodes created by the insert
+ * @param bytes[IN] the number of bytes the insert added to leaf pages
+ */
+void BTreeIndex::countInsert(int key, bool newKey, int newLeaves, int bytes)
+{
+	pthread_mutex_lock(&statsMutex);
+	
+	if(entryCount==0 || key < minKey)
+		minKey = key;
+	if(entryCount==0 || key > maxKey)
+		maxKey = key;
+	
+	entryCount++;
+	if(newKey)
+		distinctKeys++;
+	leafCount += newLeaves;
+	leafBytes += bytes;
+	modified = true;
+	
+	pthread_mutex_unlock(&statsMutex);
+}
+
+/*
+ * Update the statistics after a (key, rid) pair was removed.
+ * If the key was the smallest or the largest one, the new one is looked up;
+ * the caller must not hold any latch.
+ * @param key[IN] the removed key
+ * @param lastOfKey[IN] true if the leaf holds no other entry with the key
+ * @param freedLeaves[IN] the number of leaf nodes freed by the remove
+ * @param bytes[IN] the number of bytes the remove took from leaf pages
+ */
+void BTreeIndex::countRemove(int key, bool lastOfKey, int freedLeaves, int bytes)
+{
+	pthread_mutex_lock(&statsMutex);
+	
+	entryCount--;
+	if(lastOfKey)
+		distinctKeys--;
+	leafCount -= freedLeaves;
+	leafBytes -= bytes;
+	modified = true;
+	
+	bool newMin = (entryCount>0 && key==minKey);
+	bool newMax = (entryCount>0 && key==maxKey);
+	
+	pthread_mutex_unlock(&statsMutex);
+	
+	IndexCursor cursor;
+	int bound;
+	RecordId rid;
+	
+	//  an insert may have moved the bound meanwhile; keep its value then
+	if(newMin && locate(INT_MIN, cursor)==0 && readForward(cursor, bound, rid)==0)
+	{
+		pthread_mutex_lock(&statsMutex);
+		if(minKey==key)
+			minKey = bound;
+		pthread_mutex_unlock(&statsMutex);
+	}
+	
+	if(newMax && readLastKey(bound)==0)
+	{
+		pthread_mutex_lock(&statsMutex);
+		if(maxKey==key)
+			maxKey = bound;
+		pthread_mutex_unlock(&statsMutex);
+	}
+}
+
+/*
+ * Return the latch of the node stored at pid, creating it on first use.
+ * @param pid[IN] the PageId of the node
+ * @return the latch of the node
+ */
+BTreeIndex::NodeLatch* BTreeIndex::getLatch(PageId pid)
+{
+	pthread_mutex_lock(&latchMutex);
+	
+	NodeLatch*& latch = latches[pid];
+	if(latch==NULL)
+	{
+		latch = new NodeLatch;
+		pthread_mutex_init(&latch->lock, NULL);
+		latch->version = 0;
+	}
+	
+	pthread_mutex_unlock(&latchMutex);
+	return latch;
+}
+
+/*
+ * Lock a node for writing. Its version becomes odd, which tells
+ * optimistic readers that the node is being changed.
+ * @param latch[IN] the latch of the node
+ */
+void BTreeIndex::writeLatch(NodeLatch* latch)
+{
+	pthread_mutex_lock(&latch->lock);
+	__sync_fetch_and_add(&latch->version, 1);
+}
+
+/*
+ * Make the version of a node even (and new) again, then unlock it.
+ * @param latch[IN] the latch of the node
+ */
+void BTreeIndex::writeUnlatch(NodeLatch* latch)
+{
+	__sync_fetch_and_add(&latch->version, 1);
+	pthread_mutex_unlock(&latch->lock);
+}
+
+/*
+ * Wait until no writer holds a node and return its version.
+ * @param latch[IN] the latch of the node
+ * @return the (even) version of the node
+ */
+unsigned BTreeIndex::readVersion(NodeLatch* latch)
+{
+	for(;;)
+	{
+		unsigned version = latch->version;
+		__sync_synchronize();
+		
+		if((version & 1)==0)
+			return version;
+		
+		sched_yield();
+	}
+}
+
+/*
+ * Check that a node has not been changed since its version was read.
+ * @param latch[IN] the latch of the node
+ * @param version[IN] the version returned by readVersion()
+ * @return true if the node is unchanged
+ */
+bool BTreeIndex::validateVersion(NodeLatch* latch, unsigned version)
+{
+	__sync_synchronize();
+	return latch->version==version;
+}
+
+/*
+ * Release the latches held by a writer, except for the last keep ones.
+ * @param held[IN/OUT] the latches held, from the root down
+ * @param keep[IN] the number of latches at the bottom to keep
+ */
+void BTreeIndex::releaseLatches(vector<NodeLatch*>& held, unsigned keep)
+{
+	if(held.size() <= keep)
+		return;
+	
+	unsigned count = held.size() - keep;
+	for(unsigned i=0; i<count; i++)
+		writeUnlatch(held[i]);
+	
+	held.erase(held.begin(), held.begin()+count);
+}
+
+/*
+ * Destroy all node latches. No other thread may be using the index.
+ */
+void BTreeIndex::freeLatches()
+{
+	for(map<PageId, NodeLatch*>::iterator it=latches.begin(); it!=latches.end(); it++)
+	{
+		pthread_mutex_destroy(&it->second->lock);
+		delete it->second;
+	}
+	
+	latches.clear();
+}
+
+/*
+ * Reserve the PageId for a new node.
+ * Pages are handed out under a mutex, so concurrent splits never share one.
+ * @return the PageId of the new node
+ */
+PageId BTreeIndex::allocatePid()
+{
+	pthread_mutex_lock(&allocMutex);
+	
+	//  take the first free page; it holds the PageId of the next one
+	if(freeList > 0)
+	{
+		char page[PageFile::PAGE_SIZE];
+		
+		if(pf.read(freeList, page)==0)
+		{
+			PageId pid = freeList;
+			memcpy(&freeList, page, sizeof(PageId));
+			freePages--;
+			
+			pthread_mutex_unlock(&allocMutex);
+			return pid;
+		}
+	}
+	
+	PageId pid = pf.endPid();
+	if(pid < nextPid)
+		pid = nextPid;
+	nextPid = pid + 1;
+	
+	pthread_mutex_unlock(&allocMutex);
+	return pid;
+}
+
+/*
+ * Put the page of a removed node on the free list.
+ * The caller holds the latch of the node, so readers will not trust what
+ * they read from it; the epoch tells cursors that pages may have moved.
+ * @param pid[IN] the PageId of the removed node
+ * @return rc code. 0 if no rc
+ */
+RC BTreeIndex::freePid(PageId pid)
+{
+	char page[PageFile::PAGE_SIZE];
+	
+	__sync_fetch_and_add(&rebalanceEpoch, 1);
+	
+	pthread_mutex_lock(&allocMutex);
+	
+	std::fill(page, page + PageFile::PAGE_SIZE, 0);
+	memcpy(page, &freeList, sizeof(PageId));
+	
+	RC rc = pf.write(pid, page);
+	
+	if(rc==0)
+	{
+		freeList = pid;
+		freePages++;
+	}
+	
+	pthread_mutex_unlock(&allocMutex);
+	return rc;
+}
+
+/*
+ * Load every non-leaf node into memory, one level at a time from the root.
+ * @return rc code. 0 if no rc
+ */
+RC BTreeIndex::loadInnerNodes()
+{
+	RC rc;
+	vector<PageId> level(1, rootPid);
+	
+	//  the last level holds the leaves, which stay on disk
+	for(int currHeight=1; currHeight<treeHeight; currHeight++)
+	{
+		vector<PageId> nextLevel;
+		
+		for(unsigned i=0; i<level.size(); i++)
+		{
+			BTNonLeafNode node;
+			rc = node.read(level[i], pf);
+			
+			if(rc!=0)
+				return rc;
+			
+			cacheInnerNode(level[i], node);
+			
+			const ResidentNode& copy = innerNodes.find(level[i])->second;
+			nextLevel.insert(nextLevel.end(), copy.children, copy.children+copy.keyCount+1);
+		}
+		
+		level.swap(nextLevel);
+	}
+	
+	return 0;
+}
+
+/*
+ * Refresh the resident copy of the non-leaf node stored at pid.
+ * @param pid[IN] the PageId of the node
+ * @param node[IN] the current content of the node
+ */
+void BTreeIndex::cacheInnerNode(PageId pid, BTNonLeafNode& node)
+{
+	pthread_mutex_lock(&residentMutex);
+	ResidentNode& copy = innerNodes[pid];
+	pthread_mutex_unlock(&residentMutex);
+	
+	//  the caller holds the latch of the node, so a reader that sees
+	//  the copy half-updated will fail to validate the version
+	int keyCount = node.getKeyCount();
+	
+	for(int eid=0; eid<keyCount; eid++)
+	{
+		PageId pid;
+		node.readEntry(eid, copy.keys[eid], pid);
+	}
+	
+	for(int idx=0; idx<=keyCount; idx++)
+		node.readChild(idx, copy.children[idx], copy.counts[idx]);
 	
-	RC rc = pf.write(0, buffer);
+	copy.keyCount = keyCount;
+}
+
+/*
+ * Write a non-leaf node to disk and keep its resident copy consistent.
+ * @param pid[IN] the PageId to write to
+ * @param node[IN] the node to write
+ * @return rc code. 0 if no rc
+ */
+RC BTreeIndex::writeInnerNode(PageId pid, BTNonLeafNode& node)
+{
+	RC rc = node.write(pid, pf);
 	
 	if(rc!=0)
 		return rc;
+	
+	if(resident)
+		cacheInnerNode(pid, node);
+	
+	return 0;
+}
 
-    return pf.close();
+/*
+ * Find the child to follow from the resident copy of a non-leaf node.
+ * Same rule as BTNonLeafNode::locateChildPtr: follow the pointer in front
+ * of the first key that is larger than searchKey.
+ * @param pid[IN] the PageId of the non-leaf node
+ * @param searchKey[IN] the key being looked up
+ * @param childPid[OUT] the child node to follow
+ * @param before[IN/OUT] if not NULL, the # entries under the children in front of childPid is added to it
+ * @return rc code. 0 if no rc
+ */
+RC BTreeIndex::locateResidentChild(PageId pid, int searchKey, PageId& childPid, int* before)
+{
+	pthread_mutex_lock(&residentMutex);
+	map<PageId, ResidentNode>::const_iterator it = innerNodes.find(pid);
+	bool found = (it!=innerNodes.end());
+	pthread_mutex_unlock(&residentMutex);
+	
+	if(!found)
+		return RC_INVALID_PID;
+	
+	//  the copy may be changing under an optimistic reader: stay inside it
+	const ResidentNode& node = it->second;
+	int keyCount = std::max(0, std::min((int)node.keyCount, (int)MAX_INNER_KEYS));
+	int idx = upper_bound(node.keys, node.keys+keyCount, searchKey) - node.keys;
+	
+	childPid = node.children[idx];
+	
+	if(before!=NULL)
+	{
+		for(int i=0; i<idx; i++)
+			*before += node.counts[i];
+	}
+	
+	return 0;
 }
 
 /*
  * Insert (key, RecordId) pair to the index.
+ * Writers descend with latch crabbing: every node on the path is
+ * write-latched, and the latches above a node are released as soon as
+ * the node is safe, i.e., it has room for one more entry and thus cannot
+ * split. Only the part of the path that may split stays latched.
  * @param key[IN] the key for the value inserted into the index
  * @param rid[IN] the RecordId for the record being inserted into the index
  * @return rc code. 0 if no rc
@@ -97,6 +575,15 @@ RC BTreeIndex::close()
 RC BTreeIndex::insert(int key, const RecordId& rid)
 {	
 	RC rc;
+	vector<NodeLatch*> held;
+	
+	//  leaves keep RecordIds as record slot numbers
+	if(rid.pid < 0 || rid.sid < 0 || rid.sid >= RecordFile::RECORDS_PER_PAGE)
+		return RC_INVALID_RID;
+
+	//  rootPid and treeHeight may change if the root splits
+	writeLatch(&rootLatch);
+	held.push_back(&rootLatch);
 
 	//  new Tree!
 	if(treeHeight==0)
@@ -106,20 +593,29 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
 		newRoot.insert(key, rid);
 		
 		//  rootPid starts from 1 as 0 is for storing metadata
-		if(pf.endPid()==0)
-			rootPid = 1;
-		else
-			rootPid = pf.endPid();
+		rootPid = allocatePid();
 		
 		treeHeight++;
 		//  write tree into PageFile		
-		return newRoot.write(rootPid, pf);
+		rc = newRoot.write(rootPid, pf);
+		releaseLatches(held, 0);
+		
+		if(rc==0)
+			countInsert(key, true, 1, newRoot.getUsedBytes());
+		
+		return rc;
 	}
 	
 	int insertKey = -1;
 	PageId insertPid = -1;
+	int insertCount = 0;
+	
+	writeLatch(getLatch(rootPid));
+	held.push_back(getLatch(rootPid));
+	
+	rc = insert_recursive(key, rid, 1, treeHeight, rootPid, true, insertKey, insertPid, insertCount, held);
 	
-	rc = insert_recursive(key, rid, 1, rootPid, insertKey, insertPid);
+	releaseLatches(held, 0);
 	
 	if(rc!=0)
 		return rc;
@@ -127,25 +623,61 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
 	return 0;
 }
 
-RC BTreeIndex::insert_recursive(int key, const RecordId& rid, int currHeight, PageId currPid, int& tempKey, PageId& tempPid)
+RC BTreeIndex::insert_recursive(int key, const RecordId& rid, int currHeight, int height, PageId currPid, bool rightEdge, int& tempKey, PageId& tempPid, int& tempCount, vector<NodeLatch*>& held)
 {
 	RC rc;
 	
 	//  used for splitting	
 	tempKey = -1;
 	tempPid = -1;
+	tempCount = 0;
 	
-	if(currHeight==treeHeight)
+	if(currHeight==height)
 	{
 		//  Read contents od current Leaf
 		BTLeafNode currLeaf;
 		currLeaf.read(currPid, pf);
+		
+		//  a key already in this leaf does not add to the distinct keys;
+		//  keys never straddle leaves, so this is the only leaf with the key
+		PageId head = 0;
+		int count = 0;
+		bool newKey = (currLeaf.getPosting(key, head, count)!=0);
+		int bytes = currLeaf.getUsedBytes();
+		
+		//  the key's entries are on posting pages: add rid there
+		if(head > 0)
+		{
+			//  the leaf keeps its size, so nobody above it will change
+			releaseLatches(held, 1);
+			rc = insertPosting(head, rid);
+			
+			if(rc==0)
+				rc = currLeaf.setPosting(key, head, count+1);
+			
+			if(rc==0)
+				rc = currLeaf.write(currPid, pf);
+			
+			if(rc==0)
+				countInsert(key, false, 0, 0);
+			
+			return rc;
+		}
 
 		//  insert key into current leaf
 		if(currLeaf.insert(key, rid)==0)
 		{	
-			currLeaf.write(currPid, pf);
-			return 0;
+			//  the leaf did not split, so nobody above it will change
+			releaseLatches(held, 1);
+			rc = spillPosting(currLeaf, key);
+			
+			if(rc==0)
+				rc = currLeaf.write(currPid, pf);
+			
+			if(rc==0)
+				countInsert(key, newKey, 0, currLeaf.getUsedBytes()-bytes);
+			
+			return rc;
 		}
 
 		//  overflow in leaf - split
@@ -153,12 +685,16 @@ RC BTreeIndex::insert_recursive(int key, const RecordId& rid, int currHeight, Pa
 		int newkey;
 		rc = currLeaf.insertAndSplit(key, rid, newleaf, newkey);
 		
+		if(rc==0)
+			rc = spillPosting(key < newkey ? currLeaf : newleaf, key);
+		
 		if(rc!=0)
 			return rc;
 		
-		int lastPid = pf.endPid();
+		int lastPid = allocatePid();
 		tempKey = newkey;
 		tempPid = lastPid;
+		tempCount = newleaf.getKeyCount();
 
 		//  setting next node pointers for currLeaf and newleaf
 		newleaf.setNextNodePtr(currLeaf.getNextNodePtr());
@@ -175,15 +711,17 @@ RC BTreeIndex::insert_recursive(int key, const RecordId& rid, int currHeight, Pa
 		if(rc!=0)
 			return rc;
 		
+		countInsert(key, newKey, 1, currLeaf.getUsedBytes()+newleaf.getUsedBytes()-bytes);
+		
 		//  have only root, must insert next level of nonLeaf nodes
-		if(treeHeight==1)
+		if(currHeight==1)
 		{
 			BTNonLeafNode newRoot;
-			newRoot.initializeRoot(currPid, newkey, lastPid);
+			newRoot.initializeRoot(currPid, currLeaf.getKeyCount(), newkey, lastPid, newleaf.getKeyCount());
 			treeHeight++;
 			
-			rootPid = pf.endPid();
-			newRoot.write(rootPid, pf);
+			rootPid = allocatePid();
+			return writeInnerNode(rootPid, newRoot);
 		}
 		
 		return 0;
@@ -194,57 +732,87 @@ RC BTreeIndex::insert_recursive(int key, const RecordId& rid, int currHeight, Pa
 		BTNonLeafNode midNode;
 		midNode.read(currPid, pf);
 		
+		//  this node cannot split, so nobody above it will change
+		if(midNode.hasRoom())
+			releaseLatches(held, 1);
+		
 		PageId childPid = -1;
 		midNode.locateChildPtr(key, childPid);
 		
+		//  the new entry ends up under childPid: count it on the way down,
+		//  while this node is still latched
+		int childCount = midNode.getChildCount(key)+1;
+		midNode.setChildCount(key, childCount);
+		
+		rc = writeInnerNode(currPid, midNode);
+		
+		if(rc!=0)
+			return rc;
+		
 		int insertKey = -1;
 		PageId insertPid = -1;
+		int insertCount = 0;
+		
+		writeLatch(getLatch(childPid));
+		held.push_back(getLatch(childPid));
+		
+		//  the last child of a right-most node is right-most as well
+		bool childRightEdge = rightEdge && midNode.locateChildIndex(key)==midNode.getKeyCount();
 		
-		rc = insert_recursive(key, rid, currHeight+1, childPid, insertKey, insertPid);
+		rc = insert_recursive(key, rid, currHeight+1, height, childPid, childRightEdge, insertKey, insertPid, insertCount, held);
+		
+		if(rc!=0)
+			return rc;
 		
 		//  overflow! 		
 		if(!(insertKey==-1 && insertPid==-1)) 
 		{
-			if(midNode.insert(insertKey, insertPid)==0)
+			//  part of the child's entries moved to its new sibling
+			midNode.setChildCount(key, childCount-insertCount);
+			
+			if(midNode.insert(insertKey, insertPid, insertCount)==0)
 			{
 				// If we were able to successfully insert the child's median key into midNode
 				// Write it into PageFile
-				midNode.write(currPid, pf);
-				return 0;
+				return writeInnerNode(currPid, midNode);
 			}
 			//  must split midNode due to overflow	
 			BTNonLeafNode anotherMidNode;
 			int newkey;
 			
-			midNode.insertAndSplit(insertKey, insertPid, anotherMidNode, newkey);
+			rc = midNode.insertAndSplit(insertKey, insertPid, insertCount, anotherMidNode, newkey, rightEdge);
 			
-			int lastPid = pf.endPid();
+			if(rc!=0)
+				return rc;
+			
+			int lastPid = allocatePid();
 			tempKey = newkey;
 			tempPid = lastPid;
+			tempCount = anotherMidNode.getTotalCount();
 			
 			// / write contents into midNode after split
-			rc = midNode.write(currPid, pf);
+			rc = writeInnerNode(currPid, midNode);
 			
 			if(rc!=0)
 				return rc;
 			
-			rc = anotherMidNode.write(lastPid, pf);
+			rc = writeInnerNode(lastPid, anotherMidNode);
 			
 			if(rc!=0)
 				return rc;
 			
 			// If we just split a root, we'll now need a new single non-leaf node
 			// The new first value of the sibling node (anotherMidNode) gets inserted into root
-			if(treeHeight==1)
+			if(currHeight==1)
 			{
 				//  init root with pointers to children nodes and update height
 				BTNonLeafNode newRoot;
-				newRoot.initializeRoot(currPid, newkey, lastPid);
+				newRoot.initializeRoot(currPid, midNode.getTotalCount(), newkey, lastPid, anotherMidNode.getTotalCount());
 				treeHeight++;
 				
 				//  update rootPid and write to PageFile
-				rootPid = pf.endPid();
-				newRoot.write(rootPid, pf);
+				rootPid = allocatePid();
+				return writeInnerNode(rootPid, newRoot);
 			}
 			
 		}
@@ -253,72 +821,480 @@ RC BTreeIndex::insert_recursive(int key, const RecordId& rid, int currHeight, Pa
 }
 
 /*
- * Find the leaf-node index entry whose key value is larger than or 
- * equal to searchKey, and output the location of the entry in IndexCursor.
- * IndexCursor is a "pointer" to a B+tree leaf-node entry consisting of
- * the PageId of the node and the SlotID of the index entry.
- * Note that, for range queries, we need to scan the B+tree leaf nodes.
- * For example, if the query is "key > 1000", we should scan the leaf
- * nodes starting with the key value 1000. For this reason,
- * it is better to return the location of the leaf node entry 
- * for a given searchKey, instead of returning the RecordId
- * associated with the searchKey directly.
- * Once the location of the index entry is identified and returned 
- * from this function, you should call readForward() to retrieve the
- * actual (key, rid) pair from the index.
- * @param key[IN] the key to find.
- * @param cursor[OUT] the cursor pointing to the first index entry
- *                    with the key value.
- * @return rc code. 0 if no rc.
+ * Remove (key, RecordId) pair from the index.
+ * Unlike insert(), remove() keeps the whole path latched: only the leaf
+ * tells whether the entry exists, and then the entry count of every node
+ * on the path changes. From the leaf up, a node left less than half full
+ * borrows from or merges with a sibling; a root left with one child is
+ * replaced by that child.
+ * @param key[IN] the key of the entry to remove
+ * @param rid[IN] the RecordId of the entry to remove
+ * @return rc code. RC_NO_SUCH_RECORD if the pair is not in the index
  */
-RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
+RC BTreeIndex::remove(int key, const RecordId& rid)
 {
-	RC rc;	
-	BTNonLeafNode midNode;
-	BTLeafNode leaf;
+	RC rc;
+	vector<NodeLatch*> held;
 	
-	int eid;
-	int currHeight = 1;
-	PageId nextPid = rootPid;
+	writeLatch(&rootLatch);
+	held.push_back(&rootLatch);
 	
-	while(currHeight!=treeHeight)
+	if(treeHeight==0)
 	{
-		rc = midNode.read(nextPid, pf);
+		releaseLatches(held, 0);
+		return RC_NO_SUCH_RECORD;
+	}
+	
+	//  the non-leaf nodes on the path, and the child followed in each
+	int height = treeHeight;
+	vector<BTNonLeafNode> path(height-1);
+	vector<PageId> pathPids(height-1);
+	vector<int> pathIdx(height-1);
+	
+	PageId pid = rootPid;
+	int count;
+	
+	for(int h=0; h<height-1; h++)
+	{
+		writeLatch(getLatch(pid));
+		held.push_back(getLatch(pid));
+		
+		rc = path[h].read(pid, pf);
 		
 		if(rc!=0)
+		{
+			releaseLatches(held, 0);
 			return rc;
+		}
+		
+		pathPids[h] = pid;
+		pathIdx[h] = path[h].locateChildIndex(key);
+		path[h].readChild(pathIdx[h], pid, count);
+	}
+	
+	writeLatch(getLatch(pid));
+	held.push_back(getLatch(pid));
+	
+	BTLeafNode leaf;
+	rc = leaf.read(pid, pf);
+	
+	PageId head = 0;
+	int postingCount = 0;
+	int bytes = leaf.getUsedBytes();
+	
+	if(rc==0)
+		rc = leaf.getPosting(key, head, postingCount);
+	
+	//  the key's entries are on posting pages: take rid off them
+	if(rc==0 && head > 0)
+	{
+		rc = removePosting(head, rid);
+		
+		if(rc==0)
+			rc = leaf.setPosting(key, head, postingCount-1);
+	}
+	else if(rc==0)
+		rc = leaf.remove(key, rid);
+	
+	if(rc!=0)
+	{
+		releaseLatches(held, 0);
+		return rc;
+	}
+	
+	bytes -= leaf.getUsedBytes();
+	
+	//  a key still in this leaf still counts as a distinct key
+	bool lastOfKey = (leaf.getPosting(key, head, postingCount)!=0);
+	
+	//  the entry is gone: every subtree on the path holds one entry less
+	for(int h=0; h<height-1; h++)
+	{
+		PageId childPid;
+		path[h].readChild(pathIdx[h], childPid, count);
+		path[h].setChildCountAt(pathIdx[h], count-1);
+	}
+	
+	int freedPid = -1;
+	int freedLeaves = 0;
+	
+	if(height==1)
+	{
+		//  the last entry is gone: the tree is empty again
+		if(leaf.getKeyCount()==0)
+		{
+			rc = freePid(pid);
+			rootPid = -1;
+			treeHeight = 0;
+			freedLeaves = 1;
+			
+			//  the freed leaf takes its (empty) header along
+			bytes += leaf.getUsedBytes();
+		}
+		else
+			rc = leaf.write(pid, pf);
+	}
+	else if(!leaf.isUnderflow())
+		rc = leaf.write(pid, pf);
+	else
+	{
+		rc = rebalanceLeaf(path[height-2], pathIdx[height-2], leaf, pid, freedPid, bytes, held);
 		
-		//  Locate child node to look at next given the search key and update nextPid
-		rc = midNode.locateChildPtr(searchKey, nextPid);
+		if(freedPid!=-1)
+			freedLeaves = 1;
+	}
+	
+	//  walk back up: every node on the path has a new count
+	for(int h=height-2; h>=0 && rc==0; h--)
+	{
+		BTNonLeafNode& node = path[h];
+		
+		if(h==0)
+		{
+			//  a root with a single child is replaced by the child
+			if(node.getKeyCount()==0)
+			{
+				rootPid = node.getFirstPtr();
+				treeHeight--;
+				rc = freePid(pathPids[h]);
+			}
+			else
+				rc = writeInnerNode(pathPids[h], node);
+		}
+		else if(!node.isUnderflow())
+			rc = writeInnerNode(pathPids[h], node);
+		else
+			rc = rebalanceInner(path[h-1], pathIdx[h-1], node, pathPids[h], freedPid, held);
+	}
+	
+	releaseLatches(held, 0);
+	
+	if(rc!=0)
+		return rc;
+	
+	countRemove(key, lastOfKey, freedLeaves, bytes);
+	return 0;
+}
+
+/*
+ * Fix the underflow of a leaf: merge it with a sibling if both fit in one
+ * node, otherwise move entries over from the sibling. The right sibling is
+ * used, or the left one for the last child. Both leaves are written and
+ * parent is updated in memory.
+ * @param parent[IN/OUT] the parent of the leaf, latched by the caller
+ * @param idx[IN] the child number of the leaf in parent
+ * @param child[IN] the leaf, latched by the caller
+ * @param childPid[IN] the PageId of the leaf
+ * @param freedPid[OUT] the PageId of the leaf freed by a merge, -1 if none
+ * @param bytes[IN/OUT] the leaf bytes freed so far; what the two leaves
+ *        shrink by is added, as a packed leaf may change size when entries move
+ * @param held[IN/OUT] the latches held; the sibling's is added
+ * @return rc code. 0 if no rc
+ */
+RC BTreeIndex::rebalanceLeaf(BTNonLeafNode& parent, int idx, BTLeafNode& child, PageId childPid, int& freedPid, int& bytes, vector<NodeLatch*>& held)
+{
+	RC rc;
+	bool rightSibling = (idx < parent.getKeyCount());
+	int leftIdx = rightSibling ? idx : idx-1;
+	
+	PageId siblingPid;
+	int siblingCount;
+	parent.readChild(rightSibling ? idx+1 : idx-1, siblingPid, siblingCount);
+	
+	writeLatch(getLatch(siblingPid));
+	held.push_back(getLatch(siblingPid));
+	
+	BTLeafNode sibling;
+	rc = sibling.read(siblingPid, pf);
+	
+	if(rc!=0)
+		return rc;
+	
+	//  entries are about to move between nodes
+	__sync_fetch_and_add(&rebalanceEpoch, 1);
+	
+	BTLeafNode& left = rightSibling ? child : sibling;
+	BTLeafNode& right = rightSibling ? sibling : child;
+	PageId leftPid = rightSibling ? childPid : siblingPid;
+	PageId rightPid = rightSibling ? siblingPid : childPid;
+	
+	freedPid = -1;
+	bytes += child.getUsedBytes() + sibling.getUsedBytes();
+	
+	if(left.merge(right)==0)
+	{
+		rc = left.write(leftPid, pf);
 		
 		if(rc!=0)
 			return rc;
 		
-		currHeight++;
+		bytes -= left.getUsedBytes();
+		parent.removeEntry(leftIdx);
+		parent.setChildCountAt(leftIdx, left.getKeyCount());
+		
+		freedPid = rightPid;
+		return freePid(rightPid);
 	}
 	
-	rc = leaf.read(nextPid, pf);
-		
+	int siblingKey;
+	left.redistribute(right, siblingKey);
+	
+	rc = left.write(leftPid, pf);
+	
+	if(rc==0)
+		rc = right.write(rightPid, pf);
+	
 	if(rc!=0)
 		return rc;
 	
-	// Locate leaf node that contains searchKey and update eid
-	rc = leaf.locate(searchKey, eid);
+	bytes -= left.getUsedBytes() + right.getUsedBytes();
+	parent.setKey(leftIdx, siblingKey);
+	parent.setChildCountAt(leftIdx, left.getKeyCount());
+	parent.setChildCountAt(leftIdx+1, right.getKeyCount());
+	
+	return 0;
+}
+
+/*
+ * Fix the underflow of a non-leaf node, the same way as rebalanceLeaf();
+ * the key between the two nodes in parent moves down into them.
+ * @param parent[IN/OUT] the parent of the node, latched by the caller
+ * @param idx[IN] the child number of the node in parent
+ * @param child[IN] the node, latched by the caller
+ * @param childPid[IN] the PageId of the node
+ * @param freedPid[OUT] the PageId of the node freed by a merge, -1 if none
+ * @param held[IN/OUT] the latches held; the sibling's is added
+ * @return rc code. 0 if no rc
+ */
+RC BTreeIndex::rebalanceInner(BTNonLeafNode& parent, int idx, BTNonLeafNode& child, PageId childPid, int& freedPid, vector<NodeLatch*>& held)
+{
+	RC rc;
+	bool rightSibling = (idx < parent.getKeyCount());
+	int leftIdx = rightSibling ? idx : idx-1;
+	
+	PageId siblingPid;
+	int siblingCount;
+	parent.readChild(rightSibling ? idx+1 : idx-1, siblingPid, siblingCount);
+	
+	writeLatch(getLatch(siblingPid));
+	held.push_back(getLatch(siblingPid));
+	
+	BTNonLeafNode sibling;
+	rc = sibling.read(siblingPid, pf);
 	
 	if(rc!=0)
 		return rc;
 	
-	// Update indexCursor
-	cursor.eid = eid;
-	cursor.pid = nextPid;
+	//  entries are about to move between nodes
+	__sync_fetch_and_add(&rebalanceEpoch, 1);
+	
+	BTNonLeafNode& left = rightSibling ? child : sibling;
+	BTNonLeafNode& right = rightSibling ? sibling : child;
+	PageId leftPid = rightSibling ? childPid : siblingPid;
+	PageId rightPid = rightSibling ? siblingPid : childPid;
+	
+	int midKey;
+	PageId midPid;
+	parent.readEntry(leftIdx, midKey, midPid);
+	
+	freedPid = -1;
+	
+	if(left.merge(midKey, right)==0)
+	{
+		rc = writeInnerNode(leftPid, left);
+		
+		if(rc!=0)
+			return rc;
+		
+		parent.removeEntry(leftIdx);
+		parent.setChildCountAt(leftIdx, left.getTotalCount());
+		
+		freedPid = rightPid;
+		return freePid(rightPid);
+	}
+	
+	int newMidKey;
+	left.redistribute(midKey, right, newMidKey);
+	
+	rc = writeInnerNode(leftPid, left);
+	
+	if(rc==0)
+		rc = writeInnerNode(rightPid, right);
+	
+	if(rc!=0)
+		return rc;
+	
+	parent.setKey(leftIdx, newMidKey);
+	parent.setChildCountAt(leftIdx, left.getTotalCount());
+	parent.setChildCountAt(leftIdx+1, right.getTotalCount());
 	
 	return 0;
 }
 
+/*
+ * Find the leaf-node index entry whose key value is larger than or 
+ * equal to searchKey, and output the location of the entry in IndexCursor.
+ * IndexCursor is a "pointer" to a B+tree leaf-node entry consisting of
+ * the PageId of the node and the SlotID of the index entry.
+ * Note that, for range queries, we need to scan the B+tree leaf nodes.
+ * For example, if the query is "key > 1000", we should scan the leaf
+ * nodes starting with the key value 1000. For this reason,
+ * it is better to return the location of the leaf node entry 
+ * for a given searchKey, instead of returning the RecordId
+ * associated with the searchKey directly.
+ * Once the location of the index entry is identified and returned 
+ * from this function, you should call readForward() to retrieve the
+ * actual (key, rid) pair from the index.
+ * @param key[IN] the key to find.
+ * @param cursor[OUT] the cursor pointing to the first index entry
+ *                    with the key value.
+ * @return rc code. 0 if no rc.
+ */
+RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
+{
+	return descend(searchKey, cursor, NULL);
+}
+
+/*
+ * Count the index entries whose key is smaller than searchKey.
+ * On the way down, the entry counts of the children in front of the
+ * followed pointer are added up; in the leaf, the entries in front of
+ * the located one are added.
+ * @param searchKey[IN] the key to count up to
+ * @param count[OUT] the number of entries with a key < searchKey
+ * @return rc code. 0 if no rc
+ */
+RC BTreeIndex::rank(int searchKey, int& count)
+{
+	IndexCursor cursor;
+	
+	count = 0;
+	RC rc = descend(searchKey, cursor, &count);
+	
+	//  an empty index has nothing in front of any key
+	if(rc==RC_NO_SUCH_RECORD && treeHeight==0)
+		return 0;
+	
+	return rc;
+}
+
+/*
+ * Descend from the root to the leaf entry whose key value is larger than
+ * or equal to searchKey, reading every node optimistically.
+ * @param searchKey[IN] the key to find
+ * @param cursor[OUT] the cursor pointing to the entry
+ * @param before[OUT] if not NULL, the # entries in front of the cursor
+ * @return rc code. 0 if no rc
+ */
+RC BTreeIndex::descend(int searchKey, IndexCursor& cursor, int* before)
+{
+	RC rc;	
+	BTNonLeafNode midNode;
+	BTLeafNode leaf;
+	
+	int eid;
+	
+	//  readers take no latch: each node is read optimistically and
+	//  the descent starts over if a writer changed a node meanwhile
+	restart:
+	if(before!=NULL)
+		*before = 0;
+	
+	unsigned epoch = rebalanceEpoch;
+	__sync_synchronize();
+	
+	NodeLatch* parent = &rootLatch;
+	unsigned parentVersion = readVersion(parent);
+	
+	PageId nextPid = rootPid;
+	int height = treeHeight;
+	
+	if(!validateVersion(parent, parentVersion))
+		goto restart;
+	
+	if(height==0)
+		return RC_NO_SUCH_RECORD;
+	
+	for(int currHeight=1; currHeight<=height; currHeight++)
+	{
+		NodeLatch* latch = getLatch(nextPid);
+		unsigned version = readVersion(latch);
+		
+		//  the pointer to this node is only good if the parent is unchanged
+		if(!validateVersion(parent, parentVersion))
+			goto restart;
+		
+		if(currHeight==height)
+		{
+			rc = leaf.read(nextPid, pf);
+			
+			if(!validateVersion(latch, version))
+				goto restart;
+			
+			if(rc!=0)
+				return rc;
+			
+			// Locate leaf node that contains searchKey and update eid
+			rc = leaf.locate(searchKey, eid);
+			
+			if(rc!=0)
+				return rc;
+			
+			if(before!=NULL)
+				*before += eid;
+			
+			// Update indexCursor
+			cursor.eid = eid;
+			cursor.pid = nextPid;
+			cursor.key = searchKey;
+			cursor.rid.pid = 0;
+			cursor.rid.sid = 0;
+			cursor.version = version;
+			cursor.epoch = epoch;
+			cursor.postingPid = 0;
+			cursor.postingBase = 0;
+			
+			return 0;
+		}
+		
+		PageId childPid = -1;
+		
+		//  in resident mode the non-leaf levels never touch the PageFile
+		if(resident)
+			rc = locateResidentChild(nextPid, searchKey, childPid, before);
+		else
+		{
+			rc = midNode.read(nextPid, pf);
+			
+			//  Locate child node to look at next given the search key
+			if(rc==0)
+				rc = midNode.locateChildPtr(searchKey, childPid);
+			
+			if(rc==0 && before!=NULL)
+				*before += midNode.countBefore(searchKey);
+		}
+		
+		if(!validateVersion(latch, version))
+			goto restart;
+		
+		if(rc!=0)
+			return rc;
+		
+		parent = latch;
+		parentVersion = version;
+		nextPid = childPid;
+	}
+	
+	return RC_INVALID_CURSOR;
+}
+
 
 /*
  * Read the (key, rid) pair at the location specified by the index cursor,
  * and move foward the cursor to the next entry.
+ * If the leaf was changed since the cursor was set, the cursor is
+ * checked against its (key, rid) and, if it no longer points to the first
+ * entry after them, set again with locate().
  * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
  * @param key[OUT] the key stored at the index cursor location.
  * @param rid[OUT] the RecordId stored at the index cursor location.
@@ -327,40 +1303,466 @@ RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
 RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
 {
 	RC rc;
-
-	PageId cursorPid = cursor.pid;
-	int cursorEid = cursor.eid;
+	BTLeafNode leaf;
+	unsigned version;
+	unsigned epoch;
+	bool relocated = false;
 	
-	// Load data for the cursor's leaf
+	for(;;)
+	{
+		// the cursor's PageId should never go beyond an uninitialized page
+		if(cursor.pid <= 0)
+			return RC_INVALID_CURSOR;
+		
+		// a rebalance that starts after this may move entries of the leaves we read
+		epoch = rebalanceEpoch;
+		__sync_synchronize();
+		
+		// Load data for the cursor's leaf; retry if a writer changed it meanwhile
+		NodeLatch* latch = getLatch(cursor.pid);
+		version = readVersion(latch);
+		rc = leaf.read(cursor.pid, pf);
+		
+		if(!validateVersion(latch, version))
+			continue;
+		
+		if(rc!=0)
+			return rc;
+		
+		// a changed leaf may have moved our entry: check it by key, unless
+		// remove() moved entries between leaves or freed pages meanwhile
+		if(version!=cursor.version && (epoch!=cursor.epoch || !cursorInPlace(cursor, leaf)))
+		{
+			// entries of cursor.key in front of cursor.rid are skipped below
+			RecordId next = cursor.rid;
+			rc = locate(cursor.key, cursor);
+			
+			if(rc!=0)
+				return rc;
+			
+			cursor.rid = next;
+			relocated = true;
+			continue;
+		}
+		
+		// nothing left in this leaf: continue with the next one
+		if(cursor.eid >= leaf.getKeyCount())
+		{
+			cursor.pid = leaf.getNextNodePtr();
+			cursor.eid = 0;
+			cursor.version = 1;
+			cursor.epoch = epoch;
+			cursor.postingPid = 0;
+			continue;
+		}
+		
+		// Based on the cursor's eid, find return the key and rid
+		rc = leaf.readEntry(cursor.eid, key, rid);
+		
+		// the RecordId may be on a posting page; the leaf's latch covers those too
+		PageId head;
+		int pos;
+		
+		if(rc==0 && leaf.getPostingEntry(cursor.eid, head, pos))
+		{
+			rc = readPosting(head, pos, cursor, version==cursor.version, rid);
+			
+			if(!validateVersion(latch, version))
+				continue;
+		}
+		
+		if(rc!=0)
+			return rc;
+		
+		// after locate(), the entries in front of (cursor.key, cursor.rid) have been read before
+		bool seen = (relocated && key==cursor.key && rid < cursor.rid);
+		
+		// cursorEid should not exceed keys in leafNode
+		if(cursor.eid+1 >= leaf.getKeyCount())
+		{
+			cursor.eid = 0;
+			cursor.pid = leaf.getNextNodePtr();
+			cursor.version = 1;  // the version of the next leaf is not known yet
+			cursor.postingPid = 0;
+		}
+		else
+		{
+			cursor.eid++;
+			cursor.version = version;
+		}
+		cursor.epoch = epoch;
+		
+		if(seen)
+			continue;
+		
+		// the next entry must come after the one just read
+		cursor.key = key;
+		cursor.rid = rid;
+		++cursor.rid;
+		
+		return 0;
+	}
+}
+
+/*
+ * Move the cursor forward to the first entry whose key is larger than or
+ * equal to searchKey. If the leaf the cursor has read last still holds a
+ * key as large as searchKey, the entry is found in it, which is likely in
+ * the cache; otherwise, or if the leaf may have changed under the cursor,
+ * the cursor is set again from the root.
+ * @param searchKey[IN] the key to find
+ * @param cursor[IN/OUT] the cursor pointing to the entry
+ * @return rc code. 0 if no rc
+ */
+RC BTreeIndex::seek(int searchKey, IndexCursor& cursor)
+{
+	RC rc;
 	BTLeafNode leaf;
-	rc = leaf.read(cursorPid, pf);
+	int eid, lastKey;
+	RecordId lastRid;
+	
+	//  the next entry is at least (cursor.key, cursor.rid) already
+	if(searchKey<=cursor.key)
+		return 0;
+	
+	//  a cursor that moved on to a leaf it has not read yet (odd version)
+	//  knows nothing of that leaf, so it descends like one that remove()
+	//  may have moved entries away from
+	unsigned epoch = rebalanceEpoch;
+	__sync_synchronize();
+	
+	if(cursor.pid>0 && cursor.version%2==0 && epoch==cursor.epoch)
+	{
+		NodeLatch* latch = getLatch(cursor.pid);
+		unsigned version = readVersion(latch);
+		rc = leaf.read(cursor.pid, pf);
+		
+		if(rc==0 && validateVersion(latch, version) && leaf.getKeyCount()>0 &&
+		   leaf.readEntry(leaf.getKeyCount()-1, lastKey, lastRid)==0 &&
+		   searchKey<=lastKey && leaf.locate(searchKey, eid)==0)
+		{
+			cursor.eid = eid;
+			cursor.key = searchKey;
+			cursor.rid.pid = 0;
+			cursor.rid.sid = 0;
+			cursor.version = version;
+			cursor.epoch = epoch;
+			cursor.postingPid = 0;
+			cursor.postingBase = 0;
+			
+			return 0;
+		}
+	}
+	
+	return locate(searchKey, cursor);
+}
+
+/*
+ * Read the RecordId at position pos of the posting list on the pages
+ * starting at head. A scan goes on from the page it read last, as long as
+ * the leaf is unchanged, so that it reads every posting page once.
+ * @param head[IN] the first posting page of the key
+ * @param pos[IN] the position in the posting list
+ * @param cursor[IN/OUT] the cursor; the page holding pos is remembered in it
+ * @param sameLeaf[IN] true if the leaf is unchanged since the cursor was set
+ * @param rid[OUT] the RecordId
+ * @return rc code. 0 if no rc
+ */
+RC BTreeIndex::readPosting(PageId head, int pos, IndexCursor& cursor, bool sameLeaf, RecordId& rid)
+{
+	BTPostingNode page;
+	PageId pid = head;
+	int base = 0;
+	
+	if(sameLeaf && cursor.postingPid > 0 && cursor.postingHead==head && cursor.postingBase <= pos)
+	{
+		pid = cursor.postingPid;
+		base = cursor.postingBase;
+	}
+	
+	// a chain that changes under an optimistic reader may end early or even
+	// loop; the caller finds out from the leaf's version and starts over
+	for(PageId steps=0; ; steps++)
+	{
+		if(pid <= 0 || steps > pf.endPid())
+			return RC_INVALID_CURSOR;
+		
+		RC rc = page.read(pid, pf);
+		
+		if(rc!=0)
+			return rc;
+		
+		if(pos < base+page.getCount())
+			break;
+		
+		base += page.getCount();
+		pid = page.getNextPtr();
+	}
+	
+	cursor.postingPid = pid;
+	cursor.postingBase = base;
+	cursor.postingHead = head;
+	
+	return page.readEntry(pos-base, rid);
+}
+
+/*
+ * Add rid to the posting pages of a key. It goes to the first page that
+ * ends at or behind it, or to the last page; a full page is split.
+ * The caller holds the latch of the key's leaf.
+ * @param head[IN] the first posting page of the key
+ * @param rid[IN] the RecordId to add
+ * @return rc code. 0 if no rc
+ */
+RC BTreeIndex::insertPosting(PageId head, const RecordId& rid)
+{
+	RC rc;
+	BTPostingNode page;
+	PageId pid = head;
+	
+	for(;;)
+	{
+		rc = page.read(pid, pf);
+		
+		if(rc!=0)
+			return rc;
+		
+		RecordId last;
+		if(page.getNextPtr() <= 0 || (page.readEntry(page.getCount()-1, last)==0 && !(last < rid)))
+			break;
+		
+		pid = page.getNextPtr();
+	}
+	
+	if(page.insert(rid)==0)
+		return page.write(pid, pf);
+	
+	BTPostingNode sibling;
+	rc = page.insertAndSplit(rid, sibling);
 	
 	if(rc!=0)
 		return rc;
 	
-	// Based on the cursor's eid, find return the key and rid
-	rc = leaf.readEntry(cursorEid, key, rid);
+	PageId siblingPid = allocatePid();
+	sibling.setNextPtr(page.getNextPtr());
+	page.setNextPtr(siblingPid);
+	
+	rc = sibling.write(siblingPid, pf);
 	
 	if(rc!=0)
 		return rc;
-		
-	// the cursor's PageId should never go beyond an uninitialized page
-	if(cursorPid <= 0)
-		return RC_INVALID_CURSOR;
 	
-	// cursorEid should not exceed keys in leafNode
-	if(cursorEid+1 >= leaf.getKeyCount())
+	return page.write(pid, pf);
+}
+
+/*
+ * Take rid off the posting pages of a key; a page left empty is unlinked
+ * and freed. The caller holds the latch of the key's leaf.
+ * @param head[IN/OUT] the first posting page of the key; 0 once all are freed
+ * @param rid[IN] the RecordId to remove
+ * @return rc code. RC_NO_SUCH_RECORD if rid is not on the pages
+ */
+RC BTreeIndex::removePosting(PageId& head, const RecordId& rid)
+{
+	RC rc;
+	BTPostingNode page;
+	PageId prevPid = 0;
+	PageId pid = head;
+	
+	for(;;)
 	{
-		cursorEid = 0;
-		cursorPid = leaf.getNextNodePtr();
+		if(pid <= 0)
+			return RC_NO_SUCH_RECORD;
+		
+		rc = page.read(pid, pf);
+		
+		if(rc!=0)
+			return rc;
+		
+		if(page.remove(rid)==0)
+			break;
+		
+		//  the pages are sorted: a page ending behind rid would hold it
+		RecordId last;
+		if(page.readEntry(page.getCount()-1, last)==0 && !(last < rid))
+			return RC_NO_SUCH_RECORD;
+		
+		prevPid = pid;
+		pid = page.getNextPtr();
 	}
+	
+	if(page.getCount() > 0)
+		return page.write(pid, pf);
+	
+	if(prevPid==0)
+		head = page.getNextPtr();
 	else
-		cursorEid++;
+	{
+		BTPostingNode prev;
+		rc = prev.read(prevPid, pf);
+		
+		if(rc==0)
+			rc = prev.setNextPtr(page.getNextPtr());
+		
+		if(rc==0)
+			rc = prev.write(prevPid, pf);
+		
+		if(rc!=0)
+			return rc;
+	}
 	
-	// Write into cursor
-	cursor.eid = cursorEid;
-	cursor.pid = cursorPid;
-	return 0;
+	return freePid(pid);
+}
+
+/*
+ * Move the posting list of key from the leaf to posting pages once it
+ * takes more than BTLeafNode::MAX_POSTING_BYTES of the leaf. The pages are
+ * filled up in RecordId order. The caller holds the latch of the leaf
+ * and writes it afterwards.
+ * @param leaf[IN/OUT] the leaf holding key
+ * @param key[IN] the key whose posting list just grew
+ * @return rc code. 0 if no rc
+ */
+RC BTreeIndex::spillPosting(BTLeafNode& leaf, int key)
+{
+	if(leaf.getPostingBytes(key) <= BTLeafNode::MAX_POSTING_BYTES)
+		return 0;
+	
+	vector<RecordId> rids;
+	RC rc = leaf.readPosting(key, rids);
+	
+	if(rc!=0)
+		return rc;
+	
+	PageId head = allocatePid();
+	PageId pid = head;
+	BTPostingNode page;
+	
+	for(unsigned i=0; i<rids.size(); i++)
+	{
+		if(page.insert(rids[i])==0)
+			continue;
+		
+		//  the page is full: link it to a new one
+		PageId next = allocatePid();
+		page.setNextPtr(next);
+		rc = page.write(pid, pf);
+		
+		if(rc!=0)
+			return rc;
+		
+		page = BTPostingNode();
+		pid = next;
+		page.insert(rids[i]);
+	}
+	
+	rc = page.write(pid, pf);
+	
+	if(rc!=0)
+		return rc;
+	
+	return leaf.setPosting(key, head, rids.size());
+}
+
+/*
+ * Check that the cursor still points to the first entry of the leaf
+ * that is larger than or equal to (cursor.key, cursor.rid). An entry whose
+ * RecordId is on a posting page is not trusted.
+ * @param cursor[IN] the cursor to check
+ * @param leaf[IN] the leaf the cursor points into
+ * @return true if the cursor is in place
+ */
+bool BTreeIndex::cursorInPlace(const IndexCursor& cursor, BTLeafNode& leaf)
+{
+	int key;
+	RecordId rid;
+	
+	if(cursor.eid > leaf.getKeyCount())
+		return false;
+	
+	if(cursor.eid < leaf.getKeyCount())
+	{
+		leaf.readEntry(cursor.eid, key, rid);
+		if(key < cursor.key || (key==cursor.key && (rid.pid < 0 || rid < cursor.rid)))
+			return false;
+	}
+	
+	if(cursor.eid > 0)
+	{
+		leaf.readEntry(cursor.eid-1, key, rid);
+		if(key > cursor.key || (key==cursor.key && (rid.pid < 0 || !(rid < cursor.rid))))
+			return false;
+	}
+	
+	return true;
+}
+
+/*
+ * Find the largest key in the index by following the last child-node
+ * pointer down to the last leaf. Nodes are read optimistically like locate().
+ * @param key[OUT] the largest key
+ * @return rc code. 0 if no rc
+ */
+RC BTreeIndex::readLastKey(int& key)
+{
+	RC rc;
+	BTNonLeafNode midNode;
+	BTLeafNode leaf;
+	RecordId rid;
+	
+	restart:
+	NodeLatch* parent = &rootLatch;
+	unsigned parentVersion = readVersion(parent);
+	
+	PageId nextPid = rootPid;
+	int height = treeHeight;
+	
+	if(!validateVersion(parent, parentVersion))
+		goto restart;
+	
+	if(height==0)
+		return RC_NO_SUCH_RECORD;
+	
+	for(int currHeight=1; currHeight<=height; currHeight++)
+	{
+		NodeLatch* latch = getLatch(nextPid);
+		unsigned version = readVersion(latch);
+		
+		if(!validateVersion(parent, parentVersion))
+			goto restart;
+		
+		if(currHeight==height)
+		{
+			rc = leaf.read(nextPid, pf);
+			
+			if(rc==0)
+				rc = leaf.readEntry(leaf.getKeyCount()-1, key, rid);
+			
+			if(!validateVersion(latch, version))
+				goto restart;
+			
+			return rc;
+		}
+		
+		PageId childPid = -1;
+		int count;
+		rc = midNode.read(nextPid, pf);
+		
+		if(rc==0)
+			rc = midNode.readChild(midNode.getKeyCount(), childPid, count);
+		
+		if(!validateVersion(latch, version))
+			goto restart;
+		
+		if(rc!=0)
+			return rc;
+		
+		parent = latch;
+		parentVersion = version;
+		nextPid = childPid;
+	}
+	
+	return RC_INVALID_CURSOR;
 }
 
 PageId BTreeIndex::getRootPid()
@@ -373,3 +1775,86 @@ int BTreeIndex::getTreeHeight()
 	return treeHeight;
 }
 
+int BTreeIndex::getEntryCount()
+{
+	pthread_mutex_lock(&statsMutex);
+	int count = entryCount;
+	pthread_mutex_unlock(&statsMutex);
+	
+	return count;
+}
+
+int BTreeIndex::getDistinctKeyCount()
+{
+	pthread_mutex_lock(&statsMutex);
+	int count = distinctKeys;
+	pthread_mutex_unlock(&statsMutex);
+	
+	return count;
+}
+
+int BTreeIndex::getMinKey()
+{
+	pthread_mutex_lock(&statsMutex);
+	int key = minKey;
+	pthread_mutex_unlock(&statsMutex);
+	
+	return key;
+}
+
+int BTreeIndex::getMaxKey()
+{
+	pthread_mutex_lock(&statsMutex);
+	int key = maxKey;
+	pthread_mutex_unlock(&statsMutex);
+	
+	return key;
+}
+
+int BTreeIndex::getLeafCount()
+{
+	pthread_mutex_lock(&statsMutex);
+	int count = leafCount;
+	pthread_mutex_unlock(&statsMutex);
+	
+	return count;
+}
+
+double BTreeIndex::getFillFactor()
+{
+	pthread_mutex_lock(&statsMutex);
+	long long bytes = leafBytes;
+	int leaves = leafCount;
+	pthread_mutex_unlock(&statsMutex);
+	
+	if(leaves==0)
+		return 0;
+	
+	return (double)bytes / ((double)leaves * PageFile::PAGE_SIZE);
+}
+
+time_t BTreeIndex::getBuildTime()
+{
+	return (time_t)buildTime;
+}
+
+int BTreeIndex::getPageCount()
+{
+	pthread_mutex_lock(&allocMutex);
+	int count = pf.endPid();
+	if(count < nextPid)
+		count = nextPid;
+	pthread_mutex_unlock(&allocMutex);
+	
+	return count;
+}
+
+int BTreeIndex::getFreePageCount()
+{
+	pthread_mutex_lock(&allocMutex);
+	int count = freePages;
+	pthread_mutex_unlock(&allocMutex);
+	
+	return count;
+}
+
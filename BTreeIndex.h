@@ -13,8 +13,13 @@
 #include "Bruinbase.h"
 #include "PageFile.h"
 #include "RecordFile.h"
+#include "BTreeNode.h"
 #include <string.h>
 #include <stdlib.h>
+#include <map>
+#include <vector>
+#include <pthread.h>
+#include <ctime>
  
              
 /**
@@ -22,30 +27,62 @@
  * An IndexCursor consists of pid (PageId of the leaf node) and 
  * eid (the location of the index entry inside the node).
  * IndexCursor is used for index lookup and traversal.
+ * key, rid and version let readForward() notice that the leaf was changed
+ * by another thread after the cursor was set, and find its place again;
+ * epoch tells it whether remove() may have moved entries or freed the leaf since.
+ * Inside a posting list kept on posting pages, postingPid and postingBase
+ * remember the page the cursor is in, so a scan reads each page in turn;
+ * postingHead tells which key's list that page belongs to.
  */
 typedef struct {
   // PageId of the index entry
   PageId  pid;  
   // The entry number inside the node
   int     eid;  
+  // The next entry to read is larger than or equal to (key, rid)
+  int     key;
+  RecordId rid;
+  // The version of the leaf when the cursor was set (odd if unknown)
+  unsigned version;
+  // The rebalance epoch of the index when the cursor was set
+  unsigned epoch;
+  // The posting page holding the entry, if any, the position of its first
+  // RecordId, and the first posting page of the key
+  PageId  postingPid;
+  int     postingBase;
+  PageId  postingHead;
 } IndexCursor;
 
 /**
  * Implements a B-Tree index for bruinbase.
  * 
+ * Several threads may call insert(), locate() and readForward() on the
+ * same open index. Writers latch the part of the path that may split.
+ * Readers take no latch at all: every node has a version that a writer
+ * makes odd while it holds the node, and even again when it is done.
+ * A reader notes the version before reading a node and checks it again
+ * afterwards (optimistic lock coupling); if it changed, it starts over.
  */
 class BTreeIndex {
  public:
   BTreeIndex();
+  ~BTreeIndex();
 
   /**
    * Open the index file in read or write mode.
    * Under 'w' mode, the index file should be created if it does not exist.
+   * In resident mode every non-leaf node is loaded into memory here and
+   * kept up to date by insert(), so that locate() only reads the leaf.
+   * It pays off for an index that serves many lookups while it is open,
+   * as in BTreeBench. SqlEngine opens an index for a single statement,
+   * where loading the non-leaf nodes reads at least the pages one
+   * descent from the root would, so it does not use resident mode.
    * @param indexname[IN] the name of the index file
    * @param mode[IN] 'r' for read, 'w' for write
+   * @param resident[IN] true to keep all non-leaf nodes in memory
    * @return error code. 0 if no error
    */
-  RC open(const std::string& indexname, char mode);
+  RC open(const std::string& indexname, char mode, bool resident = false);
 
   /**
    * Close the index file.
@@ -61,8 +98,16 @@ class BTreeIndex {
    */
   RC insert(int key, const RecordId& rid);
 
-  //Recursive function for inserting key into correct leaf and non-leaf nodes alike
-  RC insert_recursive(int key, const RecordId& rid, int currHeight, PageId thisPid, int& tempKey, PageId& tempPid);
+  /**
+   * Remove (key, RecordId) pair from the index.
+   * A node left less than half full borrows entries from a sibling or is
+   * merged with it; pages of merged nodes go on a free list that is used
+   * before the file grows again.
+   * @param key[IN] the key of the entry to remove
+   * @param rid[IN] the RecordId of the entry to remove
+   * @return error code. RC_NO_SUCH_RECORD if the pair is not in the index
+   */
+  RC remove(int key, const RecordId& rid);
   
   /**
    * Find the leaf-node index entry whose key value is larger than or
@@ -96,9 +141,60 @@ class BTreeIndex {
    * @return error code. 0 if no error
    */
   RC readForward(IndexCursor& cursor, int& key, RecordId& rid);
+
+  /**
+   * Move the cursor forward to the first entry whose key is larger than
+   * or equal to searchKey. The leaf the cursor is in is searched first,
+   * so that probes for ascending keys close to each other do not descend
+   * from the root; a key beyond that leaf is found with locate().
+   * @param searchKey[IN] the key to find
+   * @param cursor[IN/OUT] the cursor; it stays if its next entry is not
+   *        smaller than searchKey
+   * @return error code. 0 if no error
+   */
+  RC seek(int searchKey, IndexCursor& cursor);
+
+  /**
+   * Count the index entries whose key is smaller than searchKey.
+   * Every non-leaf node keeps the number of entries under each child,
+   * so this takes one root-to-leaf descent and reads no other leaf.
+   * The number of entries in [lo, hi) is rank(hi) - rank(lo).
+   * @param searchKey[IN] the key to count up to
+   * @param count[OUT] the number of entries with a key < searchKey
+   * @return error code. 0 if no error
+   */
+  RC rank(int searchKey, int& count);
   
   PageId getRootPid();
   int getTreeHeight();
+
+  /**
+   * Statistics kept in the metadata page (pid 0) of the index.
+   * They are kept up to date by insert() and written by close().
+   */
+
+  // the number of (key, rid) pairs inserted into the index
+  int getEntryCount();
+
+  // the number of different keys in the index
+  int getDistinctKeyCount();
+
+  // the smallest and the largest key in the index (only if getEntryCount() > 0)
+  int getMinKey();
+  int getMaxKey();
+
+  // the number of leaf nodes
+  int getLeafCount();
+
+  // the average fraction of the leaf pages in use, from 0 to 1
+  double getFillFactor();
+
+  // the time the index was last changed and closed (0 if never)
+  time_t getBuildTime();
+
+  // the number of pages in the index file, and how many are on the free list
+  int getPageCount();
+  int getFreePageCount();
   
  private:
   PageFile pf;         /// the PageFile used to store the actual b+tree in disk
@@ -109,10 +205,169 @@ class BTreeIndex {
   /// this class is destructed. Make sure to store the values of the two 
   /// variables in disk, so that they can be reconstructed when the index
   /// is opened again later.
+
+  /**
+   * Layout of the metadata page (pid 0) of the index file.
+   */
+  struct IndexHeader {
+    PageId    rootPid;       // the PageId of the root node
+    int       treeHeight;    // the height of the tree
+    int       entryCount;    // # (key, rid) pairs in the index
+    int       formatVersion; // FORMAT_VERSION of the code that wrote the file
+    int       pageSize;      // PageFile::PAGE_SIZE of the code that wrote the file
+    int       distinctKeys;  // # different keys
+    int       minKey;        // the smallest key
+    int       maxKey;        // the largest key
+    int       leafCount;     // # leaf nodes
+    int       fillPerMille;  // average leaf fill factor, in 1/1000
+    long long buildTime;     // time of the last close() after a change
+    PageId    freeList;      // the first free page, 0 if none
+    int       freePages;     // # pages on the free list
+    long long leafBytes;     // # bytes in use in all leaf pages
+  };
+
+  // version of the on-disk format; files with another version are rejected
+  static const int FORMAT_VERSION = 6;
+
+  int       entryCount;   /// the number of entries in the index
+  int       distinctKeys; /// the number of different keys
+  int       minKey;       /// the smallest key in the index
+  int       maxKey;       /// the largest key in the index
+  int       leafCount;    /// the number of leaf nodes
+  long long leafBytes;    /// the number of bytes in use in all leaf pages
+  long long buildTime;    /// the time the index was last changed and closed
+  bool      writable;     /// true if opened in 'w' mode
+  bool      modified;     /// true if the index was changed since open()
+  pthread_mutex_t statsMutex; /// protects the statistics above
+
+  PageId    freeList;     /// the first free page; each holds the PageId of the next
+  int       freePages;    /// the number of pages on the free list
+  volatile unsigned rebalanceEpoch; /// bumped before remove() moves entries between nodes
   
-  //buffer with pid=0 to store rootPid and treeHeight in disk
+  //buffer with pid=0 to store the IndexHeader in disk
   char buffer[PageFile::PAGE_SIZE]; 
-  
+
+  //write the IndexHeader to the metadata page
+  RC writeHeader();
+
+  //update the statistics after an insert; newLeaves is the # leaves it created
+  //and bytes the # bytes it added to leaf pages
+  void countInsert(int key, bool newKey, int newLeaves, int bytes);
+
+  //update the statistics after a remove; freedLeaves is the # leaves it freed
+  //and bytes the # bytes it took from leaf pages
+  void countRemove(int key, bool lastOfKey, int freedLeaves, int bytes);
+
+  //find the largest key in the index
+  RC readLastKey(int& key);
+
+  // maximum # keys in a non-leaf node
+  static const int MAX_INNER_KEYS = BTNonLeafNode::MAX_KEY_COUNT;
+
+  /**
+   * Compact in-memory copy of a non-leaf node for resident mode.
+   * children[i] holds the keys smaller than keys[i];
+   * the last child holds everything else.
+   * counts[i] is the number of leaf entries under children[i].
+   * Fixed-size arrays, so that an optimistic reader racing with a
+   * writer never follows freed memory.
+   */
+  struct ResidentNode {
+    int    keyCount;
+    int    keys[MAX_INNER_KEYS];
+    PageId children[MAX_INNER_KEYS+1];
+    int    counts[MAX_INNER_KEYS+1];
+  };
+
+  /**
+   * Latch of a node. Writers lock the mutex; readers only look at the
+   * version, which is odd while a writer holds the node.
+   */
+  struct NodeLatch {
+    pthread_mutex_t   lock;
+    volatile unsigned version;
+  };
+
+  bool resident;                             /// true if opened in resident mode
+  std::map<PageId, ResidentNode> innerNodes; /// non-leaf nodes keyed by PageId
+
+  //load every non-leaf node from disk into innerNodes
+  RC loadInnerNodes();
+
+  //refresh the resident copy of the non-leaf node stored at pid
+  void cacheInnerNode(PageId pid, BTNonLeafNode& node);
+
+  //write a non-leaf node to disk and keep its resident copy consistent
+  RC writeInnerNode(PageId pid, BTNonLeafNode& node);
+
+  //find the child to follow from the resident copy of the non-leaf node pid
+  //and, if before is given, add the # entries under the children in front of it
+  RC locateResidentChild(PageId pid, int searchKey, PageId& childPid, int* before);
+
+  NodeLatch        rootLatch;   /// protects rootPid and treeHeight
+  pthread_mutex_t  latchMutex;  /// protects the latches map
+  pthread_mutex_t  allocMutex;  /// protects nextPid
+  pthread_mutex_t  residentMutex; /// protects the innerNodes map (not its nodes)
+  std::map<PageId, NodeLatch*> latches; /// node latches keyed by PageId
+  PageId nextPid;               /// the next PageId handed out by allocatePid()
+
+  //Recursive function for inserting key into correct leaf and non-leaf nodes alike
+  //height is the tree height when the insert started; held are the latches on the path
+  //on a split, tempCount is the number of entries moved to the new node tempPid;
+  //rightEdge is true if thisPid is the right-most node of its level
+  RC insert_recursive(int key, const RecordId& rid, int currHeight, int height, PageId thisPid, bool rightEdge, int& tempKey, PageId& tempPid, int& tempCount, std::vector<NodeLatch*>& held);
+
+  //optimistic descent shared by locate() and rank(); if before is given,
+  //it is set to the number of entries in front of the returned cursor
+  RC descend(int searchKey, IndexCursor& cursor, int* before);
+
+  //true if cursor points to the first entry of leaf >= (cursor.key, cursor.rid)
+  bool cursorInPlace(const IndexCursor& cursor, BTLeafNode& leaf);
+
+  //read the RecordId at position pos of the posting pages starting at head;
+  //the cursor's posting page is used if it is at or in front of pos
+  RC readPosting(PageId head, int pos, IndexCursor& cursor, bool sameLeaf, RecordId& rid);
+
+  //add rid to the posting pages of a key starting at head
+  RC insertPosting(PageId head, const RecordId& rid);
+
+  //take rid off the posting pages starting at head; head changes if the first page is freed
+  RC removePosting(PageId& head, const RecordId& rid);
+
+  //move the posting list of key to posting pages once it is too long for the leaf
+  RC spillPosting(BTLeafNode& leaf, int key);
+
+  //return the latch of the node stored at pid, creating it on first use
+  NodeLatch* getLatch(PageId pid);
+
+  //lock a node for writing and make its version odd
+  void writeLatch(NodeLatch* latch);
+
+  //make the version of a node even again and unlock it
+  void writeUnlatch(NodeLatch* latch);
+
+  //wait until no writer holds the node and return its version
+  unsigned readVersion(NodeLatch* latch);
+
+  //true if the node has not been changed since its version was read
+  bool validateVersion(NodeLatch* latch, unsigned version);
+
+  //release the latches in held, except for the last keep ones
+  void releaseLatches(std::vector<NodeLatch*>& held, unsigned keep);
+
+  //destroy all node latches
+  void freeLatches();
+
+  //reserve the PageId for a new node, reusing a free page if there is one
+  PageId allocatePid();
+
+  //put the page of a removed node on the free list
+  RC freePid(PageId pid);
+
+  //fix an underflow of the child at idx of parent by borrowing from or
+  //merging with a sibling; held collects the latches taken on siblings
+  RC rebalanceLeaf(BTNonLeafNode& parent, int idx, BTLeafNode& child, PageId childPid, int& freedPid, int& bytes, std::vector<NodeLatch*>& held);
+  RC rebalanceInner(BTNonLeafNode& parent, int idx, BTNonLeafNode& child, PageId childPid, int& freedPid, std::vector<NodeLatch*>& held);
 };
 
 #endif /* BTREEINDEX_H */
\ No newline at end of file
@@ -1,369 +1,1678 @@
 #include "BTreeNode.h"
 #include <iostream>
+#include <algorithm>
+#include <climits>
+#include <immintrin.h>
 
 using namespace std;
 
+//Layout of a leaf node in its page:
+//  [slot count (2 bytes)][slot bytes (2 bytes)] [slot] [slot] ... [next pid]
+//Every slot holds one key and its posting list:
+//  [key][n*2] [rid] [rid] ...       n RecordIds kept in the leaf, or
+//  [key][1] [count][first page]     count RecordIds kept on posting pages.
+//A RecordId is stored as the difference to the one in front of it, counted
+//in record slots, as a varint; records loaded one after the other thus take
+//one byte each. The first RecordId of a list is counted from 0.
+//
+//A leaf whose keys all have one RecordId in the leaf may be packed instead
+//(frame of reference): the high bit of the slot bytes is set and the slots are
+//  [key base][key bits (1 byte)][rid bits (1 byte)][rid base (varint)]
+//  [key - key base, key bits each] ... [rid - rid base, rid bits each] ...
+//Every key or RecordId then takes the same number of bits, so the i-th one is
+//found without reading the ones in front of it.
+
+//Size in bytes of the header in front of the slots and of the whole page that slots may use
+static const int LEAF_HEADER = 2*sizeof(unsigned short);
+static const int LEAF_CAPACITY = PageFile::PAGE_SIZE - LEAF_HEADER - sizeof(PageId);
+
+//Room an unpacked split keeps for a slot that does not fit on either side:
+//a posting list up to BTLeafNode::MAX_POSTING_BYTES and the entry being inserted
+static const int SPLIT_SLACK = LEAF_CAPACITY/4;
+
+//The slot bytes of a packed leaf have this bit set
+static const unsigned short LEAF_PACKED = 0x8000;
+
+//The widest RecordId difference a packed leaf stores, so that a field with
+//its first bit anywhere in a byte fits into one 64-bit word
+static const int MAX_RID_BITS = 56;
+
+//A packed leaf is searched by bisection until this many keys are left
+static const int LOCATE_WINDOW = 16;
+
+//Size in bytes of the header of a posting page (next pid, count, bytes) and of its RecordIds
+static const int POSTING_HEADER = sizeof(PageId) + 2*sizeof(unsigned short);
+static const int POSTING_CAPACITY = PageFile::PAGE_SIZE - POSTING_HEADER;
+
+//The position of a RecordId in its file, counted in record slots
+static unsigned long long ridOrdinal(const RecordId& rid)
+{
+	return (unsigned long long)rid.pid * RecordFile::RECORDS_PER_PAGE + rid.sid;
+}
+
+static RecordId ordinalRid(unsigned long long ordinal)
+{
+	RecordId rid;
+	rid.pid = (PageId)(ordinal / RecordFile::RECORDS_PER_PAGE);
+	rid.sid = (int)(ordinal % RecordFile::RECORDS_PER_PAGE);
+	return rid;
+}
+
+//Only RecordIds that point to a record slot can be delta-encoded
+static bool validRid(const RecordId& rid)
+{
+	return rid.pid >= 0 && rid.sid >= 0 && rid.sid < RecordFile::RECORDS_PER_PAGE;
+}
+
+//A varint keeps 7 bits in each byte; the high bit is set on all but the last byte
+static int varintSize(unsigned long long v)
+{
+	int size = 1;
+	
+	for(; v >= 0x80; v >>= 7)
+		size++;
+	
+	return size;
+}
+
+static char* putVarint(char* p, unsigned long long v)
+{
+	for(; v >= 0x80; v >>= 7)
+		*p++ = (char)(v | 0x80);
+	
+	*p++ = (char)v;
+	return p;
+}
+
+//Read a varint that must end before end; NULL if it does not
+static const char* getVarint(const char* p, const char* end, unsigned long long& v)
+{
+	v = 0;
+	
+	for(int shift=0; p<end && shift<64; shift+=7)
+	{
+		unsigned char byte = *p++;
+		v |= (unsigned long long)(byte & 0x7f) << shift;
+		
+		if(!(byte & 0x80))
+			return p;
+	}
+	
+	return NULL;
+}
+
+//Number of bits needed for values from 0 to range
+static int bitWidth(unsigned long long range)
+{
+	int bits = 0;
+	
+	for(; range > 0; range >>= 1)
+		bits++;
+	
+	return bits;
+}
+
+//Read the width-bit field starting at bit of p; p must have a word of room behind the field
+static inline unsigned long long extractBits(const char* p, int bit, int width)
+{
+	unsigned long long word;
+	memcpy(&word, p+(bit >> 3), sizeof(word));
+	
+	return (word >> (bit & 7)) & ((1ULL << width) - 1);
+}
+
+//Store v in the (zeroed) width-bit field starting at bit of p; same room needed
+static inline void depositBits(char* p, int bit, unsigned long long v)
+{
+	unsigned long long word;
+	memcpy(&word, p+(bit >> 3), sizeof(word));
+	word |= v << (bit & 7);
+	memcpy(p+(bit >> 3), &word, sizeof(word));
+}
+
+//A kernel unpacks the width-bit fields from, from+1, ..., from+n-1 of p into out
+typedef void (*UnpackKernel)(const char* p, int width, int from, int n, unsigned long long* out);
+
+//A kernel counts the width-bit fields from, ..., from+n-1 of p that are smaller than v
+typedef int (*CountBelowKernel)(const char* p, int width, int from, int n, long long v);
+
+static void unpackScalar(const char* p, int width, int from, int n, unsigned long long* out)
+{
+	for(int i=0; i<n; i++)
+		out[i] = extractBits(p, (from+i)*width, width);
+}
+
+static int countBelowScalar(const char* p, int width, int from, int n, long long v)
+{
+	int count = 0;
+	
+	for(int i=0; i<n; i++)
+		count += (long long)extractBits(p, (from+i)*width, width) < v;
+	
+	return count;
+}
+
+//AVX2 gathers the words holding 4 fields at a time, then shifts and masks
+//each lane on its own; the last few fields are done one at a time
+__attribute__((target("avx2")))
+static void unpackAvx2(const char* p, int width, int from, int n, unsigned long long* out)
+{
+	const __m256i step = _mm256_set_epi64x(3LL*width, 2LL*width, width, 0);
+	const __m256i seven = _mm256_set1_epi64x(7);
+	const __m256i mask = _mm256_set1_epi64x((1LL << width) - 1);
+	int i = 0;
+	
+	for(; i+4 <= n; i+=4)
+	{
+		__m256i bit = _mm256_add_epi64(_mm256_set1_epi64x((long long)(from+i)*width), step);
+		__m256i word = _mm256_i64gather_epi64((const long long*)p, _mm256_srli_epi64(bit, 3), 1);
+		word = _mm256_and_si256(_mm256_srlv_epi64(word, _mm256_and_si256(bit, seven)), mask);
+		_mm256_storeu_si256((__m256i*)(out+i), word);
+	}
+	
+	unpackScalar(p, width, from+i, n-i, out+i);
+}
+
+__attribute__((target("avx2")))
+static int countBelowAvx2(const char* p, int width, int from, int n, long long v)
+{
+	const __m256i step = _mm256_set_epi64x(3LL*width, 2LL*width, width, 0);
+	const __m256i seven = _mm256_set1_epi64x(7);
+	const __m256i mask = _mm256_set1_epi64x((1LL << width) - 1);
+	const __m256i value = _mm256_set1_epi64x(v);
+	int count = 0, i = 0;
+	
+	for(; i+4 <= n; i+=4)
+	{
+		__m256i bit = _mm256_add_epi64(_mm256_set1_epi64x((long long)(from+i)*width), step);
+		__m256i word = _mm256_i64gather_epi64((const long long*)p, _mm256_srli_epi64(bit, 3), 1);
+		word = _mm256_and_si256(_mm256_srlv_epi64(word, _mm256_and_si256(bit, seven)), mask);
+		count += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(value, word))));
+	}
+	
+	return count + countBelowScalar(p, width, from+i, n-i, v);
+}
+
+//AVX-512 does the same for 8 fields at a time, compared straight into a mask;
+//the masked forms keep GCC from warning about the undefined lanes of the others
+__attribute__((target("avx512f")))
+static void unpackAvx512(const char* p, int width, int from, int n, unsigned long long* out)
+{
+	const __m512i step = _mm512_set_epi64(7LL*width, 6LL*width, 5LL*width, 4LL*width,
+	                                      3LL*width, 2LL*width, width, 0);
+	const __m512i seven = _mm512_set1_epi64(7);
+	const __m512i mask = _mm512_set1_epi64((1LL << width) - 1);
+	const __m512i zero = _mm512_setzero_si512();
+	int i = 0;
+	
+	for(; i+8 <= n; i+=8)
+	{
+		__m512i bit = _mm512_add_epi64(_mm512_set1_epi64((long long)(from+i)*width), step);
+		__m512i word = _mm512_mask_i64gather_epi64(zero, 0xff, _mm512_maskz_srli_epi64(0xff, bit, 3), p, 1);
+		word = _mm512_and_si512(_mm512_maskz_srlv_epi64(0xff, word, _mm512_and_si512(bit, seven)), mask);
+		_mm512_storeu_si512((void*)(out+i), word);
+	}
+	
+	unpackScalar(p, width, from+i, n-i, out+i);
+}
+
+__attribute__((target("avx512f")))
+static int countBelowAvx512(const char* p, int width, int from, int n, long long v)
+{
+	const __m512i step = _mm512_set_epi64(7LL*width, 6LL*width, 5LL*width, 4LL*width,
+	                                      3LL*width, 2LL*width, width, 0);
+	const __m512i seven = _mm512_set1_epi64(7);
+	const __m512i mask = _mm512_set1_epi64((1LL << width) - 1);
+	const __m512i zero = _mm512_setzero_si512();
+	const __m512i value = _mm512_set1_epi64(v);
+	int count = 0, i = 0;
+	
+	for(; i+8 <= n; i+=8)
+	{
+		__m512i bit = _mm512_add_epi64(_mm512_set1_epi64((long long)(from+i)*width), step);
+		__m512i word = _mm512_mask_i64gather_epi64(zero, 0xff, _mm512_maskz_srli_epi64(0xff, bit, 3), p, 1);
+		word = _mm512_and_si512(_mm512_maskz_srlv_epi64(0xff, word, _mm512_and_si512(bit, seven)), mask);
+		count += __builtin_popcount(_mm512_cmplt_epi64_mask(word, value));
+	}
+	
+	return count + countBelowScalar(p, width, from+i, n-i, v);
+}
+
+//The widest instruction set the CPU has: 2 for AVX-512, 1 for AVX2, 0 for none
+static int cpuLevel()
+{
+	__builtin_cpu_init();
+	
+	if(__builtin_cpu_supports("avx512f"))
+		return 2;
+	if(__builtin_cpu_supports("avx2"))
+		return 1;
+	return 0;
+}
+
+//The kernels packed leaves are read with; chosen before main() runs, so
+//that threads never see them change
+static const int leafCpuLevel = cpuLevel();
+static const UnpackKernel unpackKernel = leafCpuLevel==2 ? unpackAvx512 :
+                                         leafCpuLevel==1 ? unpackAvx2 : unpackScalar;
+static const CountBelowKernel countBelowKernel = leafCpuLevel==2 ? countBelowAvx512 :
+                                                 leafCpuLevel==1 ? countBelowAvx2 : countBelowScalar;
+
+//Number of bytes of a sorted run of RecordIds, delta-encoded
+static int runBytes(const RecordId* rids, int n)
+{
+	unsigned long long prev = 0;
+	int bytes = 0;
+	
+	for(int i=0; i<n; i++)
+	{
+		unsigned long long ordinal = ridOrdinal(rids[i]);
+		bytes += varintSize(ordinal-prev);
+		prev = ordinal;
+	}
+	
+	return bytes;
+}
+
+static char* putRun(char* p, const RecordId* rids, int n)
+{
+	unsigned long long prev = 0;
+	
+	for(int i=0; i<n; i++)
+	{
+		unsigned long long ordinal = ridOrdinal(rids[i]);
+		p = putVarint(p, ordinal-prev);
+		prev = ordinal;
+	}
+	
+	return p;
+}
+
+//Decode n RecordIds that must end before end; NULL if they do not
+static const char* getRun(const char* p, const char* end, RecordId* rids, int n)
+{
+	unsigned long long ordinal = 0;
+	
+	for(int i=0; i<n && p!=NULL; i++)
+	{
+		unsigned long long delta;
+		p = getVarint(p, end, delta);
+		ordinal += delta;
+		rids[i] = ordinalRid(ordinal);
+	}
+	
+	return p;
+}
+
 //Leaf node constructor
 BTLeafNode::BTLeafNode()
 {
-	number_keys=0;
-	std::fill(buffer, buffer + PageFile::PAGE_SIZE, 0); //clear the buffer if necessary
+	slotCount = 0;
+	ridCount = 0;
+	nextPtr = 0;
+	packed = false;
+	reindex();
+}
+
+/*
+ * Read the content of the node from the page pid in the PageFile pf.
+ * A packed page is kept as it is; any other page is decoded right away.
+ * A page that does not hold a leaf (an optimistic reader may read one that
+ * is being reused) decodes to the slots that make sense, and never past the page.
+ * @param pid[IN] the PageId to read
+ * @param pf[IN] PageFile to read from
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::read(PageId pid, const PageFile& pf)
+{
+	slotCount = 0;
+	ridCount = 0;
+	nextPtr = 0;
+	packed = false;
+	
+	//Use PageFile to read from selected page into page
+	RC rc = pf.read(pid, page);
+	std::fill(page + PageFile::PAGE_SIZE, page + sizeof(page), 0);
+	
+	if(rc!=0)
+	{
+		reindex();
+		return rc;
+	}
+	
+	unsigned short count, bytes;
+	memcpy(&count, page, sizeof(unsigned short));
+	memcpy(&bytes, page+sizeof(unsigned short), sizeof(unsigned short));
+	memcpy(&nextPtr, page+PageFile::PAGE_SIZE-sizeof(PageId), sizeof(PageId));
+	
+	if(bytes & LEAF_PACKED)
+	{
+		const char* p = page+LEAF_HEADER;
+		const char* end = p+std::min((int)(bytes & ~LEAF_PACKED), LEAF_CAPACITY);
+		
+		if(end-p < (int)sizeof(int)+2)
+		{
+			reindex();
+			return 0;
+		}
+		
+		memcpy(&keyBase, p, sizeof(int));
+		keyBits = (unsigned char)p[sizeof(int)];
+		ridBits = (unsigned char)p[sizeof(int)+1];
+		p = getVarint(p+sizeof(int)+2, end, ridBase);
+		
+		if(p==NULL || count > MAX_SLOTS || keyBits > 32 || ridBits > MAX_RID_BITS)
+		{
+			reindex();
+			return 0;
+		}
+		
+		keyOffset = p-page;
+		ridOffset = keyOffset+(count*keyBits+7)/8;
+		
+		if(page+ridOffset+(count*ridBits+7)/8 > end)
+		{
+			reindex();
+			return 0;
+		}
+		
+		packedCount = count;
+		packedUsed = ridOffset+(count*ridBits+7)/8+sizeof(PageId);
+		packed = true;
+		return 0;
+	}
+	
+	const char* p = page+LEAF_HEADER;
+	const char* end = p+std::min((int)bytes, LEAF_CAPACITY);
+	
+	for(int i=0; i<count && slotCount<MAX_SLOTS && end-p >= (int)sizeof(int); i++)
+	{
+		int key;
+		unsigned long long header;
+		
+		memcpy(&key, p, sizeof(int));
+		p = getVarint(p+sizeof(int), end, header);
+		
+		if(p==NULL)
+			break;
+		
+		//the posting list is on posting pages: [count][first page]
+		if(header & 1)
+		{
+			if(end-p < (int)(sizeof(int)+sizeof(PageId)))
+				break;
+			
+			memcpy(&counts[slotCount], p, sizeof(int));
+			memcpy(&heads[slotCount], p+sizeof(int), sizeof(PageId));
+			p += sizeof(int)+sizeof(PageId);
+			
+			if(counts[slotCount] <= 0 || heads[slotCount] <= 0)
+				break;
+		}
+		else
+		{
+			unsigned long long n = header >> 1;
+			
+			if(n==0 || n > (unsigned long long)(MAX_RIDS-ridCount))
+				break;
+			
+			p = getRun(p, end, rids+ridCount, (int)n);
+			
+			if(p==NULL)
+				break;
+			
+			counts[slotCount] = (int)n;
+			heads[slotCount] = 0;
+			ridCount += n;
+		}
+		
+		keys[slotCount] = key;
+		slotCount++;
+	}
+	
+	reindex();
+	return 0;
+}
+    
+/*
+ * Write the content of the node to the page pid in the PageFile pf,
+ * packed if that takes fewer bytes.
+ * @param pid[IN] the PageId to write to
+ * @param pf[IN] PageFile to write to
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::write(PageId pid, PageFile& pf)
+{
+	//a word of room behind the page for depositBits()
+	char buffer[PageFile::PAGE_SIZE+sizeof(unsigned long long)];
+	
+	decode();
+	
+	if(getUsedBytes() > PageFile::PAGE_SIZE)
+		return RC_NODE_FULL;
+	
+	std::fill(buffer, buffer + sizeof(buffer), 0);
+	char* p = buffer+LEAF_HEADER;
+	unsigned short flags = 0;
+	
+	int base, bits, ridWidth;
+	unsigned long long ridStart;
+	
+	if(packedBytes() < varintBytes() && packing(base, bits, ridStart, ridWidth))
+	{
+		memcpy(p, &base, sizeof(int));
+		p[sizeof(int)] = (char)bits;
+		p[sizeof(int)+1] = (char)ridWidth;
+		p = putVarint(p+sizeof(int)+2, ridStart);
+		
+		for(int i=0; i<slotCount; i++)
+			depositBits(p, i*bits, (unsigned)keys[i]-(unsigned)base);
+		
+		p += (slotCount*bits+7)/8;
+		
+		for(int i=0; i<slotCount; i++)
+			depositBits(p, i*ridWidth, ridOrdinal(rids[i])-ridStart);
+		
+		p += (slotCount*ridWidth+7)/8;
+		flags = LEAF_PACKED;
+	}
+	else
+	{
+		for(int i=0; i<slotCount; i++)
+		{
+			memcpy(p, &keys[i], sizeof(int));
+			p += sizeof(int);
+			
+			if(heads[i] > 0)
+			{
+				p = putVarint(p, 1);
+				memcpy(p, &counts[i], sizeof(int));
+				memcpy(p+sizeof(int), &heads[i], sizeof(PageId));
+				p += sizeof(int)+sizeof(PageId);
+			}
+			else
+			{
+				p = putVarint(p, (unsigned long long)counts[i] << 1);
+				p = putRun(p, rids+firstRid[i], counts[i]);
+			}
+		}
+	}
+	
+	unsigned short count = slotCount;
+	unsigned short bytes = (p-(buffer+LEAF_HEADER)) | flags;
+	memcpy(buffer, &count, sizeof(unsigned short));
+	memcpy(buffer+sizeof(unsigned short), &bytes, sizeof(unsigned short));
+	memcpy(buffer+PageFile::PAGE_SIZE-sizeof(PageId), &nextPtr, sizeof(PageId));
+	
+	//Use PageFile to write from buffer into selected page
+	return pf.write(pid, buffer);
+}
+
+/*
+ * Unpack a packed node into the arrays, so that it can be changed.
+ * Every field has the same width, so the loop has no branches.
+ */
+void BTLeafNode::decode()
+{
+	if(!packed)
+		return;
+	
+	unsigned long long fields[MAX_SLOTS];
+	
+	unpackKernel(page+keyOffset, keyBits, 0, packedCount, fields);
+	for(int i=0; i<packedCount; i++)
+	{
+		keys[i] = (int)((unsigned)keyBase + (unsigned)fields[i]);
+		counts[i] = 1;
+		heads[i] = 0;
+	}
+	
+	unpackKernel(page+ridOffset, ridBits, 0, packedCount, fields);
+	for(int i=0; i<packedCount; i++)
+		rids[i] = ordinalRid(ridBase + fields[i]);
+	
+	slotCount = packedCount;
+	ridCount = packedCount;
+	packed = false;
+	
+	reindex();
+}
+
+/*
+ * Return the key of the i-th entry of a packed node.
+ * @param i[IN] the entry number
+ * @return the key
+ */
+int BTLeafNode::packedKey(int i)
+{
+	return (int)((unsigned)keyBase + (unsigned)extractBits(page+keyOffset, i*keyBits, keyBits));
+}
+
+/*
+ * Return the RecordId of the i-th entry of a packed node.
+ * @param i[IN] the entry number
+ * @return the RecordId
+ */
+RecordId BTLeafNode::packedRid(int i)
+{
+	return ordinalRid(ridBase + extractBits(page+ridOffset, i*ridBits, ridBits));
+}
+
+/*
+ * Find the bases and bit widths the node would be packed with.
+ * Only a node whose keys each have one RecordId in the node can be packed.
+ * @param keyBase[OUT] the smallest key
+ * @param keyBits[OUT] the bits per key difference
+ * @param ridBase[OUT] the smallest RecordId, in record slots
+ * @param ridBits[OUT] the bits per RecordId difference
+ * @return true if the node can be packed
+ */
+bool BTLeafNode::packing(int& keyBase, int& keyBits, unsigned long long& ridBase, int& ridBits)
+{
+	if(slotCount==0 || ridCount!=slotCount)
+		return false;
+	
+	unsigned long long low = ridOrdinal(rids[0]);
+	unsigned long long high = low;
+	
+	for(int i=0; i<slotCount; i++)
+	{
+		if(counts[i]!=1 || heads[i] > 0)
+			return false;
+		
+		unsigned long long ordinal = ridOrdinal(rids[i]);
+		low = std::min(low, ordinal);
+		high = std::max(high, ordinal);
+	}
+	
+	keyBase = keys[0];
+	keyBits = bitWidth((unsigned)keys[slotCount-1]-(unsigned)keys[0]);
+	ridBase = low;
+	ridBits = bitWidth(high-low);
+	
+	return ridBits <= MAX_RID_BITS;
+}
+
+/*
+ * Return the number of bytes the node takes with varint posting lists.
+ * @return the encoded size
+ */
+int BTLeafNode::varintBytes()
+{
+	int bytes = LEAF_HEADER + sizeof(PageId);
+	
+	for(int i=0; i<slotCount; i++)
+		bytes += slotBytes(i);
+	
+	return bytes;
+}
+
+/*
+ * Return the number of bytes the node takes packed.
+ * @return the encoded size, or INT_MAX if the node cannot be packed
+ */
+int BTLeafNode::packedBytes()
+{
+	int base, bits, ridWidth;
+	unsigned long long ridStart;
+	
+	if(!packing(base, bits, ridStart, ridWidth))
+		return INT_MAX;
+	
+	return LEAF_HEADER + sizeof(int) + 2 + varintSize(ridStart) + (slotCount*bits+7)/8 + (slotCount*ridWidth+7)/8 + sizeof(PageId);
+}
+
+/*
+ * Check whether the node fits into its page. A node that is only packed
+ * may take more bytes unpacked: one new entry can make it unpackable (a
+ * second RecordId for a key, or a RecordId far from the others), and then
+ * insertAndSplit() must split it into two unpacked halves. So a node also
+ * must not take more than two pages unpacked, less room for the largest
+ * slot that could end up on either side.
+ * @return true if the node fits
+ */
+bool BTLeafNode::fits()
+{
+	return getUsedBytes() <= PageFile::PAGE_SIZE &&
+	       varintBytes()-LEAF_HEADER-(int)sizeof(PageId) <= 2*LEAF_CAPACITY-SPLIT_SLACK;
+}
+
+/*
+ * Recompute where the entries and the inline RecordIds of every slot start.
+ */
+void BTLeafNode::reindex()
+{
+	firstEntry[0] = 0;
+	firstRid[0] = 0;
+	
+	for(int i=0; i<slotCount; i++)
+	{
+		firstEntry[i+1] = firstEntry[i]+counts[i];
+		firstRid[i+1] = firstRid[i]+(heads[i] > 0 ? 0 : counts[i]);
+	}
+}
+
+/*
+ * Find the slot of key.
+ * @param key[IN] the key to look up
+ * @param slot[OUT] the slot of key, or the slot to insert it at
+ * @return true if key is in the node
+ */
+bool BTLeafNode::findSlot(int key, int& slot)
+{
+	slot = lower_bound(keys, keys+slotCount, key) - keys;
+	return slot < slotCount && keys[slot]==key;
+}
+
+/*
+ * Find the slot that holds the eid entry.
+ * @param eid[IN] an entry number, from 0 to getKeyCount()-1
+ * @return the slot of the entry
+ */
+int BTLeafNode::slotOf(int eid)
+{
+	return upper_bound(firstEntry+1, firstEntry+slotCount+1, eid) - firstEntry - 1;
+}
+
+/*
+ * Return the number of bytes a slot takes in the page.
+ * @param slot[IN] the slot
+ * @return the encoded size of the slot
+ */
+int BTLeafNode::slotBytes(int slot)
+{
+	if(heads[slot] > 0)
+		return sizeof(int) + 1 + sizeof(int) + sizeof(PageId);
+	
+	return sizeof(int) + varintSize((unsigned long long)counts[slot] << 1) + runBytes(rids+firstRid[slot], counts[slot]);
+}
+
+/*
+ * Insert a new slot in front of the given one.
+ * @param slot[IN] the position of the new slot
+ * @param key[IN] the key of the slot
+ * @param count[IN] the number of entries with the key
+ * @param head[IN] the first posting page, or 0 if the RecordIds are in rids
+ * @param rids[IN] the count RecordIds of the key, if head is 0
+ */
+void BTLeafNode::insertSlot(int slot, int key, int count, PageId head, const RecordId* rids)
+{
+	memmove(keys+slot+1, keys+slot, (slotCount-slot)*sizeof(int));
+	memmove(counts+slot+1, counts+slot, (slotCount-slot)*sizeof(int));
+	memmove(heads+slot+1, heads+slot, (slotCount-slot)*sizeof(PageId));
+	
+	if(head <= 0)
+	{
+		RecordId* list = this->rids+firstRid[slot];
+		memmove(list+count, list, (ridCount-firstRid[slot])*sizeof(RecordId));
+		memcpy(list, rids, count*sizeof(RecordId));
+		ridCount += count;
+		head = 0;
+	}
+	
+	keys[slot] = key;
+	counts[slot] = count;
+	heads[slot] = head;
+	slotCount++;
+	
+	reindex();
+}
+
+/*
+ * Drop a slot with all its entries.
+ * @param slot[IN] the slot to drop
+ */
+void BTLeafNode::removeSlot(int slot)
+{
+	if(heads[slot] <= 0)
+	{
+		RecordId* list = rids+firstRid[slot];
+		memmove(list, list+counts[slot], (ridCount-firstRid[slot+1])*sizeof(RecordId));
+		ridCount -= counts[slot];
+	}
+	
+	memmove(keys+slot, keys+slot+1, (slotCount-slot-1)*sizeof(int));
+	memmove(counts+slot, counts+slot+1, (slotCount-slot-1)*sizeof(int));
+	memmove(heads+slot, heads+slot+1, (slotCount-slot-1)*sizeof(PageId));
+	slotCount--;
+	
+	reindex();
+}
+
+/*
+ * Return the number of (key, rid) entries stored in the node.
+ * @return the number of entries in the node
+ */
+int BTLeafNode::getKeyCount()
+{
+	if(packed)
+		return packedCount;
+	
+	return firstEntry[slotCount];
+}
+
+/*
+ * Return the number of bytes of the page the node takes,
+ * with the smaller of the two encodings.
+ * @return the encoded size of the node
+ */
+int BTLeafNode::getUsedBytes()
+{
+	if(packed)
+		return packedUsed;
+	
+	return std::min(varintBytes(), packedBytes());
+}
+
+
+/*
+ * Check whether a leaf other than the root is less than half full.
+ * @return true if less than half of the page is in use
+ */
+bool BTLeafNode::isUnderflow()
+{
+	return getUsedBytes() < PageFile::PAGE_SIZE/2;
+}
+
+/*
+ * Insert a (key, rid) pair to the node.
+ * A new key gets a slot; a known key gets rid added to its posting list.
+ * @param key[IN] the key to insert
+ * @param rid[IN] the RecordId to insert
+ * @return 0 if successful. Return an error code if the node is full.
+ */
+RC BTLeafNode::insert(int key, const RecordId& rid)
+{
+	if(!validRid(rid))
+		return RC_INVALID_RID;
+	
+	decode();
+	
+	//The arrays hold one entry more than a page, for insertAndSplit()
+	if(slotCount > MAX_SLOTS || ridCount > MAX_RIDS)
+		return RC_NODE_FULL;
+	
+	int slot;
+	
+	if(!findSlot(key, slot))
+		insertSlot(slot, key, 1, 0, &rid);
+	else if(heads[slot] > 0)
+		return RC_INVALID_ATTRIBUTE;
+	else
+	{
+		//Keep the posting list sorted; the same rid goes behind its copies
+		RecordId* list = rids+firstRid[slot];
+		int pos = upper_bound(list, list+counts[slot], rid) - list;
+		
+		memmove(list+pos+1, list+pos, (ridCount-firstRid[slot]-pos)*sizeof(RecordId));
+		list[pos] = rid;
+		counts[slot]++;
+		ridCount++;
+		reindex();
+	}
+	
+	//Take the entry out again if the node no longer fits into its page
+	if(!fits())
+	{
+		remove(key, rid);
+		return RC_NODE_FULL;
+	}
+	
+	return 0;
+}
+
+/*
+ * Insert the (key, rid) pair to the node
+ * and split the node half and half with sibling.
+ * The node is split between two keys, at the one that divides its bytes
+ * most evenly, so that all entries with a key stay in one node.
+ * A new key behind all others in the right-most leaf (as in a load sorted
+ * by key) is split off alone instead, which leaves this node full.
+ * The separator key to put in the parent is returned in siblingKey.
+ * @param key[IN] the key to insert.
+ * @param rid[IN] the RecordId to insert.
+ * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
+ * @param siblingKey[OUT] the shortest separator between the two nodes (see BTNonLeafNode::separator()).
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::insertAndSplit(int key, const RecordId& rid, 
+                              BTLeafNode& sibling, int& siblingKey)
+{
+	//If sibling node is not empty, return error
+	if(sibling.getKeyCount()!=0)
+		return RC_INVALID_ATTRIBUTE;
+	
+	if(!validRid(rid))
+		return RC_INVALID_RID;
+	
+	decode();
+	sibling.decode();
+	
+	int slot;
+	if(findSlot(key, slot) && heads[slot] > 0)
+		return RC_INVALID_ATTRIBUTE;
+	
+	//Add the entry first; the arrays have room for one entry more than a page
+	if(insert(key, rid)==RC_NODE_FULL)
+	{
+		if(slotCount > MAX_SLOTS || ridCount > MAX_RIDS)
+			return RC_NODE_FULL;
+		
+		if(!findSlot(key, slot))
+			insertSlot(slot, key, 1, 0, &rid);
+		else
+		{
+			RecordId* list = rids+firstRid[slot];
+			int pos = upper_bound(list, list+counts[slot], rid) - list;
+			
+			memmove(list+pos+1, list+pos, (ridCount-firstRid[slot]-pos)*sizeof(RecordId));
+			list[pos] = rid;
+			counts[slot]++;
+			ridCount++;
+			reindex();
+		}
+	}
+	
+	if(slotCount < 2)
+	{
+		remove(key, rid);
+		return RC_NODE_FULL;
+	}
+	
+	//Find the key boundary that divides the bytes most evenly. In a packed
+	//node every entry takes the same bits, so that is the middle key.
+	int split = -1;
+	int last = slotCount-1;
+	
+	if(nextPtr==0 && keys[last]==key && counts[last]==1 && heads[last]==0)
+		split = last;
+	else if(packedBytes() < varintBytes())
+		split = slotCount/2;
+	else
+	{
+		int total = varintBytes()-LEAF_HEADER-sizeof(PageId);
+		int leftBytes = 0;
+		int bestDiff = INT_MAX;
+		
+		for(int i=1; i<slotCount; i++)
+		{
+			leftBytes += slotBytes(i-1);
+			int rightBytes = total-leftBytes;
+			
+			if(leftBytes > LEAF_CAPACITY || rightBytes > LEAF_CAPACITY)
+				continue;
+			
+			if(abs(leftBytes-rightBytes) < bestDiff)
+			{
+				bestDiff = abs(leftBytes-rightBytes);
+				split = i;
+			}
+		}
+	}
+	
+	if(split < 0)
+	{
+		remove(key, rid);
+		return RC_NODE_FULL;
+	}
+	
+	//Move the slots behind the boundary to the sibling
+	for(int i=split; i<slotCount; i++)
+		sibling.insertSlot(i-split, keys[i], counts[i], heads[i], rids+firstRid[i]);
+	
+	while(slotCount > split)
+		removeSlot(slotCount-1);
+	
+	sibling.nextPtr = nextPtr;
+	siblingKey = BTNonLeafNode::separator(keys[slotCount-1], sibling.keys[0]);
+	
+	//Remember not to touch the next node pointer
+	//Since we use it later, changing this will destroy the index tree's leaf node mapping
+	
+	return 0;
+}
+
+/*
+ * Find the entry whose key value is larger than or equal to searchKey
+ * and output the eid (entry number) whose key value >= searchKey.
+ * Remeber that all keys inside a B+tree node should be kept sorted.
+ * A packed node is searched without unpacking it.
+ * @param searchKey[IN] the key to search for
+ * @param eid[OUT] the entry number that contains a key larger than or equalty to searchKey
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::locate(int searchKey, int& eid)
+{
+	if(packed)
+	{
+		//narrow down by binary search, then count the keys below
+		//searchKey in the last few with one kernel call
+		int low = 0, high = packedCount;
+		
+		while(high-low > LOCATE_WINDOW)
+		{
+			int mid = (low+high)/2;
+			
+			if(packedKey(mid) < searchKey)
+				low = mid+1;
+			else
+				high = mid;
+		}
+		
+		long long v = (long long)searchKey - keyBase;
+		eid = low + (v <= 0 ? 0 : countBelowKernel(page+keyOffset, keyBits, low, high-low, v));
+		return 0;
+	}
+	
+	int slot;
+	findSlot(searchKey, slot);
+	
+	//The first entry of the slot; past the last entry if all keys are smaller
+	eid = firstEntry[slot];
+	return 0;
 }
 
 /*
- * Read the content of the node from the page pid in the PageFile pf.
- * @param pid[IN] the PageId to read
- * @param pf[IN] PageFile to read from
+ * Read the (key, rid) pair from the eid entry.
+ * @param eid[IN] the entry number to read the (key, rid) pair from
+ * @param key[OUT] the key from the entry
+ * @param rid[OUT] the RecordId from the entry; (-1, -1) if it is on a posting page
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::read(PageId pid, const PageFile& pf)
+RC BTLeafNode::readEntry(int eid, int& key, RecordId& rid)
 {
-	//Use PageFile to read from selected page into buffer
-	return pf.read(pid, buffer);	
+	//If eid is out of bounds (negative or more than the number of keys we have), return error
+	if(eid >= getKeyCount() || eid < 0)
+		return RC_NO_SUCH_RECORD;
+	
+	if(packed)
+	{
+		key = packedKey(eid);
+		rid = packedRid(eid);
+		return 0;
+	}
+	
+	int slot = slotOf(eid);
+	key = keys[slot];
+	
+	if(heads[slot] > 0)
+	{
+		rid.pid = -1;
+		rid.sid = -1;
+	}
+	else
+		rid = rids[firstRid[slot]+eid-firstEntry[slot]];
+	
+	return 0;
 }
-    
+
 /*
- * Write the content of the node to the page pid in the PageFile pf.
- * @param pid[IN] the PageId to write to
- * @param pf[IN] PageFile to write to
- * @return 0 if successful. Return an error code if there is an error.
+ * Find the RecordId of the eid entry on the posting pages of its key.
+ * @param eid[IN] the entry number
+ * @param head[OUT] the first posting page of the key
+ * @param pos[OUT] the position of the RecordId in the posting list
+ * @return true if the entry is on posting pages, false if it is in the node
  */
-RC BTLeafNode::write(PageId pid, PageFile& pf)
+bool BTLeafNode::getPostingEntry(int eid, PageId& head, int& pos)
 {
-	//Use PageFile to write from buffer into selected page
-	return pf.write(pid, buffer);
+	//A packed node has no posting pages
+	if(packed || eid >= getKeyCount() || eid < 0)
+		return false;
+	
+	int slot = slotOf(eid);
+	
+	if(heads[slot] <= 0)
+		return false;
+	
+	head = heads[slot];
+	pos = eid-firstEntry[slot];
+	return true;
 }
 
 /*
- * Return the number of keys stored in the node.
- * @return the number of keys in the node
+ * Find the posting list of key.
+ * @param key[IN] the key to look up
+ * @param head[OUT] the first posting page, or 0 if the list is in the node
+ * @param count[OUT] the number of entries with the key
+ * @return 0 if successful. Return RC_NO_SUCH_RECORD if the key is not in the node.
+ */
+RC BTLeafNode::getPosting(int key, PageId& head, int& count)
+{
+	int slot;
+	
+	if(packed)
+	{
+		int eid;
+		locate(key, eid);
+		
+		if(eid >= packedCount || packedKey(eid)!=key)
+			return RC_NO_SUCH_RECORD;
+		
+		head = 0;
+		count = 1;
+		return 0;
+	}
+	
+	if(!findSlot(key, slot))
+		return RC_NO_SUCH_RECORD;
+	
+	head = heads[slot];
+	count = counts[slot];
+	return 0;
+}
+
+/*
+ * Keep the posting list of key on posting pages, dropping its inline RecordIds.
+ * @param key[IN] a key in the node
+ * @param head[IN] the first posting page of the key
+ * @param count[IN] the number of entries with the key; 0 removes the key
+ * @return 0 if successful. Return RC_NO_SUCH_RECORD if the key is not in the node.
  */
- int BTLeafNode::maxKeyCount()
+RC BTLeafNode::setPosting(int key, PageId head, int count)
 {
-	int size_record = sizeof(int) + sizeof(RecordId);
-	return (PageFile::PAGE_SIZE - sizeof(PageId))/size_record;
+	int slot;
+	
+	decode();
+	
+	if(!findSlot(key, slot))
+		return RC_NO_SUCH_RECORD;
+	
+	if(count > 0 && head <= 0)
+		return RC_INVALID_PID;
+	
+	removeSlot(slot);
+	
+	if(count > 0)
+		insertSlot(slot, key, count, head, NULL);
+	
+	return 0;
 }
-int BTLeafNode::getKeyCount()
+
+/*
+ * Read the posting list of key that is stored in the node.
+ * @param key[IN] the key to look up
+ * @param rids[OUT] the RecordIds of the key, sorted
+ * @return 0 if successful. Return RC_NO_SUCH_RECORD if the list is not in the node.
+ */
+RC BTLeafNode::readPosting(int key, vector<RecordId>& rids)
+{
+	int slot;
+	
+	decode();
+	
+	if(!findSlot(key, slot) || heads[slot] > 0)
+		return RC_NO_SUCH_RECORD;
+	
+	rids.assign(this->rids+firstRid[slot], this->rids+firstRid[slot]+counts[slot]);
+	return 0;
+}
+
+/*
+ * Return the number of bytes the posting list of key takes in the node.
+ * @param key[IN] the key to look up
+ * @return the size of the posting list; 0 if the key is not in the node
+ */
+int BTLeafNode::getPostingBytes(int key)
+{
+	int slot;
+	
+	decode();
+	
+	if(!findSlot(key, slot))
+		return 0;
+	
+	return slotBytes(slot)-sizeof(int);
+}
+
+/*
+ * Return the pid of the next slibling node.
+ * @return the PageId of the next sibling node 
+ */
+PageId BTLeafNode::getNextNodePtr()
+{
+	return nextPtr;
+}
+
+/*
+ * Set the pid of the next slibling node.
+ * @param pid[IN] the PageId of the next sibling node 
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::setNextNodePtr(PageId pid)
+{
+	//If pid is invalid, return error
+	if(pid < 0)
+		return RC_INVALID_PID;
+	
+	nextPtr = pid;
+	return 0;
+}
+
+/*
+ * Remove the (key, rid) pair from the node.
+ * @param key[IN] the key to remove
+ * @param rid[IN] the RecordId to remove
+ * @return 0 if successful. Return RC_NO_SUCH_RECORD if the pair is not in the node.
+ */
+RC BTLeafNode::remove(int key, const RecordId& rid)
 {
-	//return number_keys;
+	int slot;
 	
-	//This is the size in bytes of an entry pair
-	int size_record = sizeof(RecordId) + sizeof(int);
-	int count=0;
-	char* temp = buffer;
+	decode();
 	
-	//Loop through all the indexes in the temp buffer; increment by 12 bytes to jump to next key
-	//1008 is the largest possible index of the next inserted pair (since we already know we can fit another pair)
-	int i;
-	for(i=0; i<=1008; i+=size_record)
+	//The RecordIds on posting pages are removed by the index
+	if(!findSlot(key, slot) || heads[slot] > 0)
+		return RC_NO_SUCH_RECORD;
+	
+	RecordId* list = rids+firstRid[slot];
+	int pos = lower_bound(list, list+counts[slot], rid) - list;
+	
+	if(pos >= counts[slot] || list[pos]!=rid)
+		return RC_NO_SUCH_RECORD;
+	
+	//The last entry of a key takes its slot along
+	if(counts[slot]==1)
 	{
-		int innerKey;
-		memcpy(&innerKey, temp, sizeof(int)); //Save the current key inside buffer as innerKey
-		if(innerKey==0) //Once we hit key of 0, we break
-			break;
-		//Otherwise, increment count
-		count++;
-		
-		temp += size_record; //Jump temp over to the next key
+		removeSlot(slot);
+		return 0;
 	}
 	
-	return count;
+	memmove(list+pos, list+pos+1, (ridCount-firstRid[slot]-pos-1)*sizeof(RecordId));
+	counts[slot]--;
+	ridCount--;
+	reindex();
+	
+	return 0;
 }
 
 /*
- * Insert a (key, rid) pair to the node.
- * @param key[IN] the key to insert
- * @param rid[IN] the RecordId to insert
- * @return 0 if successful. Return an error code if the node is full.
+ * Move all entries of the next sibling node to the end of this node.
+ * The sibling's next node pointer becomes this node's.
+ * @param sibling[IN] the next sibling node; it is left unchanged
+ * @return 0 if successful. Return RC_NODE_FULL if the entries do not fit.
  */
-RC BTLeafNode::insert(int key, const RecordId& rid)
+RC BTLeafNode::merge(BTLeafNode& sibling)
 {
-	//Save last 4 bytes (the pid) for reconstructing the inserted leaf
-	PageId nextNodePtr = getNextNodePtr();
+	decode();
+	sibling.decode();
+	
+	int oldCount = slotCount;
 	
-	int size_record = sizeof(RecordId) + sizeof(int);
+	for(int i=0; i<sibling.slotCount; i++)
+		insertSlot(slotCount, sibling.keys[i], sibling.counts[i], sibling.heads[i], sibling.rids+sibling.firstRid[i]);
 	
-	int totPairs = maxKeyCount();
-	if(getKeyCount()+1 > totPairs) //if(getKeyCount()+1 > 85)
+	//Take the entries out again if they do not fit into one page
+	if(!fits())
 	{
+		while(slotCount > oldCount)
+			removeSlot(slotCount-1);
+		
 		return RC_NODE_FULL;
 	}
 	
-	//Now we must go through the buffer's sorted keys to see where the new key goes
-	char* temp = buffer;
+	nextPtr = sibling.nextPtr;
+	return 0;
+}
+
+/*
+ * Move keys between this node and its next sibling so that both
+ * take about half of their bytes. A key moves with all its entries.
+ * The separator key to put in the parent is returned in siblingKey.
+ * @param sibling[IN] the next sibling node
+ * @param siblingKey[OUT] the shortest separator between the two nodes afterwards
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::redistribute(BTLeafNode& sibling, int& siblingKey)
+{
+	decode();
+	sibling.decode();
 	
+	if(slotCount+sibling.slotCount < 2)
+		return RC_NO_SUCH_RECORD;
 	
-	int i;
-	for(i=0; i<1008; i+=size_record)
+	//Move one key at a time for as long as that evens out the two nodes
+	for(;;)
 	{
-		int innerKey;
-		memcpy(&innerKey, temp, sizeof(int)); //Save the current key inside buffer as innerKey
+		int leftBytes = getUsedBytes();
+		int rightBytes = sibling.getUsedBytes();
 		
-		//Once the innerKey is null or key is smaller than some inside key, we stop
-		if(innerKey==0 || !(key > innerKey))
+		if(leftBytes > rightBytes && slotCount > 1)
+		{
+			int last = slotCount-1;
+			sibling.insertSlot(0, keys[last], counts[last], heads[last], rids+firstRid[last]);
+			removeSlot(last);
+			
+			//Move it back if that did not help
+			if(abs(getUsedBytes()-sibling.getUsedBytes()) >= leftBytes-rightBytes || !sibling.fits())
+			{
+				insertSlot(slotCount, sibling.keys[0], sibling.counts[0], sibling.heads[0], sibling.rids);
+				sibling.removeSlot(0);
+				break;
+			}
+		}
+		else if(rightBytes > leftBytes && sibling.slotCount > 1)
+		{
+			insertSlot(slotCount, sibling.keys[0], sibling.counts[0], sibling.heads[0], sibling.rids);
+			sibling.removeSlot(0);
+			
+			if(abs(getUsedBytes()-sibling.getUsedBytes()) >= rightBytes-leftBytes || !fits())
+			{
+				int last = slotCount-1;
+				sibling.insertSlot(0, keys[last], counts[last], heads[last], rids+firstRid[last]);
+				removeSlot(last);
+				break;
+			}
+		}
+		else
 			break;
-		
-		temp += size_record; //Jump temp over to the next key
 	}
 	
-	//At this point, variable i holds the index to insert the pair and temp is the buffer at that index
-	char* buffer1 = (char*)malloc(PageFile::PAGE_SIZE);
-	std::fill(buffer1, buffer1 + PageFile::PAGE_SIZE, 0); //clear the buffer if necessary
+	if(slotCount==0 || sibling.slotCount==0)
+		return RC_NO_SUCH_RECORD;
 	
-	//Copy all values from buffer into buffer1 up until i
-	memcpy(buffer1, buffer, i);
+	siblingKey = BTNonLeafNode::separator(keys[slotCount-1], sibling.keys[0]);
+	return 0;
+}
+
+/*
+ * Print the keys of the node to cout
+ */
+void BTLeafNode::print()
+{
+	decode();
 	
-	//Values to insert as new (key, rid) pair
-	PageId pid = rid.pid;
-	int sid = rid.sid;
+	for(int i=0; i<slotCount; i++)
+	{
+		cout << keys[i];
+		
+		//A key with several entries is followed by their number
+		if(counts[i] > 1)
+			cout << "x" << counts[i];
+		
+		cout << " ";
+	}
 	
-	memcpy(buffer1+i, &key, sizeof(int));
-	memcpy(buffer1+i+sizeof(int), &rid, sizeof(RecordId));
+	cout << "" << endl;
+}
+
+//----------------------------------------------------------------------------------------------------
+
+
+//Posting page constructor
+BTPostingNode::BTPostingNode()
+{
+	count = 0;
+	nextPtr = 0;
+}
+
+//Layout of a posting page:
+//  [next pid][rid count (2 bytes)][rid bytes (2 bytes)] [rid] [rid] ...
+//with the RecordIds delta-encoded like the posting lists in a leaf
+
+/*
+ * Read the page pid of the PageFile pf.
+ * @param pid[IN] the PageId to read
+ * @param pf[IN] PageFile to read from
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTPostingNode::read(PageId pid, const PageFile& pf)
+{
+	char buffer[PageFile::PAGE_SIZE];
 	
-	//INCREMENTAL POINTER METHOD:
-	//char* insertPos = buffer1+i;
-	//memcpy(insertPos, &pid, sizeof(PageId));
-	//insertPos += sizeof(PageId);
-	//memcpy(insertPos, &sid, sizeof(int));
-	//insertPos += sizeof(int);
-	//memcpy(insertPos, &key, sizeof(int));
+	count = 0;
+	nextPtr = 0;
 	
-	//Copy the rest of the values into buffer1
-	//Notice that we are neglecting nextNodePtr, so we'll manually copy that in
-	memcpy(buffer1+i+size_record, buffer+i, getKeyCount()*size_record - i);
-	memcpy(buffer1+PageFile::PAGE_SIZE-sizeof(PageId), &nextNodePtr, sizeof(PageId));
+	RC rc = pf.read(pid, buffer);
 	
-	//Copy buffer1 into buffer, then delete temporary buffer1 to prevent memory leak
-	memcpy(buffer, buffer1, PageFile::PAGE_SIZE);
-	free(buffer1);
+	if(rc!=0)
+		return rc;
 	
-	//Successfully inserted leaf node, so we increment number of keys
-	number_keys++;
+	unsigned short n, bytes;
+	memcpy(&nextPtr, buffer, sizeof(PageId));
+	memcpy(&n, buffer+sizeof(PageId), sizeof(unsigned short));
+	memcpy(&bytes, buffer+sizeof(PageId)+sizeof(unsigned short), sizeof(unsigned short));
+	
+	//a page that is being reused may hold anything: keep what decodes
+	const char* p = buffer+POSTING_HEADER;
+	const char* end = p+std::min((int)bytes, POSTING_CAPACITY);
+	
+	if(n <= MAX_RIDS && getRun(p, end, rids, n)!=NULL)
+		count = n;
 	
 	return 0;
 }
 
 /*
- * Insert the (key, rid) pair to the node
- * and split the node half and half with sibling.
- * The first key of the sibling node is returned in siblingKey.
- * @param key[IN] the key to insert.
- * @param rid[IN] the RecordId to insert.
- * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
- * @param siblingKey[OUT] the first key in the sibling node after split.
+ * Write the page pid of the PageFile pf.
+ * @param pid[IN] the PageId to write to
+ * @param pf[IN] PageFile to write to
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::insertAndSplit(int key, const RecordId& rid, 
-                              BTLeafNode& sibling, int& siblingKey)
+RC BTPostingNode::write(PageId pid, PageFile& pf)
 {
-	//Save last 4 bytes (the pid) for reconstructing the inserted leaf
-	PageId nextNodePtr = getNextNodePtr();
-	
-	int size_record = sizeof(RecordId) + sizeof(int);
-	int totPairs = maxKeyCount();
+	char buffer[PageFile::PAGE_SIZE];
 	
-	//Only split if inserting will cause an overflow; otherwise, return error
-	if(!(getKeyCount() >= totPairs))
-		return RC_INVALID_FILE_FORMAT;
-	
-	//If sibling node is not empty, return error
-	if(sibling.getKeyCount()!=0)
-		return RC_INVALID_ATTRIBUTE;
+	if(usedBytes() > POSTING_CAPACITY)
+		return RC_NODE_FULL;
 	
-	//Clear sibling buffer just in case
-	std::fill(sibling.buffer, sibling.buffer + PageFile::PAGE_SIZE, 0); //clear the buffer if necessary
+	std::fill(buffer, buffer + PageFile::PAGE_SIZE, 0);
 	
-	//Calculate keys to remain in the first half
-	int numHalfKeys = ((int)((getKeyCount()+1)/2));
+	char* end = putRun(buffer+POSTING_HEADER, rids, count);
+	unsigned short n = count;
+	unsigned short bytes = end-(buffer+POSTING_HEADER);
 	
-	//Find the index at which to split the node's buffer
-	int halfIndex = numHalfKeys*size_record;
+	memcpy(buffer, &nextPtr, sizeof(PageId));
+	memcpy(buffer+sizeof(PageId), &n, sizeof(unsigned short));
+	memcpy(buffer+sizeof(PageId)+sizeof(unsigned short), &bytes, sizeof(unsigned short));
 	
-	//Copy everything on the right side of halfIndex into sibling's buffer (ignore the pid)
-	memcpy(sibling.buffer, buffer+halfIndex, PageFile::PAGE_SIZE-sizeof(PageId)-halfIndex);
+	return pf.write(pid, buffer);
+}
+
+/*
+ * Return the number of bytes the RecordIds take in the page.
+ * @return the encoded size of the RecordIds
+ */
+int BTPostingNode::usedBytes()
+{
+	return runBytes(rids, count);
+}
+
+/*
+ * Insert rid into the page, keeping the RecordIds sorted.
+ * @param rid[IN] the RecordId to insert
+ * @return 0 if successful. Return RC_NODE_FULL if the page is full.
+ */
+RC BTPostingNode::insert(const RecordId& rid)
+{
+	if(!validRid(rid))
+		return RC_INVALID_RID;
 	
-	//Update sibling's number of keys and set pid to current node's pid ptr
-	sibling.number_keys = getKeyCount() - numHalfKeys;
-	sibling.setNextNodePtr(getNextNodePtr());
+	if(count >= MAX_RIDS)
+		return RC_NODE_FULL;
 	
-	//Clear the second half of current buffer except for pid; update number of keys
-	std::fill(buffer+halfIndex, buffer + PageFile::PAGE_SIZE - sizeof(PageId), 0); 
-	number_keys = numHalfKeys;
+	int pos = upper_bound(rids, rids+count, rid) - rids;
 	
-	//Check which buffer to insert new (key, rid) into
-	int firstHalfKey;
-	memcpy(&firstHalfKey, sibling.buffer, sizeof(int));
+	memmove(rids+pos+1, rids+pos, (count-pos)*sizeof(RecordId));
+	rids[pos] = rid;
+	count++;
 	
-	//Insert pair and increment number of keys
-	if(key>=firstHalfKey) //If our key belongs in the second buffer (since it's sorted)...
-	{
-		sibling.insert(key, rid);
-	}
-	else //Otherwise, place it in the first half
+	if(usedBytes() > POSTING_CAPACITY)
 	{
-		insert(key, rid);
+		memmove(rids+pos, rids+pos+1, (count-pos-1)*sizeof(RecordId));
+		count--;
+		return RC_NODE_FULL;
 	}
 	
-	//Copy over sibling's first key and rid
-	memcpy(&siblingKey, sibling.buffer, sizeof(int));
+	return 0;
+}
+
+/*
+ * Insert rid and split the page with sibling, which follows it in the chain.
+ * @param rid[IN] the RecordId to insert
+ * @param sibling[IN] the empty page to split with
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTPostingNode::insertAndSplit(const RecordId& rid, BTPostingNode& sibling)
+{
+	if(sibling.count!=0)
+		return RC_INVALID_ATTRIBUTE;
+	
+	if(!validRid(rid))
+		return RC_INVALID_RID;
 	
-	RecordId siblingRid;
-	siblingRid.pid = -1;
-	siblingRid.sid = -1;
-	memcpy(&siblingRid, sibling.buffer+sizeof(int), sizeof(RecordId));
+	//Appending: start a new page and leave this one full
+	if(count==0 || !(rid < rids[count-1]))
+		return sibling.insert(rid);
 	
-	//Remember not to touch the next node pointer
-	//Since we use it later, changing this will destroy the index tree's leaf node mapping
+	int pos = upper_bound(rids, rids+count, rid) - rids;
+	
+	memmove(rids+pos+1, rids+pos, (count-pos)*sizeof(RecordId));
+	rids[pos] = rid;
+	count++;
+	
+	int half = count/2;
+	memcpy(sibling.rids, rids+half, (count-half)*sizeof(RecordId));
+	sibling.count = count-half;
+	count = half;
 	
 	return 0;
 }
+
 /*
- * Find the entry whose key value is larger than or equal to searchKey
- * and output the eid (entry number) whose key value >= searchKey.
- * Remeber that all keys inside a B+tree node should be kept sorted.
- * @param searchKey[IN] the key to search for
- * @param eid[OUT] the entry number that contains a key larger than or equalty to searchKey
- * @return 0 if successful. Return an error code if there is an error.
+ * Remove rid from the page.
+ * @param rid[IN] the RecordId to remove
+ * @return 0 if successful. Return RC_NO_SUCH_RECORD if rid is not in the page.
  */
-RC BTLeafNode::locate(int searchKey, int& eid)
+RC BTPostingNode::remove(const RecordId& rid)
 {
-	//This is the size in bytes of an entry pair
-	int size_record = sizeof(RecordId) + sizeof(int);
+	int pos = lower_bound(rids, rids+count, rid) - rids;
 	
-	char* temp = buffer;
+	if(pos >= count || rids[pos]!=rid)
+		return RC_NO_SUCH_RECORD;
 	
-	//Loop through all the indexes in the temp buffer; increment by 12 bytes to jump to next key	
-	int i;
-	for(i=0; i<getKeyCount()*size_record; i+=size_record)
-	{
-		int innerKey;
-		memcpy(&innerKey, temp, sizeof(int)); //Save the current key inside buffer as innerKey
-		
-		//Once innerKey is larger than or equal to searchKey
-		if(innerKey >= searchKey)
-		{
-			//Set eid to the current byte index divided by size of a pair entry
-			//This effectively produces eid
-			eid = i/size_record;
-			return 0;
-		}
-		
-		temp += size_record; //Jump temp over to the next key
-	}
+	memmove(rids+pos, rids+pos+1, (count-pos-1)*sizeof(RecordId));
+	count--;
 	
-	//If we get here, all of the keys inside the buffer were less than searchKey
-	eid = getKeyCount();
 	return 0;
 }
 
 /*
- * Read the (key, rid) pair from the eid entry.
- * @param eid[IN] the entry number to read the (key, rid) pair from
- * @param key[OUT] the key from the entry
- * @param rid[OUT] the RecordId from the entry
- * @return 0 if successful. Return an error code if there is an error.
+ * Read the pos-th RecordId of the page.
+ * @param pos[IN] the position in the page
+ * @param rid[OUT] the RecordId
+ * @return 0 if successful. Return RC_NO_SUCH_RECORD if pos is out of range.
  */
-RC BTLeafNode::readEntry(int eid, int& key, RecordId& rid)
+RC BTPostingNode::readEntry(int pos, RecordId& rid)
+{
+	if(pos < 0 || pos >= count)
+		return RC_NO_SUCH_RECORD;
+	
+	rid = rids[pos];
+	return 0;
+}
+
+int BTPostingNode::getCount()
+{
+	return count;
+}
+
+PageId BTPostingNode::getNextPtr()
+{
+	return nextPtr;
+}
+
+RC BTPostingNode::setNextPtr(PageId pid)
+{
+	if(pid < 0)
+		return RC_INVALID_PID;
+	
+	nextPtr = pid;
+	return 0;
+}
+
+//----------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------
+
+
+//Nonleaf node constructor
+BTNonLeafNode::BTNonLeafNode()
+{
+	number_keys = 0;
+	pids[0] = 0;
+	counts[0] = 0;
+}
+
+//Layout of a nonleaf node in its page:
+//  [key count (2 bytes)][key bytes][key shift][pid bytes][3 unused bytes][key base][pid base]
+//  [pid, count] [pid, count] ... [key] [key] ...
+//The count next to a pid is the number of leaf entries in the subtree of that pid,
+//so the counts let us find how many entries lie before a key without reading leaves.
+//Keys are stored as (key - key base) >> key shift in key bytes (1 to 4), and pids
+//as pid - pid base in 2 bytes when the children are close enough, 4 otherwise.
+//Separators are picked with as many trailing zero bits as possible (see
+//separator()), which makes the shift large and the stored keys short.
+
+//Size in bytes of the header and of the subtree count next to every pid
+static const int NONLEAF_HEADER = 2*sizeof(int) + sizeof(int) + sizeof(PageId);
+static const int NONLEAF_COUNT = sizeof(int);
+
+//Number of bytes needed for values from 0 to range
+static int byteWidth(unsigned range)
 {
-	//This is the size in bytes of an entry pair
-	int size_record = sizeof(RecordId) + sizeof(int);
+	int bytes = 1;
 	
-	//If eid is out of bounds (negative or more than the number of keys we have), return error
-	if(eid >= getKeyCount() || eid < 0)
-		return RC_NO_SUCH_RECORD; //Not sure which error to return...RC_INVALID_CURSOR?
+	for(range >>= 8; range > 0; range >>= 8)
+		bytes++;
 	
-	//This is the position in bytes of the entry
-	int bytePos = eid*size_record;
+	return bytes;
+}
+
+//Number of trailing zero bits of v; 32 for 0
+static int trailingZeros(unsigned v)
+{
+	if(v==0)
+		return 32;
 	
-	char* temp = buffer;
+	int bits = 0;
 	
-	//Copy the data into parameters
-	memcpy(&key, temp+bytePos, sizeof(int));
-	memcpy(&rid, temp+bytePos+sizeof(int), sizeof(RecordId));
+	for(; (v & 1)==0; v >>= 1)
+		bits++;
 	
-	return 0;
+	return bits;
 }
 
-/*
- * Return the pid of the next slibling node.
- * @return the PageId of the next sibling node 
- */
-PageId BTLeafNode::getNextNodePtr()
+//Little-endian fields of 1 to 4 bytes
+static unsigned getField(const char* p, int bytes)
 {
-	//Initialize a PageId; assume there's no next node by default
-	PageId pid = 0; 
-	char* temp = buffer;
+	unsigned v = 0;
 	
-	//Find the last PageId section of the buffer and copy data over to pid
-	memcpy(&pid, temp+PageFile::PAGE_SIZE-sizeof(PageId), sizeof(PageId));
+	for(int i=bytes-1; i>=0; i--)
+		v = (v << 8) | (unsigned char)p[i];
 	
-	return pid;
+	return v;
+}
+
+static void putField(char* p, int bytes, unsigned v)
+{
+	for(int i=0; i<bytes; i++, v >>= 8)
+		p[i] = (char)(v & 0xff);
 }
 
 /*
- * Set the pid of the next slibling node.
- * @param pid[IN] the PageId of the next sibling node 
- * @return 0 if successful. Return an error code if there is an error.
+ * Return the shortest separator between two neighbouring nodes: the key
+ * with the most trailing zero bits that is larger than low and not larger
+ * than high. Every key below it is <= low and every key from it on is >= high.
+ * @param low[IN] the largest key of the left node
+ * @param high[IN] the smallest key of the right node; larger than low
+ * @return the separator key
  */
-RC BTLeafNode::setNextNodePtr(PageId pid)
+int BTNonLeafNode::separator(int low, int high)
 {
-	//If pid is invalid, return error
-	if(pid < 0)
-		return RC_INVALID_PID;
-	
-	char* temp = buffer;
-	
-	//Otherwise, copy the parameter pid into our buffer
-	memcpy(temp+PageFile::PAGE_SIZE-sizeof(PageId), &pid, sizeof(PageId));
+	//Clear low bits of high for as long as the result stays above low
+	for(int bits=31; bits>0; bits--)
+	{
+		long long mask = ~((1LL << bits) - 1);
+		long long candidate = (long long)high & mask;
+		
+		if(candidate > low)
+			return (int)candidate;
+	}
 	
-	return 0;
+	return high;
 }
 
 /*
- * Print the keys of the node to cout
+ * Find the encoding of n keys and the n+1 pids around them.
+ * @return the number of bytes the node takes in its page
  */
-void BTLeafNode::print()
+static int nonLeafEncoding(const int* keys, const PageId* pids, int n,
+                           int& keyBytes, int& keyShift, int& pidBytes)
 {
-	//This is the size in bytes of an entry pair
-	int size_record = sizeof(RecordId) + sizeof(int);
+	unsigned diffs = 0;
+	PageId low = pids[0], high = pids[0];
 	
-	char* temp = buffer;
+	for(int i=1; i<n; i++)
+		diffs |= (unsigned)keys[i]-(unsigned)keys[0];
 	
-	for(int i=0; i<getKeyCount()*size_record; i+=size_record)
+	for(int i=1; i<=n; i++)
 	{
-		int innerKey;
-		memcpy(&innerKey, temp, sizeof(int)); //Save the current key inside buffer as innerKey
-		
-		cout << innerKey << " ";
-		
-		temp += size_record; //Jump temp over to the next key
+		low = std::min(low, pids[i]);
+		high = std::max(high, pids[i]);
 	}
 	
-	cout << "" << endl;
+	keyShift = std::min(trailingZeros(diffs), 31);
+	keyBytes = (n==0) ? 1 : byteWidth(((unsigned)keys[n-1]-(unsigned)keys[0]) >> keyShift);
+	pidBytes = ((unsigned)high-(unsigned)low <= 0xffff) ? 2 : sizeof(PageId);
+	
+	return NONLEAF_HEADER + (n+1)*(pidBytes+NONLEAF_COUNT) + n*keyBytes;
 }
 
-//----------------------------------------------------------------------------------------------------
-//----------------------------------------------------------------------------------------------------
-//----------------------------------------------------------------------------------------------------
-
-
-//Nonleaf node constructor
-BTNonLeafNode::BTNonLeafNode()
+/*
+ * Return the number of bytes the node takes in its page.
+ * @return the encoded size of the node
+ */
+int BTNonLeafNode::getUsedBytes()
 {
-	number_keys=0;
-	std::fill(buffer, buffer + PageFile::PAGE_SIZE, 0); //clear the buffer if necessary
+	int keyBytes, keyShift, pidBytes;
+	
+	return nonLeafEncoding(keys, pids, number_keys, keyBytes, keyShift, pidBytes);
 }
 
 /*
  * Read the content of the node from the page pid in the PageFile pf.
+ * An optimistic reader may read a page that is being reused for another
+ * node; such a page decodes to no keys, and never to anything outside the page.
  * @param pid[IN] the PageId to read
  * @param pf[IN] PageFile to read from
  * @return 0 if successful. Return an error code if there is an error.
  */
 RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
 {
+	char buffer[PageFile::PAGE_SIZE];
+	
+	number_keys = 0;
+	pids[0] = 0;
+	counts[0] = 0;
+	
 	//Use PageFile to read from selected page into buffer
-	return pf.read(pid, buffer);
+	RC rc = pf.read(pid, buffer);
+	
+	if(rc!=0)
+		return rc;
+	
+	unsigned short count;
+	memcpy(&count, buffer, sizeof(unsigned short));
+	
+	int keyBytes = (unsigned char)buffer[2];
+	int keyShift = (unsigned char)buffer[3];
+	int pidBytes = (unsigned char)buffer[4];
+	int keyBase;
+	PageId pidBase;
+	memcpy(&keyBase, buffer+2*sizeof(int), sizeof(int));
+	memcpy(&pidBase, buffer+3*sizeof(int), sizeof(PageId));
+	
+	if(count > MAX_KEY_COUNT || keyBytes < 1 || keyBytes > 4 || keyShift > 31 || (pidBytes!=2 && pidBytes!=4) ||
+	   NONLEAF_HEADER + (count+1)*(pidBytes+NONLEAF_COUNT) + count*keyBytes > PageFile::PAGE_SIZE)
+		return 0;
+	
+	const char* p = buffer+NONLEAF_HEADER;
+	
+	for(int i=0; i<=count; i++)
+	{
+		pids[i] = (PageId)((unsigned)pidBase + getField(p, pidBytes));
+		memcpy(&counts[i], p+pidBytes, sizeof(int));
+		p += pidBytes+NONLEAF_COUNT;
+	}
+	
+	for(int i=0; i<count; i++)
+	{
+		keys[i] = (int)((unsigned)keyBase + (getField(p, keyBytes) << keyShift));
+		p += keyBytes;
+	}
+	
+	number_keys = count;
+	return 0;
 }
     
 /*
@@ -374,115 +1683,171 @@ RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
  */
 RC BTNonLeafNode::write(PageId pid, PageFile& pf)
 {
+	char buffer[PageFile::PAGE_SIZE];
+	int keyBytes, keyShift, pidBytes;
+	
+	if(nonLeafEncoding(keys, pids, number_keys, keyBytes, keyShift, pidBytes) > PageFile::PAGE_SIZE)
+		return RC_NODE_FULL;
+	
+	std::fill(buffer, buffer + PageFile::PAGE_SIZE, 0);
+	
+	unsigned short count = number_keys;
+	int keyBase = (number_keys > 0) ? keys[0] : 0;
+	PageId pidBase = *std::min_element(pids, pids+number_keys+1);
+	
+	memcpy(buffer, &count, sizeof(unsigned short));
+	buffer[2] = (char)keyBytes;
+	buffer[3] = (char)keyShift;
+	buffer[4] = (char)pidBytes;
+	memcpy(buffer+2*sizeof(int), &keyBase, sizeof(int));
+	memcpy(buffer+3*sizeof(int), &pidBase, sizeof(PageId));
+	
+	char* p = buffer+NONLEAF_HEADER;
+	
+	for(int i=0; i<=number_keys; i++)
+	{
+		putField(p, pidBytes, (unsigned)pids[i]-(unsigned)pidBase);
+		memcpy(p+pidBytes, &counts[i], sizeof(int));
+		p += pidBytes+NONLEAF_COUNT;
+	}
+	
+	for(int i=0; i<number_keys; i++)
+	{
+		putField(p, keyBytes, ((unsigned)keys[i]-(unsigned)keyBase) >> keyShift);
+		p += keyBytes;
+	}
+	
 	//Use PageFile to write from buffer into selected page
 	return pf.write(pid, buffer);
 }
 
 /*
- * Return the number of keys stored in the node.
- * @return the number of keys in the node
+ * Check that one more (key, pid) pair fits into the node without a split,
+ * whatever key and pid it has: the check assumes they widen every stored
+ * key and pid to 4 bytes.
+ * @return true if the node has room for another entry
  */
-int BTNonLeafNode::maxKeyCount()
+bool BTNonLeafNode::hasRoom()
 {
-	int size_record = sizeof(int) + sizeof(PageId);
-	return (PageFile::PAGE_SIZE - sizeof(PageId))/size_record;
+	return NONLEAF_HEADER + (number_keys+2)*(sizeof(PageId)+NONLEAF_COUNT) + (number_keys+1)*sizeof(int) <= (unsigned)PageFile::PAGE_SIZE;
 }
+
+/*
+ * Return the number of keys stored in the node.
+ * @return the number of keys in the node
+ */
 int BTNonLeafNode::getKeyCount()
 {
-	//return number_keys;
-	
-	//This is the size in bytes of an entry pair
-	int size_record = sizeof(PageId) + sizeof(int);
-	int totPairs = maxKeyCount(); //127
-	int count=0;
-	//Now we must go through the buffer's sorted keys to see where the new key goes
-	//For nonleaf nodes only, remember to skip the first 8 bytes (4 bytes pid, 4 bytes empty)
-	char* temp = buffer+8;
-	
-	//Loop through all the indexes in the temp buffer; increment by 8 bytes to jump to next key
-	//1016 is the largest possible index of the next inserted pair (since we already know we can fit another pair)
-	//For nonleaf nodes only, remember that we start the (key,pid) entries at index 8
-	int i;
-	for(i=8; i<=1016; i+=size_record)
-	{
-		int innerKey;
-		memcpy(&innerKey, temp, sizeof(int)); //Save the current key inside buffer as innerKey
-		if(innerKey==0) //Once we hit key of 0, we break
-			break;
-		//Otherwise, increment count
-		count++;
+	return number_keys;
+}
 
-		temp += size_record; //Jump temp over to the next key
-	}
-	
-	return count;
+/*
+ * Return the number of the child that searchKey leads to,
+ * i.e., the number of keys in the node that are <= searchKey.
+ * @param searchKey[IN] the key being looked up
+ * @return the child number, from 0 to getKeyCount()
+ */
+int BTNonLeafNode::locateChildIndex(int searchKey)
+{
+	return upper_bound(keys, keys+number_keys, searchKey) - keys;
 }
 
 /*
  * Insert a (key, pid) pair to the node.
  * @param key[IN] the key to insert
  * @param pid[IN] the PageId to insert
+ * @param count[IN] the number of leaf entries under pid
  * @return 0 if successful. Return an error code if the node is full.
  */
-RC BTNonLeafNode::insert(int key, PageId pid)
+RC BTNonLeafNode::insert(int key, PageId pid, int count)
 {
-	//Nonleaf nodes have pairs of integer keys and PageIds, with another PageId at the front
-	int size_record = sizeof(PageId) + sizeof(int);
-	int totPairs = maxKeyCount(); //127
+	//The arrays hold one entry more than a page, for insertAndSplit()
+	if(number_keys >= MAX_KEY_COUNT)
+		return RC_NODE_FULL;
+	
+	//The new key goes in front of the first key that is not smaller
+	int eid = lower_bound(keys, keys+number_keys, key) - keys;
+	
+	//Shift the rest of the entries one slot to the right and write the new entry
+	memmove(keys+eid+1, keys+eid, (number_keys-eid)*sizeof(int));
+	memmove(pids+eid+2, pids+eid+1, (number_keys-eid)*sizeof(PageId));
+	memmove(counts+eid+2, counts+eid+1, (number_keys-eid)*sizeof(int));
+	keys[eid] = key;
+	pids[eid+1] = pid;
+	counts[eid+1] = count;
+	number_keys++;
 	
-	//Return error if no more space in this node
-	//Page has 1024 bytes, we need to store 8 bytes (key, pid)
-	//That means we can fit 127 with 8 bytes left over; the first 4 will be used for pid
-	//Check if adding one more (key, pid) pair will exceed the size limit of 127
-	if(getKeyCount()+1 > totPairs)
+	//Take the entry out again if the node no longer fits into its page
+	if(getUsedBytes() > PageFile::PAGE_SIZE)
 	{
-		//cout << "Cannot insert anymore: this node is full!" << endl;
+		removeEntry(eid);
 		return RC_NODE_FULL;
 	}
+	
+	return 0;
+}
+
+/*
+ * Split the entries laid out in keys, pids and counts between this node
+ * and sibling at key mid, which goes up to the parent.
+ * @param n[IN] the number of keys laid out
+ * @param mid[IN] the key to split at
+ * @param sibling[IN] the node that gets the keys behind mid
+ * @param midKey[OUT] the key between the two halves
+ */
+void BTNonLeafNode::splitAt(int n, int mid, BTNonLeafNode& sibling, int& midKey)
+{
+	//The key at mid moves up to the parent and
+	//its (pid, count) becomes the first child of the sibling
+	midKey = keys[mid];
+	sibling.number_keys = n-mid-1;
+	memcpy(sibling.keys, keys+mid+1, sibling.number_keys*sizeof(int));
+	memcpy(sibling.pids, pids+mid+1, (sibling.number_keys+1)*sizeof(PageId));
+	memcpy(sibling.counts, counts+mid+1, (sibling.number_keys+1)*sizeof(int));
+	
+	number_keys = mid;
+}
 
-	//Now we must go through the buffer's sorted keys to see where the new key goes
-	//For nonleaf nodes only, remember to skip the first 8 bytes (4 bytes pid, 4 bytes empty)
-	char* temp = buffer+8;
+/*
+ * Split the entries laid out in keys, pids and counts between this node
+ * and sibling. The key at the split goes up to the parent. Near the middle,
+ * the key with the most trailing zero bits is picked, as it takes the
+ * fewest bytes in the parent; both halves must fit into a page.
+ * @param n[IN] the number of keys laid out
+ * @param sibling[IN] the node that gets the right half
+ * @param midKey[OUT] the key between the two halves
+ * @return 0 if successful. Return RC_NODE_FULL if no split fits.
+ */
+RC BTNonLeafNode::splitEntries(int n, BTNonLeafNode& sibling, int& midKey)
+{
+	int keyBytes, keyShift, pidBytes;
+	int best = -1;
+	int bestScore = INT_MIN;
 	
-	//Loop through all the indexes in the temp buffer; increment by 8 bytes to jump to next key
-	//1016 is the largest possible index of the next inserted pair (since we already know we can fit another pair)
-	//For nonleaf nodes only, remember that we start the (key,pid) entries at index 8
-	int i;
-	for(i=8; i<1016; i+=size_record)
+	for(int mid=0; mid<n; mid++)
 	{
-		int innerKey;
-		memcpy(&innerKey, temp, sizeof(int)); //Save the current key inside buffer as innerKey
+		int leftBytes = nonLeafEncoding(keys, pids, mid, keyBytes, keyShift, pidBytes);
+		int rightBytes = nonLeafEncoding(keys+mid+1, pids+mid+1, n-mid-1, keyBytes, keyShift, pidBytes);
 		
-		//Once the innerKey is null or key is smaller than some inside key, we stop
-		if(innerKey==0 || !(key > innerKey))
-			break;
+		if(leftBytes > PageFile::PAGE_SIZE || rightBytes > PageFile::PAGE_SIZE)
+			continue;
 		
-		temp += size_record; //Jump temp over to the next key
+		//Stay within an eighth of the keys around the middle if that fits
+		int distance = abs(2*mid-n);
+		int score = (distance <= n/8) ? trailingZeros((unsigned)keys[mid])*PageFile::PAGE_SIZE : -PageFile::PAGE_SIZE*64;
+		score -= distance;
+		
+		if(score > bestScore)
+		{
+			bestScore = score;
+			best = mid;
+		}
 	}
 	
-	//At this point, variable i holds the index to insert the pair and temp is the buffer at that index
-	char* buffer1 = (char*)malloc(PageFile::PAGE_SIZE);
-	std::fill(buffer1, buffer1 + PageFile::PAGE_SIZE, 0); //clear the buffer if necessary
-	
-	//Copy all values from buffer into buffer1 up until i
-	memcpy(buffer1, buffer, i);
-	
-	//Copy key and pid into buffer1
-	memcpy(buffer1+i, &key, sizeof(int));
-	memcpy(buffer1+i+sizeof(int), &pid, sizeof(PageId));
-	
-	//Copy the rest of the values into buffer1
-	//For nonleaf nodes only, remember that we must add in 8 bytes extra
-	//Otherwise we would be counting the initial (pid, empty) as a key
-	memcpy(buffer1+i+size_record, buffer+i, getKeyCount()*size_record - i + 8);
-	
-	
-	//Copy buffer1 into buffer, then delete temporary buffer1 to prevent memory leak
-	memcpy(buffer, buffer1, PageFile::PAGE_SIZE);
-	free(buffer1);
+	if(best < 0)
+		return RC_NODE_FULL;
 	
-	//Successfully inserted leaf node, so we increment number of keys
-	number_keys++;	
+	splitAt(n, best, sibling, midKey);
 	return 0;
 }
 
@@ -492,109 +1857,38 @@ RC BTNonLeafNode::insert(int key, PageId pid)
  * The middle key after the split is returned in midKey.
  * @param key[IN] the key to insert
  * @param pid[IN] the PageId to insert
+ * @param count[IN] the number of leaf entries under pid
  * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
  * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
+ * @param rightEdge[IN] true if the node is the right-most one of its level
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey)
+RC BTNonLeafNode::insertAndSplit(int key, PageId pid, int count, BTNonLeafNode& sibling, int& midKey, bool rightEdge)
 {
-	//Nonleaf nodes have pairs of integer keys and PageIds, with another PageId at the front
-	int size_record = sizeof(PageId) + sizeof(int);
-	int totPairs = maxKeyCount(); //127
-	
-	//Only split if inserting will cause an overflow; otherwise, return error
-	if(!(getKeyCount() >= totPairs))
-		return RC_INVALID_FILE_FORMAT;
-	
 	//If sibling node is not empty, return error
 	if(sibling.getKeyCount()!=0)
 		return RC_INVALID_ATTRIBUTE;
-
-	//Clear sibling buffer just in case
-	std::fill(sibling.buffer, sibling.buffer + PageFile::PAGE_SIZE, 0); //clear the buffer if necessary
-
-	//Calculate keys to remain in the first half
-	int numHalfKeys = ((int)((getKeyCount()+1)/2));
-
-	//Find the index at which to split the node's buffer
-	//For nonleaf nodes only, remember to add an offset of 8 for initial pid
-	int halfIndex = numHalfKeys*size_record + 8;
 	
-	//REMOVING THE MEDIAN KEY
+	//Lay out all keyCount+1 entries in order; the arrays have room for one more
+	int eid = lower_bound(keys, keys+number_keys, key) - keys;
 	
-	//Find the last key of the first half and the first key of the second half
-	int key1 = -1;
-	int key2 = -1;
-	
-	memcpy(&key1, buffer+halfIndex-8, sizeof(int));
-	memcpy(&key2, buffer+halfIndex, sizeof(int));
+	memmove(keys+eid+1, keys+eid, (number_keys-eid)*sizeof(int));
+	memmove(pids+eid+2, pids+eid+1, (number_keys-eid)*sizeof(PageId));
+	memmove(counts+eid+2, counts+eid+1, (number_keys-eid)*sizeof(int));
+	keys[eid] = key;
+	pids[eid+1] = pid;
+	counts[eid+1] = count;
+	number_keys++;
 	
-	if(key < key1) //key1 is the median key to be removed
-	{
-		//Copy everything on the right side of halfIndex into sibling's buffer (ignore the pid)
-		//For nonleaf nodes only, remember to add an offset of 8 for initial pid
-		memcpy(sibling.buffer+8, buffer+halfIndex, PageFile::PAGE_SIZE-halfIndex);
-		//Update sibling's number of keys
-		sibling.number_keys = getKeyCount() - numHalfKeys;
-		
-		//Copy down the median key before getting rid of it in buffer
-		memcpy(&midKey, buffer+halfIndex-8, sizeof(int));
-		
-		//Also set the sibling pid from buffer before getting rid of it
-		memcpy(sibling.buffer, buffer+halfIndex-4, sizeof(PageId));
-		
-		//Clear the second half of current buffer; update number of keys
-		//Also clear the last key of the first half, since this is the median key
-		std::fill(buffer+halfIndex-8, buffer + PageFile::PAGE_SIZE, 0); 
-		number_keys = numHalfKeys - 1;
-		
-		//Insert the (key, pid) pair into buffer, since it's key is smaller than the median
-		insert(key, pid);		
-	}
-	else if(key > key2) //key2 is the median key to be removed
-	{
-		//Copy everything on the right side of halfIndex EXCEPT FOR THE FIRST KEY into sibling's buffer (ignore the pid)
-		//The first key on the right side here is the median key, which will be removed
-		//For nonleaf nodes only, remember to add an offset of 8 for initial pid
-		memcpy(sibling.buffer+8, buffer+halfIndex+8, PageFile::PAGE_SIZE-halfIndex-8);
-		//Update sibling's number of keys
-		sibling.number_keys = getKeyCount() - numHalfKeys - 1;
-		
-		//Copy down the median key before getting rid of it in buffer
-		memcpy(&midKey, buffer+halfIndex, sizeof(int));
-		
-		//Also set the sibling pid from buffer before getting rid of it
-		memcpy(sibling.buffer, buffer+halfIndex+4, sizeof(PageId));
-		
-		//Clear the second half of current buffer; update number of keys
-		std::fill(buffer+halfIndex, buffer + PageFile::PAGE_SIZE, 0); 
-		number_keys = numHalfKeys;
-		
-		//Insert the (key, pid) pair into sibling, since it's key is larger than the median
-		sibling.insert(key, pid);
-		
-	}
-	else //key is the median key to be removed
+	//Appending at the right edge of the tree (a load sorted by key): keep
+	//this node full and start the sibling with the new child only
+	if(rightEdge && eid==number_keys-1)
 	{
-		//Copy everything on the right side of halfIndex into sibling's buffer (ignore the pid)
-		//For nonleaf nodes only, remember to add an offset of 8 for initial pid
-		memcpy(sibling.buffer+8, buffer+halfIndex, PageFile::PAGE_SIZE-halfIndex);
-		//Update sibling's number of keys
-		sibling.number_keys = getKeyCount() - numHalfKeys;
-		
-		//Clear the second half of current buffer; update number of keys
-		std::fill(buffer+halfIndex, buffer + PageFile::PAGE_SIZE, 0); 
-		number_keys = numHalfKeys;
-		
-		//The key we're inserting IS the median key, so we stop the insertion process and return
-		midKey = key;
-		
-		//Set the sibling pid from the median key parameter
-		memcpy(sibling.buffer, &pid, sizeof(PageId));
+		splitAt(number_keys, eid, sibling, midKey);
+		return 0;
 	}
-
-	//If we reach this, then we have somehow split the node and inserted the (key, pid) pair
-	return 0;
+	
+	return splitEntries(number_keys, sibling, midKey);
 }
 
 /*
@@ -606,100 +1900,287 @@ RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, in
  */
 RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
 {
-	//This is the size in bytes of an entry pair
-	int size_record = sizeof(PageId) + sizeof(int);
-	
-	//Skip the first 8 offset bytes, since there's no key there
-	char* temp = buffer+8;	
-	
-	//Loop through all the indexes in the temp buffer; increment by 8 bytes to jump to next key	
-	int i;	
-	for(i=8; i<getKeyCount()*size_record+8; i+=size_record)
-	{
-		int innerKey;
-		memcpy(&innerKey, temp, sizeof(int)); //Save the current key inside buffer as innerKey
-				
-		if(i==8 && innerKey > searchKey) //If searchKey is less than first key, we need to return initial pid
-		{
-			//A special check is necessarily since the initial pid is in a different buffer position from the rest
-			memcpy(&pid, buffer, sizeof(PageId));
-			return 0;
-		}
-		else if(innerKey > searchKey)
-		{
-			//Set pid to be the left pid (that is, the pid on the small side of innerKey)
-			memcpy(&pid, temp-4, sizeof(PageId));
-			return 0;
-		}
-		
-		//Otherwise, searchKey is greater than or equal to innerKey, so we keep checking
-		temp += size_record; //Jump temp over to the next key
-		
-	}
-	
-	//If we get here, searchKey was greater than all instances of innerKey
-	//Copy over the last, right-most pid before returning
-	//Remember that temp is now on the next non-existent node's position, so we need to decrement by 4 bytes
-	memcpy(&pid, temp-4, sizeof(PageId));
+	//The child in front of the first key larger than searchKey
+	//(or the right-most child if there is no such key)
+	pid = pids[locateChildIndex(searchKey)];
 	return 0;
 }
 
 /*
  * Initialize the root node with (pid1, key, pid2).
  * @param pid1[IN] the first PageId to insert
+ * @param count1[IN] the number of leaf entries under pid1
  * @param key[IN] the key that should be inserted between the two PageIds
  * @param pid2[IN] the PageId to insert behind the key
+ * @param count2[IN] the number of leaf entries under pid2
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::initializeRoot(PageId pid1, int count1, int key, PageId pid2, int count2)
+{
+	number_keys = 0;
+	pids[0] = pid1;
+	counts[0] = count1;
+	
+	//Then the first (key, pid, count) entry
+	return insert(key, pid2, count2);
+}
+
+/*
+ * Read the eid-th key and the child-node pointer right behind it.
+ * @param eid[IN] the entry number to read the (key, pid) pair from
+ * @param key[OUT] the key from the entry
+ * @param pid[OUT] the PageId of the child node on the right of the key
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2)
+RC BTNonLeafNode::readEntry(int eid, int& key, PageId& pid)
+{
+	//If eid is out of bounds (negative or more than the number of keys we have), return error
+	if(eid >= number_keys || eid < 0)
+		return RC_NO_SUCH_RECORD;
+	
+	key = keys[eid];
+	pid = pids[eid+1];
+	
+	return 0;
+}
+
+/*
+ * Read the pointer and the entry count of the idx-th child.
+ * @param idx[IN] the child number, from 0 to getKeyCount()
+ * @param pid[OUT] the PageId of the child node
+ * @param count[OUT] the number of leaf entries under the child
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::readChild(int idx, PageId& pid, int& count)
+{
+	if(idx > number_keys || idx < 0)
+		return RC_NO_SUCH_RECORD;
+	
+	pid = pids[idx];
+	count = counts[idx];
+	
+	return 0;
+}
+
+/*
+ * Return the left-most child-node pointer, which has no key in front of it.
+ * @return the PageId of the first child node
+ */
+PageId BTNonLeafNode::getFirstPtr()
+{
+	return pids[0];
+}
+
+/*
+ * Return the number of leaf entries under the child that searchKey leads to.
+ * @param searchKey[IN] the key being looked up
+ * @return the number of leaf entries in the subtree of the child
+ */
+int BTNonLeafNode::getChildCount(int searchKey)
+{
+	return counts[locateChildIndex(searchKey)];
+}
+
+/*
+ * Set the number of leaf entries under the child that searchKey leads to.
+ * @param searchKey[IN] the key being looked up
+ * @param count[IN] the number of leaf entries in the subtree of the child
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::setChildCount(int searchKey, int count)
+{
+	counts[locateChildIndex(searchKey)] = count;
+	return 0;
+}
+
+/*
+ * Return the number of leaf entries under the children in front of
+ * the child that searchKey leads to. All of them are smaller than searchKey.
+ * @param searchKey[IN] the key being looked up
+ * @return the number of leaf entries before the child of searchKey
+ */
+int BTNonLeafNode::countBefore(int searchKey)
 {
-	RC error;
+	int idx = locateChildIndex(searchKey);
+	int total = 0;
+	
+	for(int i=0; i<idx; i++)
+		total += counts[i];
+	
+	return total;
+}
 
-	std::fill(buffer, buffer + PageFile::PAGE_SIZE, 0); //clear the buffer if necessary
+/*
+ * Return the number of leaf entries under all children of the node.
+ * @return the number of leaf entries in the subtree of the node
+ */
+int BTNonLeafNode::getTotalCount()
+{
+	int total = 0;
 	
-	//This time, don't skip the first 8 offset bytes
-	//We're actually initializing it to something explicitly
-	char* temp = buffer;
+	for(int i=0; i<=number_keys; i++)
+		total += counts[i];
 	
-	//Copy over the initial pid into buffer
-	memcpy(temp, &pid1, sizeof(PageId));
+	return total;
+}
+
+/*
+ * Set the number of leaf entries under the idx-th child.
+ * @param idx[IN] the child number, from 0 to getKeyCount()
+ * @param count[IN] the number of leaf entries in the subtree of the child
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::setChildCountAt(int idx, int count)
+{
+	if(idx > number_keys || idx < 0)
+		return RC_NO_SUCH_RECORD;
 	
-	//Copy the first pair into buffer
-	//memcpy(temp+8, &key, sizeof(int));
-	//memcpy(temp+12, &pid2, sizeof(PageId));
-	error = insert(key, pid2);
+	counts[idx] = count;
+	return 0;
+}
+
+/*
+ * Replace the eid-th key.
+ * @param eid[IN] the entry number of the key
+ * @param key[IN] the new key
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::setKey(int eid, int key)
+{
+	if(eid >= number_keys || eid < 0)
+		return RC_NO_SUCH_RECORD;
 	
-	if(error!=0)
-		return error;
+	keys[eid] = key;
+	return 0;
+}
+
+/*
+ * Remove the eid-th key and the child-node pointer right behind it.
+ * @param eid[IN] the entry number to remove
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::removeEntry(int eid)
+{
+	if(eid >= number_keys || eid < 0)
+		return RC_NO_SUCH_RECORD;
 	
-	//Set number of (key, pid) pairs to 1
-	//Only need this if we dont use insert to set (key, pid2) pair
-	//number_keys = 1;
+	//Shift the rest of the entries one slot to the left
+	memmove(keys+eid, keys+eid+1, (number_keys-eid-1)*sizeof(int));
+	memmove(pids+eid+1, pids+eid+2, (number_keys-eid-1)*sizeof(PageId));
+	memmove(counts+eid+1, counts+eid+2, (number_keys-eid-1)*sizeof(int));
+	number_keys--;
 	
 	return 0;
 }
 
 /*
- * Print the keys of the node to cout
+ * Check whether a nonleaf node other than the root is less than half full.
+ * @return true if less than half of the page is in use
  */
-void BTNonLeafNode::print()
+bool BTNonLeafNode::isUnderflow()
+{
+	return getUsedBytes() < PageFile::PAGE_SIZE/2;
+}
+
+/*
+ * Append midKey and all keys and children of the next sibling node to this node.
+ * @param midKey[IN] the key between the two nodes in their parent
+ * @param sibling[IN] the next sibling node; it is left unchanged
+ * @return 0 if successful. Return RC_NODE_FULL if the entries do not fit.
+ */
+RC BTNonLeafNode::merge(int midKey, BTNonLeafNode& sibling)
 {
-	//This is the size in bytes of an entry pair
-	int size_record = sizeof(PageId) + sizeof(int);
+	int keyCount = number_keys;
 	
-	//Skip the first 8 offset bytes, since there's no key there
-	char* temp = buffer+8;
+	if(keyCount+1+sibling.number_keys > MAX_KEY_COUNT)
+		return RC_NODE_FULL;
+	
+	//midKey comes down in front of the sibling's first child
+	keys[keyCount] = midKey;
+	memcpy(keys+keyCount+1, sibling.keys, sibling.number_keys*sizeof(int));
+	memcpy(pids+keyCount+1, sibling.pids, (sibling.number_keys+1)*sizeof(PageId));
+	memcpy(counts+keyCount+1, sibling.counts, (sibling.number_keys+1)*sizeof(int));
+	number_keys = keyCount+1+sibling.number_keys;
 	
-	for(int i=8; i<getKeyCount()*size_record+8; i+=size_record)
+	//Take the entries out again if they do not fit into one page
+	if(getUsedBytes() > PageFile::PAGE_SIZE)
 	{
-		int innerKey;
-		memcpy(&innerKey, temp, sizeof(int)); //Save the current key inside buffer as innerKey
+		number_keys = keyCount;
+		return RC_NODE_FULL;
+	}
+	
+	return 0;
+}
 
-		cout << innerKey << " ";
+/*
+ * Move keys and children between this node and its next sibling so that
+ * both hold about half of them. The key between the two nodes goes
+ * through the parent: midKey comes down and newMidKey goes up.
+ * @param midKey[IN] the key between the two nodes in their parent
+ * @param sibling[IN] the next sibling node
+ * @param newMidKey[OUT] the key to put between the two nodes in their parent
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::redistribute(int midKey, BTNonLeafNode& sibling, int& newMidKey)
+{
+	int keyCount = number_keys;
+	int totKeys = keyCount+1+sibling.number_keys;
+	
+	//Lay out all entries in order, with midKey in front of the sibling's first child
+	int allKeys[2*MAX_KEY_COUNT+1];
+	PageId allPids[2*MAX_KEY_COUNT+2];
+	int allCounts[2*MAX_KEY_COUNT+2];
+	
+	memcpy(allKeys, keys, keyCount*sizeof(int));
+	allKeys[keyCount] = midKey;
+	memcpy(allKeys+keyCount+1, sibling.keys, sibling.number_keys*sizeof(int));
+	memcpy(allPids, pids, (keyCount+1)*sizeof(PageId));
+	memcpy(allPids+keyCount+1, sibling.pids, (sibling.number_keys+1)*sizeof(PageId));
+	memcpy(allCounts, counts, (keyCount+1)*sizeof(int));
+	memcpy(allCounts+keyCount+1, sibling.counts, (sibling.number_keys+1)*sizeof(int));
+	
+	//Split them again by bytes, like insertAndSplit(), and keep the old split if none fits
+	int keyBytes, keyShift, pidBytes;
+	int best = -1;
+	int bestDiff = INT_MAX;
+	
+	for(int mid=0; mid<totKeys; mid++)
+	{
+		int leftBytes = nonLeafEncoding(allKeys, allPids, mid, keyBytes, keyShift, pidBytes);
+		int rightBytes = nonLeafEncoding(allKeys+mid+1, allPids+mid+1, totKeys-mid-1, keyBytes, keyShift, pidBytes);
 		
-		//Otherwise, searchKey is greater than or equal to innerKey, so we keep checking
-		temp += size_record; //Jump temp over to the next key
+		if(leftBytes <= PageFile::PAGE_SIZE && rightBytes <= PageFile::PAGE_SIZE && abs(leftBytes-rightBytes) < bestDiff)
+		{
+			bestDiff = abs(leftBytes-rightBytes);
+			best = mid;
+		}
 	}
 	
+	if(best < 0)
+		best = keyCount;
+	
+	newMidKey = allKeys[best];
+	
+	number_keys = best;
+	memcpy(keys, allKeys, best*sizeof(int));
+	memcpy(pids, allPids, (best+1)*sizeof(PageId));
+	memcpy(counts, allCounts, (best+1)*sizeof(int));
+	
+	sibling.number_keys = totKeys-best-1;
+	memcpy(sibling.keys, allKeys+best+1, sibling.number_keys*sizeof(int));
+	memcpy(sibling.pids, allPids+best+1, (sibling.number_keys+1)*sizeof(PageId));
+	memcpy(sibling.counts, allCounts+best+1, (sibling.number_keys+1)*sizeof(int));
+	
+	return 0;
+}
+
+/*
+ * Print the keys of the node to cout
+ */
+void BTNonLeafNode::print()
+{
+	for(int eid=0; eid<number_keys; eid++)
+		cout << keys[eid] << " ";
+	
 	cout << "" << endl;	
-}
\ No newline at end of file
+}
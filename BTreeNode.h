@@ -14,12 +14,37 @@
 #include "PageFile.h"
 #include <string.h>
 #include <stdlib.h>
+#include <vector>
 
 /**
  * BTLeafNode: The class representing a B+tree leaf node.
+ * A leaf stores every key once, followed by its posting list: the sorted
+ * RecordIds of all entries with the key, delta-encoded. A posting list that
+ * grows too long for the leaf is moved to a chain of posting pages
+ * (BTPostingNode), and the leaf keeps the number of entries and the first
+ * posting page. Entries are numbered (eid) in (key, rid) order, so an entry
+ * id counts the RecordIds on posting pages as well.
+ *
+ * A leaf whose keys each have a single RecordId may instead be packed:
+ * every key is stored as its difference to the smallest key, and every
+ * RecordId as its difference to the smallest one, each with as few bits
+ * as the largest difference needs. write() picks whichever encoding is
+ * smaller. A packed leaf is only unpacked when it is changed; lookups and
+ * reads extract single keys and RecordIds straight from the packed bits.
+ * Unpacking and the last steps of a lookup use AVX2 or AVX-512 kernels
+ * when the CPU has them.
  */
 class BTLeafNode {
   public:
+
+    // the most bytes a posting list may take in the leaf; longer lists
+    // are moved to posting pages by the index
+    static const int MAX_POSTING_BYTES = PageFile::PAGE_SIZE / 8;
+
+    // the most keys and inline RecordIds a leaf page can hold (a packed
+    // leaf needs at least one bit per entry)
+    static const int MAX_RIDS = PageFile::PAGE_SIZE - sizeof(int) - sizeof(PageId);
+    static const int MAX_SLOTS = MAX_RIDS;
   
    /**
     * Constructor for leaf node; initialize its variables
@@ -31,19 +56,21 @@ class BTLeafNode {
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert
     * @param rid[IN] the RecordId to insert
-    * @return 0 if successful. Return an error code if the node is full.
+    * @return 0 if successful. Return an error code if the node is full,
+    *         or RC_INVALID_ATTRIBUTE if the posting list of key is on posting pages.
     */
     RC insert(int key, const RecordId& rid);
 
    /**
     * Insert the (key, rid) pair to the node
-    * and split the node half and half with sibling.
-    * The first key of the sibling node is returned in siblingKey.
+    * and split the node half and half (in bytes) with sibling.
+    * All entries with the same key stay in the same node.
+    * The separator key to put in the parent is returned in siblingKey.
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert.
     * @param rid[IN] the RecordId to insert.
     * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
-    * @param siblingKey[OUT] the first key in the sibling node after split.
+    * @param siblingKey[OUT] the shortest separator between the two nodes (see BTNonLeafNode::separator()).
     * @return 0 if successful. Return an error code if there is an error.
     */
     RC insertAndSplit(int key, const RecordId& rid, BTLeafNode& sibling, int& siblingKey);
@@ -61,6 +88,8 @@ class BTLeafNode {
 
    /**
     * Read the (key, rid) pair from the eid entry.
+    * The RecordId of an entry on a posting page is not in the node:
+    * rid is then set to (-1, -1) and getPostingEntry() tells where it is.
     * @param eid[IN] the entry number to read the (key, rid) pair from
     * @param key[OUT] the key from the slot
     * @param rid[OUT] the RecordId from the slot
@@ -68,6 +97,50 @@ class BTLeafNode {
     */
     RC readEntry(int eid, int& key, RecordId& rid);
 
+   /**
+    * Find the RecordId of the eid entry on the posting pages of its key.
+    * @param eid[IN] the entry number
+    * @param head[OUT] the first posting page of the key
+    * @param pos[OUT] the position of the RecordId in the posting list
+    * @return true if the entry is on posting pages, false if it is in the node
+    */
+    bool getPostingEntry(int eid, PageId& head, int& pos);
+
+   /**
+    * Find the posting list of key.
+    * @param key[IN] the key to look up
+    * @param head[OUT] the first posting page, or 0 if the list is in the node
+    * @param count[OUT] the number of entries with the key
+    * @return 0 if successful. Return RC_NO_SUCH_RECORD if the key is not in the node.
+    */
+    RC getPosting(int key, PageId& head, int& count);
+
+   /**
+    * Keep the posting list of key on posting pages from now on,
+    * dropping the RecordIds stored in the node.
+    * @param key[IN] a key in the node
+    * @param head[IN] the first posting page of the key
+    * @param count[IN] the number of entries with the key; 0 removes the key
+    * @return 0 if successful. Return RC_NO_SUCH_RECORD if the key is not in the node.
+    */
+    RC setPosting(int key, PageId head, int count);
+
+   /**
+    * Read the posting list of key that is stored in the node.
+    * @param key[IN] the key to look up
+    * @param rids[OUT] the RecordIds of the key, sorted
+    * @return 0 if successful. Return RC_NO_SUCH_RECORD if the key is not in the node
+    *         or its list is on posting pages.
+    */
+    RC readPosting(int key, std::vector<RecordId>& rids);
+
+   /**
+    * Return the number of bytes the posting list of key takes in the node.
+    * @param key[IN] the key to look up
+    * @return the size of the posting list; 0 if the key is not in the node
+    */
+    int getPostingBytes(int key);
+
    /**
     * Return the pid of the next slibling node.
     * @return the PageId of the next sibling node 
@@ -83,11 +156,50 @@ class BTLeafNode {
     RC setNextNodePtr(PageId pid);
 
    /**
-    * Return the number of keys stored in the node.
-    * @return the number of keys in the node
+    * Return the number of (key, rid) entries stored in the node,
+    * including the ones on posting pages.
+    * @return the number of entries in the node
     */
     int getKeyCount();
-    int maxKeyCount();
+
+   /**
+    * Return the number of bytes of the page the node takes.
+    * @return the encoded size of the node
+    */
+    int getUsedBytes();
+
+   /**
+    * Check whether a leaf other than the root is less than half full.
+    * Such a leaf must borrow from or merge with a sibling after remove().
+    * @return true if less than half of the page is in use
+    */
+    bool isUnderflow();
+
+   /**
+    * Remove the (key, rid) pair from the node.
+    * @param key[IN] the key to remove
+    * @param rid[IN] the RecordId to remove
+    * @return 0 if successful. Return RC_NO_SUCH_RECORD if the pair is not
+    *         in the node or on posting pages.
+    */
+    RC remove(int key, const RecordId& rid);
+
+   /**
+    * Move all entries of the next sibling node to the end of this node.
+    * The sibling's next node pointer becomes this node's.
+    * @param sibling[IN] the next sibling node; it is left unchanged
+    * @return 0 if successful. Return RC_NODE_FULL if the entries do not fit.
+    */
+    RC merge(BTLeafNode& sibling);
+
+   /**
+    * Move keys between this node and its next sibling so that both
+    * take about half of their bytes.
+    * @param sibling[IN] the next sibling node
+    * @param siblingKey[OUT] the shortest separator between the two nodes afterwards
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC redistribute(BTLeafNode& sibling, int& siblingKey);
     
    /**
     * Read the content of the node from the page pid in the PageFile pf.
@@ -111,23 +223,159 @@ class BTLeafNode {
     void print();
 
   private:
-    //declare the variables that a nonleaf must hold
-    int number_keys;
-    /**
-    * The main memory buffer for loading the content of the disk page 
-    * that contains the node.
-    */
-    char buffer[PageFile::PAGE_SIZE];
-   
+    //unpack a packed node into the arrays below before it is changed
+    void decode();
+
+    //key and RecordId of the i-th entry of a packed node
+    int packedKey(int i);
+    RecordId packedRid(int i);
+
+    //encoded size of the node with each encoding; INT_MAX if it cannot be packed
+    int varintBytes();
+    int packedBytes();
+
+    //whether the node fits into its page and, unpacked, into two pages
+    bool fits();
+
+    //the bases and bit widths the node would be packed with; false if it cannot be
+    bool packing(int& keyBase, int& keyBits, unsigned long long& ridBase, int& ridBits);
+
+    //find the slot of key; returns false and the slot to insert it at if it is not there
+    bool findSlot(int key, int& slot);
+
+    //find the slot holding the eid entry
+    int slotOf(int eid);
+
+    //number of bytes slot takes in the page
+    int slotBytes(int slot);
+
+    //make room for a new slot, or drop one
+    void insertSlot(int slot, int key, int count, PageId head, const RecordId* rids);
+    void removeSlot(int slot);
+
+    //recompute the first entry and the first inline RecordId of every slot
+    void reindex();
+
+    //the decoded content of the node
+    int       slotCount;               // # keys
+    int       keys[MAX_SLOTS+1];       // the keys, sorted
+    int       counts[MAX_SLOTS+1];     // # entries with each key
+    PageId    heads[MAX_SLOTS+1];      // first posting page, 0 if the RecordIds are inline
+    int       firstEntry[MAX_SLOTS+2]; // eid of the first entry of each slot
+    int       firstRid[MAX_SLOTS+2];   // index in rids of the first inline RecordId of each slot
+    int       ridCount;                // # inline RecordIds
+    RecordId  rids[MAX_RIDS+1];        // the inline posting lists, in key order
+    PageId    nextPtr;                 // the next sibling node
+
+    //a packed node as read from its page, until decode() is called
+    bool      packed;                  // true if the arrays above are not filled in yet
+    int       packedCount;             // # entries
+    int       packedUsed;              // # bytes of the page in use
+    int       keyBase, keyBits;        // smallest key and bits per key difference
+    unsigned long long ridBase;        // smallest RecordId, in record slots
+    int       ridBits;                 // bits per RecordId difference
+    int       keyOffset, ridOffset;    // where the key and RecordId bits start in page
+    char      page[PageFile::PAGE_SIZE+sizeof(unsigned long long)]; // with room to read a word past the end
 }; 
 
 
+/**
+ * BTPostingNode: a page of the posting list of one key that is too long
+ * to be kept in its leaf. The pages of a key form a chain, each holding
+ * a sorted, delta-encoded run of RecordIds that follows the previous page.
+ */
+class BTPostingNode {
+  public:
+
+    // the most RecordIds a posting page can hold
+    static const int MAX_RIDS = PageFile::PAGE_SIZE - sizeof(PageId) - sizeof(int);
+
+    BTPostingNode();
+
+   /**
+    * Insert rid into the page, keeping the RecordIds sorted.
+    * @param rid[IN] the RecordId to insert
+    * @return 0 if successful. Return RC_NODE_FULL if the page is full.
+    */
+    RC insert(const RecordId& rid);
+
+   /**
+    * Insert rid and split the page with sibling, which follows it in the chain.
+    * A rid behind all others goes alone into the sibling, so that pages
+    * filled in RecordId order stay full.
+    * @param rid[IN] the RecordId to insert
+    * @param sibling[IN] the empty page to split with
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC insertAndSplit(const RecordId& rid, BTPostingNode& sibling);
+
+   /**
+    * Remove rid from the page.
+    * @param rid[IN] the RecordId to remove
+    * @return 0 if successful. Return RC_NO_SUCH_RECORD if rid is not in the page.
+    */
+    RC remove(const RecordId& rid);
+
+   /**
+    * Read the pos-th RecordId of the page.
+    * @param pos[IN] the position in the page
+    * @param rid[OUT] the RecordId
+    * @return 0 if successful. Return RC_NO_SUCH_RECORD if pos is out of range.
+    */
+    RC readEntry(int pos, RecordId& rid);
+
+    // the number of RecordIds in the page
+    int getCount();
+
+    // the next page of the chain, 0 if this is the last one
+    PageId getNextPtr();
+    RC setNextPtr(PageId pid);
+
+   /**
+    * Read/write the page pid of the PageFile pf.
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC read(PageId pid, const PageFile& pf);
+    RC write(PageId pid, PageFile& pf);
+
+  private:
+    //number of bytes the RecordIds take in the page
+    int usedBytes();
+
+    int       count;
+    RecordId  rids[MAX_RIDS+1];
+    PageId    nextPtr;
+};
+
+
 /**
  * BTNonLeafNode: The class representing a B+tree nonleaf node.
+ * Next to every child-node pointer, the node keeps the number of leaf
+ * entries in the subtree of that child (a "counted" B+tree), so that the
+ * number of entries in a key range can be found with two descents.
+ *
+ * The node is decoded into arrays when it is read. In its page, keys are
+ * stored relative to the first key with as few bytes as they need, and the
+ * pids as 16-bit offsets when the children lie close together, so the
+ * number of keys a node holds depends on the keys and is found by bytes.
+ * Separators are picked as short as possible (separator()) to help that.
  */
 class BTNonLeafNode {
   public:
   
+    // the most keys a nonleaf node can hold: one byte per key and a 16-bit
+    // pid with its 4-byte count per child, behind a 16-byte header
+    static const int MAX_KEY_COUNT = (PageFile::PAGE_SIZE - 16 - 2 - sizeof(int)) / (1 + 2 + sizeof(int));
+  
+   /**
+    * Return the shortest separator between two neighbouring nodes: the key
+    * with the most trailing zero bits in (low, high].
+    * @param low[IN] the largest key of the left node
+    * @param high[IN] the smallest key of the right node; larger than low
+    * @return the separator key
+    */
+    static int separator(int low, int high);
+  
     /**
     * Constructor for nonleaf node; initialize its variables
     */
@@ -138,23 +386,29 @@ class BTNonLeafNode {
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert
     * @param pid[IN] the PageId to insert
+    * @param count[IN] the number of leaf entries under pid
     * @return 0 if successful. Return an error code if the node is full.
     */
-    RC insert(int key, PageId pid);
+    RC insert(int key, PageId pid, int count);
 
    /**
     * Insert the (key, pid) pair to the node
-    * and split the node half and half with sibling.
+    * and split the node about half and half (by bytes) with sibling.
     * The sibling node MUST be empty when this function is called.
-    * The middle key after the split is returned in midKey.
+    * The middle key after the split is returned in midKey; near the middle,
+    * the key that takes the fewest bytes in the parent is picked.
+    * A key appended behind all others in the right-most node of a level is
+    * split off alone with its child instead, which leaves this node full.
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert
     * @param pid[IN] the PageId to insert
+    * @param count[IN] the number of leaf entries under pid
     * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
     * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
+    * @param rightEdge[IN] true if the node is the right-most one of its level
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey);
+    RC insertAndSplit(int key, PageId pid, int count, BTNonLeafNode& sibling, int& midKey, bool rightEdge);
 
    /**
     * Given the searchKey, find the child-node pointer to follow and
@@ -166,14 +420,119 @@ class BTNonLeafNode {
     */
     RC locateChildPtr(int searchKey, PageId& pid);
 
+   /**
+    * Return the number of the child that searchKey leads to, i.e.,
+    * the number of keys in the node that are <= searchKey.
+    * @param searchKey[IN] the key being looked up
+    * @return the child number, from 0 to getKeyCount()
+    */
+    int locateChildIndex(int searchKey);
+
    /**
     * Initialize the root node with (pid1, key, pid2).
     * @param pid1[IN] the first PageId to insert
+    * @param count1[IN] the number of leaf entries under pid1
     * @param key[IN] the key that should be inserted between the two PageIds
     * @param pid2[IN] the PageId to insert behind the key
+    * @param count2[IN] the number of leaf entries under pid2
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC initializeRoot(PageId pid1, int count1, int key, PageId pid2, int count2);
+
+   /**
+    * Read the eid-th key and the child-node pointer right behind it.
+    * @param eid[IN] the entry number to read the (key, pid) pair from
+    * @param key[OUT] the key from the entry
+    * @param pid[OUT] the PageId of the child node on the right of the key
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC readEntry(int eid, int& key, PageId& pid);
+
+   /**
+    * Read the pointer and the entry count of the idx-th child.
+    * @param idx[IN] the child number, from 0 to getKeyCount()
+    * @param pid[OUT] the PageId of the child node
+    * @param count[OUT] the number of leaf entries under the child
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC readChild(int idx, PageId& pid, int& count);
+
+   /**
+    * Return the left-most child-node pointer, which has no key in front of it.
+    * @return the PageId of the first child node
+    */
+    PageId getFirstPtr();
+
+   /**
+    * Return the number of leaf entries under the child that searchKey leads to.
+    * @param searchKey[IN] the key being looked up
+    * @return the number of leaf entries in the subtree of the child
+    */
+    int getChildCount(int searchKey);
+
+   /**
+    * Set the number of leaf entries under the child that searchKey leads to.
+    * @param searchKey[IN] the key being looked up
+    * @param count[IN] the number of leaf entries in the subtree of the child
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC initializeRoot(PageId pid1, int key, PageId pid2);
+    RC setChildCount(int searchKey, int count);
+
+   /**
+    * Return the number of leaf entries under the children in front of
+    * the child that searchKey leads to.
+    * @param searchKey[IN] the key being looked up
+    * @return the number of leaf entries before the child of searchKey
+    */
+    int countBefore(int searchKey);
+
+   /**
+    * Set the number of leaf entries under the idx-th child.
+    * @param idx[IN] the child number, from 0 to getKeyCount()
+    * @param count[IN] the number of leaf entries in the subtree of the child
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC setChildCountAt(int idx, int count);
+
+   /**
+    * Replace the eid-th key.
+    * @param eid[IN] the entry number of the key
+    * @param key[IN] the new key
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC setKey(int eid, int key);
+
+   /**
+    * Remove the eid-th key and the child-node pointer right behind it.
+    * @param eid[IN] the entry number to remove
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC removeEntry(int eid);
+
+   /**
+    * Append midKey and all keys and children of the next sibling node to this node.
+    * @param midKey[IN] the key between the two nodes in their parent
+    * @param sibling[IN] the next sibling node; it is left unchanged
+    * @return 0 if successful. Return RC_NODE_FULL if the entries do not fit.
+    */
+    RC merge(int midKey, BTNonLeafNode& sibling);
+
+   /**
+    * Move keys and children between this node and its next sibling so that
+    * both hold about half of them; midKey comes down from the parent
+    * and newMidKey goes up in its place.
+    * @param midKey[IN] the key between the two nodes in their parent
+    * @param sibling[IN] the next sibling node
+    * @param newMidKey[OUT] the key to put between the two nodes in their parent
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC redistribute(int midKey, BTNonLeafNode& sibling, int& newMidKey);
+
+   /**
+    * Return the number of leaf entries under all children of the node.
+    * @return the number of leaf entries in the subtree of the node
+    */
+    int getTotalCount();
 
    /**
     * Return the number of keys stored in the node.
@@ -181,7 +540,25 @@ class BTNonLeafNode {
     */
     int getKeyCount();
 
-    int maxKeyCount();
+   /**
+    * Return the number of bytes the node takes in its page.
+    * @return the encoded size of the node
+    */
+    int getUsedBytes();
+
+   /**
+    * Check that one more (key, pid) pair fits into the node without a
+    * split, whatever the key and pid are.
+    * @return true if the node has room for another entry
+    */
+    bool hasRoom();
+
+   /**
+    * Check whether a nonleaf node other than the root is less than half full.
+    * Such a node must borrow from or merge with a sibling after a remove.
+    * @return true if less than half of the page is in use
+    */
+    bool isUnderflow();
 
    /**
     * Read the content of the node from the page pid in the PageFile pf.
@@ -205,13 +582,16 @@ class BTNonLeafNode {
     void print();
 
   private:
-    //declare the variables that a nonleaf must hold
-    int number_keys;
-    /**
-    * The main memory buffer for loading the content of the disk page 
-    * that contains the node.
-    */
-    char buffer[PageFile::PAGE_SIZE];
+    //split the n keys laid out in the arrays with sibling; the middle key goes up
+    RC splitEntries(int n, BTNonLeafNode& sibling, int& midKey);
+    void splitAt(int n, int mid, BTNonLeafNode& sibling, int& midKey);
+
+    //declare the variables that a nonleaf must hold; the arrays have
+    //room for one entry more than a page, for insertAndSplit()
+    int       number_keys;
+    int       keys[MAX_KEY_COUNT+1];     // the separator keys
+    PageId    pids[MAX_KEY_COUNT+2];     // the children; pids[i+1] is behind keys[i]
+    int       counts[MAX_KEY_COUNT+2];   // # leaf entries in the subtree of each child
 }; 
 
-#endif /* BTNODE_H */
\ No newline at end of file
+#endif /* BTNODE_H */
@@ -0,0 +1,154 @@
+/*
+ * Blocked Bloom filter on the keys of a table.
+ */
+
+#include "BloomFilter.h"
+#include "Hash.h"
+#include "PageFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unistd.h>
+
+using std::string;
+
+//Layout of a filter file:
+//  page 0: [magic][block count][hash count][rate]
+//  page 1, 2, ...: the blocks, PageFile::PAGE_SIZE / 64 of them in a page
+
+static const int BLOOM_MAGIC = 0x424c4d31; // "BLM1"
+
+//64-bit words in a block, and blocks in a page
+static const int BLOCK_WORDS = BloomFilter::BLOCK_BITS / 64;
+static const int PAGE_BLOCKS = PageFile::PAGE_SIZE / (BLOCK_WORDS * sizeof(unsigned long long));
+
+BloomFilter::BloomFilter()
+{
+  blockCount = 0;
+  hashCount = 0;
+  rate = 0;
+}
+
+void BloomFilter::create(int keyCount, int rate)
+{
+  if (rate < 2) rate = 2;
+  if (keyCount < 1) keyCount = 1;
+
+  // a plain Bloom filter needs 1.44 * log2(rate) bits per key and
+  // log2(rate) hashes; keeping each key in one block costs about 20% more bits
+  double bitsPerKey = 1.2 * 1.44 * log((double) rate) / log(2.0);
+  double totalBits = bitsPerKey * keyCount;
+
+  blockCount = (int) ceil(totalBits / BLOCK_BITS);
+  hashCount = (int) (log((double) rate) / log(2.0) + 0.5);
+  if (hashCount < 1) hashCount = 1;
+  if (hashCount > 16) hashCount = 16;
+  this->rate = rate;
+
+  bits.assign((size_t) blockCount * BLOCK_WORDS, 0);
+}
+
+void BloomFilter::add(int key)
+{
+  if (blockCount == 0) return;
+
+  unsigned long long h = hashMix((unsigned) key);
+  unsigned long long* block = &bits[(size_t) ((h >> 32) * blockCount >> 32) * BLOCK_WORDS];
+
+  // every bit position takes 9 bits of a hash; 7 of them fit in 64 bits
+  unsigned long long probe = hashMix(h);
+  for (int i = 0; i < hashCount; i++) {
+    if (i > 0 && i % 7 == 0) probe = hashMix(probe);
+    int bit = probe & (BLOCK_BITS - 1);
+    block[bit >> 6] |= 1ULL << (bit & 63);
+    probe >>= 9;
+  }
+}
+
+bool BloomFilter::mayContain(int key) const
+{
+  if (blockCount == 0) return true;
+
+  unsigned long long h = hashMix((unsigned) key);
+  const unsigned long long* block = &bits[(size_t) ((h >> 32) * blockCount >> 32) * BLOCK_WORDS];
+
+  unsigned long long probe = hashMix(h);
+  for (int i = 0; i < hashCount; i++) {
+    if (i > 0 && i % 7 == 0) probe = hashMix(probe);
+    int bit = probe & (BLOCK_BITS - 1);
+    if (!(block[bit >> 6] & (1ULL << (bit & 63)))) return false;
+    probe >>= 9;
+  }
+
+  return true;
+}
+
+RC BloomFilter::write(const string& filename) const
+{
+  PageFile pf;
+  char page[PageFile::PAGE_SIZE];
+  RC rc;
+
+  // start from an empty file; an old filter may have more pages
+  unlink(filename.c_str());
+  if ((rc = pf.open(filename, 'w')) < 0) return rc;
+
+  memset(page, 0, PageFile::PAGE_SIZE);
+  int header[4] = { BLOOM_MAGIC, blockCount, hashCount, rate };
+  memcpy(page, header, sizeof(header));
+  rc = pf.write(0, page);
+
+  for (int b = 0; rc == 0 && b < blockCount; b += PAGE_BLOCKS) {
+    int n = std::min(PAGE_BLOCKS, blockCount - b);
+    memset(page, 0, PageFile::PAGE_SIZE);
+    memcpy(page, &bits[(size_t) b * BLOCK_WORDS], n * BLOCK_WORDS * sizeof(unsigned long long));
+    rc = pf.write(1 + b / PAGE_BLOCKS, page);
+  }
+
+  pf.close();
+  return rc;
+}
+
+RC BloomFilter::read(const string& filename)
+{
+  PageFile pf;
+  char page[PageFile::PAGE_SIZE];
+  RC rc;
+
+  blockCount = 0;
+  bits.clear();
+
+  if ((rc = pf.open(filename, 'r')) < 0) return rc;
+
+  int header[4];
+  if ((rc = pf.read(0, page)) < 0) {
+    pf.close();
+    return rc;
+  }
+  memcpy(header, page, sizeof(header));
+
+  if (header[0] != BLOOM_MAGIC || header[1] < 0 || header[2] < 1 || header[2] > 16 ||
+      1 + (header[1] + PAGE_BLOCKS - 1) / PAGE_BLOCKS > pf.endPid()) {
+    pf.close();
+    return RC_INVALID_FILE_FORMAT;
+  }
+
+  hashCount = header[2];
+  rate = header[3];
+  bits.assign((size_t) header[1] * BLOCK_WORDS, 0);
+
+  for (int b = 0; b < header[1]; b += PAGE_BLOCKS) {
+    if ((rc = pf.read(1 + b / PAGE_BLOCKS, page)) < 0) {
+      bits.clear();
+      pf.close();
+      return rc;
+    }
+    int n = std::min(PAGE_BLOCKS, header[1] - b);
+    memcpy(&bits[(size_t) b * BLOCK_WORDS], page, n * BLOCK_WORDS * sizeof(unsigned long long));
+  }
+
+  // only a completely read filter may rule keys out
+  blockCount = header[1];
+  pf.close();
+  return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Blocked Bloom filter on the keys of a table.
+ * The filter is split into cache-line-sized blocks; a key sets and tests
+ * bits in one block only, so a lookup touches a single cache line.
+ * It is kept next to the index, in tablename + ".blm", and tells for a
+ * key = X condition whether X may be in the table at all.
+ */
+
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+
+class BloomFilter {
+ public:
+  static const int DEFAULT_RATE = 100;  // one false positive in 100 lookups
+  static const int BLOCK_BITS = 512;    // the bits in one block (a 64-byte cache line)
+
+  BloomFilter();
+
+  /**
+   * make an empty filter sized for keyCount keys.
+   * @param keyCount[IN] the number of distinct keys that will be added
+   * @param rate[IN] allow about one false positive in rate lookups of absent keys
+   */
+  void create(int keyCount, int rate);
+
+  /**
+   * add a key to the filter.
+   * @param key[IN] the key to add
+   */
+  void add(int key);
+
+  /**
+   * test whether a key may have been added.
+   * an empty filter (nothing created or read) may contain every key.
+   * @param key[IN] the key to test
+   * @return false only if the key was certainly never added
+   */
+  bool mayContain(int key) const;
+
+  /**
+   * write the filter to a file, replacing its content.
+   * @param filename[IN] the file to write
+   * @return error code. 0 if no error
+   */
+  RC write(const std::string& filename) const;
+
+  /**
+   * read the filter from a file.
+   * @param filename[IN] the file to read
+   * @return error code. 0 if no error
+   */
+  RC read(const std::string& filename);
+
+  /**
+   * @return the number of blocks in the filter
+   */
+  int getBlockCount() const { return blockCount; }
+
+  /**
+   * @return the false positive rate the filter was sized for
+   */
+  int getRate() const { return rate; }
+
+ private:
+  int blockCount;   // # blocks
+  int hashCount;    // # bits set per key
+  int rate;         // the false positive rate the filter was sized for
+  std::vector<unsigned long long> bits; // blockCount blocks of BLOCK_BITS bits
+};
+
+#endif // BLOOMFILTER_H
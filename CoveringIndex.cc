@@ -0,0 +1,166 @@
+/*
+ * Covering B+tree index on the key column of a table.
+ */
+
+#include "CoveringIndex.h"
+#include <cstring>
+
+using std::string;
+
+//Layout of an index file (see EntryTree.cc for the rest):
+//  page 0: the fields of EntryTree, then [prefix length][# entries whose value was cut short]
+//  leaf entries:     [key][rid][value length (1 byte), high bit set if cut short][value]
+//  non-leaf entries: [key][rid][child pid]
+
+static const int COVER_MAGIC = 0x43445831; // "CDX1"
+
+//The length byte of a leaf entry whose value is a prefix
+static const int TRUNCATED = 0x80;
+
+CoveringIndex::CoveringIndex()
+  : EntryTree(COVER_MAGIC, FORMAT_VERSION, 2)
+{
+  truncatedCount = 0;
+  prefixLength = 0;
+}
+
+RC CoveringIndex::open(const string& indexname, char mode, int prefixLength)
+{
+  // a new index file is made with this length; an existing one keeps its own
+  this->prefixLength = prefixLength;
+  truncatedCount = 0;
+
+  return openTree(indexname, mode);
+}
+
+RC CoveringIndex::createTree()
+{
+  if (prefixLength < 0 || prefixLength > RecordFile::MAX_VALUE_LENGTH) return RC_INVALID_ATTRIBUTE;
+  return 0;
+}
+
+void CoveringIndex::saveHeader(int* fields) const
+{
+  fields[0] = prefixLength;
+  fields[1] = truncatedCount;
+}
+
+bool CoveringIndex::loadHeader(const int* fields)
+{
+  if (fields[0] < 0 || fields[0] > RecordFile::MAX_VALUE_LENGTH ||
+      fields[1] < 0 || fields[1] > entryCount) return false;
+
+  prefixLength = fields[0];
+  truncatedCount = fields[1];
+  return true;
+}
+
+//Order (key, rid) pairs: by key, then by RecordId
+bool CoveringIndex::less(const TreeEntry& a, const TreeEntry& b) const
+{
+  return a.key < b.key || (a.key == b.key && a.rid < b.rid);
+}
+
+int CoveringIndex::entryBytes(const TreeEntry& e, bool leaf) const
+{
+  return sizeof(int) + sizeof(RecordId) + (leaf ? 1 + e.value.size() : sizeof(PageId));
+}
+
+char* CoveringIndex::encode(char* p, const TreeEntry& e, bool leaf) const
+{
+  memcpy(p, &e.key, sizeof(int));
+  p += sizeof(int);
+  memcpy(p, &e.rid, sizeof(RecordId));
+  p += sizeof(RecordId);
+
+  if (!leaf) {
+    memcpy(p, &e.pid, sizeof(PageId));
+    return p + sizeof(PageId);
+  }
+
+  *p++ = (char) (e.value.size() | (e.truncated ? TRUNCATED : 0));
+  memcpy(p, e.value.data(), e.value.size());
+  return p + e.value.size();
+}
+
+const char* CoveringIndex::decode(const char* p, const char* end, TreeEntry& e, bool leaf) const
+{
+  if (p + sizeof(int) + sizeof(RecordId) + (leaf ? 1 : sizeof(PageId)) > end) return NULL;
+
+  memcpy(&e.key, p, sizeof(int));
+  p += sizeof(int);
+  memcpy(&e.rid, p, sizeof(RecordId));
+  p += sizeof(RecordId);
+
+  e.value.clear();
+  e.truncated = false;
+  if (!leaf) {
+    memcpy(&e.pid, p, sizeof(PageId));
+    return p + sizeof(PageId);
+  }
+
+  int len = (unsigned char) *p++;
+  e.truncated = (len & TRUNCATED) != 0;
+  len &= ~TRUNCATED;
+
+  if (p + len > end) return NULL;
+  e.value.assign(p, len);
+  return p + len;
+}
+
+//Every entry with a larger key than left is at least (key, (-1, -1))
+void CoveringIndex::separator(const TreeEntry& left, const TreeEntry& right, TreeEntry& sep) const
+{
+  sep.key = right.key;
+  sep.rid = right.rid;
+  if (left.key != right.key) {
+    sep.rid.pid = -1;
+    sep.rid.sid = -1;
+  }
+  sep.value.clear();
+  sep.truncated = false;
+}
+
+RC CoveringIndex::insert(int key, const RecordId& rid, const string& value)
+{
+  RC rc;
+
+  TreeEntry entry;
+  entry.key = key;
+  entry.rid = rid;
+  entry.pid = 0;
+  entry.value = value.substr(0, prefixLength);
+  entry.truncated = (value.size() > entry.value.size());
+
+  if ((rc = insertEntry(entry)) < 0) return rc;
+
+  if (entry.truncated) truncatedCount++;
+  return 0;
+}
+
+RC CoveringIndex::locate(int searchKey, CoverCursor& cursor)
+{
+  // smaller than every entry with this key
+  TreeEntry probe;
+  probe.key = searchKey;
+  probe.rid.pid = -1;
+  probe.rid.sid = -1;
+  probe.pid = 0;
+  probe.truncated = false;
+
+  return locateEntry(probe, cursor);
+}
+
+RC CoveringIndex::readForward(CoverCursor& cursor, int& key, RecordId& rid, string& value, bool& truncated)
+{
+  const TreeEntry* e;
+  RC rc;
+
+  if ((rc = readEntry(cursor, e)) < 0) return rc;
+
+  key = e->key;
+  rid = e->rid;
+  value = e->value;
+  truncated = e->truncated;
+  return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Covering B+tree index on the key column of a table.
+ */
+
+#ifndef COVERINGINDEX_H
+#define COVERINGINDEX_H
+
+#include "EntryTree.h"
+#include <string>
+
+/**
+ * The position of an entry in the leaves of a CoveringIndex.
+ */
+typedef TreeCursor CoverCursor;
+
+/**
+ * Implements a B+tree on the key column that keeps the value of every
+ * tuple, or its first prefixLength bytes, in the leaf entry next to
+ * the RecordId. A query that needs nothing but key and value reads the
+ * table only for values that were cut short.
+ *
+ * The entries are (key, RecordId) pairs in this order; leaves hold as
+ * many entries as fit into their page, since the values differ in length.
+ * Tables are only appended to, so the index has no remove(). It is not
+ * safe to use an open index from several threads at the same time.
+ */
+class CoveringIndex : public EntryTree {
+ public:
+  CoveringIndex();
+
+  /**
+   * Open the index file in read or write mode.
+   * Under 'w' mode, the index file is created if it does not exist.
+   * @param indexname[IN] the name of the index file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @param prefixLength[IN] the most bytes of a value to keep in a new
+   *        index file; an existing file keeps the length it was made with
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& indexname, char mode,
+          int prefixLength = RecordFile::MAX_VALUE_LENGTH);
+
+  /**
+   * Insert the (key, RecordId) pair with the value of the record.
+   * @param key[IN] the key of the record
+   * @param rid[IN] the RecordId of the record
+   * @param value[IN] the value of the record; only its prefix is kept
+   * @return error code. 0 if no error
+   */
+  RC insert(int key, const RecordId& rid, const std::string& value);
+
+  /**
+   * Find the first entry whose key is larger than or equal to searchKey.
+   * @param searchKey[IN] the key to look for
+   * @param cursor[OUT] the cursor pointing to the entry
+   * @return error code. 0 if no error
+   */
+  RC locate(int searchKey, CoverCursor& cursor);
+
+  /**
+   * Read the entry at the cursor and move it to the next entry.
+   * @param cursor[IN/OUT] the cursor pointing to the entry to read
+   * @param key[OUT] the key of the entry
+   * @param rid[OUT] the RecordId of the entry
+   * @param value[OUT] the value kept in the entry
+   * @param truncated[OUT] true if value is only a prefix of the record's value
+   * @return error code. RC_END_OF_TREE after the last entry
+   */
+  RC readForward(CoverCursor& cursor, int& key, RecordId& rid, std::string& value, bool& truncated);
+
+  /**
+   * @return the number of entries whose value was cut short
+   */
+  int getTruncatedCount() { return truncatedCount; }
+
+  /**
+   * @return the most bytes of a value an entry keeps
+   */
+  int getPrefixLength() { return prefixLength; }
+
+  // the format of the index file; a file with another version is not opened
+  static const int FORMAT_VERSION = 2;
+
+ protected:
+  // entries are (key, rid): leaf [key][rid][value length (1 byte), high bit
+  // set if cut short][value], non-leaf [key][rid][child pid]
+  bool less(const TreeEntry& a, const TreeEntry& b) const;
+  int entryBytes(const TreeEntry& e, bool leaf) const;
+  char* encode(char* p, const TreeEntry& e, bool leaf) const;
+  const char* decode(const char* p, const char* end, TreeEntry& e, bool leaf) const;
+  void separator(const TreeEntry& left, const TreeEntry& right, TreeEntry& sep) const;
+  void saveHeader(int* fields) const;
+  bool loadHeader(const int* fields);
+  RC createTree();
+
+ private:
+  int truncatedCount;  /// # entries whose value was cut short
+  int prefixLength;    /// the most bytes of a value kept in an entry
+};
+
+#endif /* COVERINGINDEX_H */
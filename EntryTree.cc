@@ -0,0 +1,373 @@
+/*
+ * B+tree of variable-length entries, shared by the value index and the
+ * covering index.
+ */
+
+#include "EntryTree.h"
+#include <cstring>
+
+using std::string;
+using std::vector;
+
+//Layout of an index file:
+//  page 0: [magic][format version][page size][root pid][tree height][entry count]
+//          followed by the fields of the subclass
+//  node page: [entry count (2 bytes)][entry bytes (2 bytes)][link pid]
+//          followed by the entries, as the subclass encodes them
+
+static const int HEADER_FIELDS = 6;
+
+static const int NODE_HEADER = 2 * sizeof(unsigned short) + sizeof(PageId);
+static const int NODE_CAPACITY = PageFile::PAGE_SIZE - NODE_HEADER;
+
+EntryTree::EntryTree(int magic, int formatVersion, int extraFields)
+  : magic(magic), formatVersion(formatVersion), extraFields(extraFields)
+{
+  writable = false;
+  rootPid = -1;
+  treeHeight = 0;
+  entryCount = 0;
+  leafPid = 0;
+}
+
+RC EntryTree::openTree(const string& indexname, char mode)
+{
+  char page[PageFile::PAGE_SIZE];
+  RC rc;
+
+  if ((rc = pf.open(indexname, mode)) < 0) return rc;
+
+  writable = (mode == 'w' || mode == 'W');
+  rootPid = -1;
+  treeHeight = 0;
+  entryCount = 0;
+  leafPid = 0;
+
+  // a new index file starts with its metadata page
+  if (pf.endPid() == 0) {
+    if (!writable) {
+      pf.close();
+      return RC_INVALID_FILE_FORMAT;
+    }
+    if ((rc = createTree()) < 0 || (rc = writeHeader()) < 0) pf.close();
+    return rc;
+  }
+
+  if ((rc = pf.read(0, page)) < 0) {
+    pf.close();
+    return rc;
+  }
+
+  vector<int> header(HEADER_FIELDS + extraFields);
+  memcpy(&header[0], page, header.size() * sizeof(int));
+
+  if (header[0] != magic || header[1] != formatVersion ||
+      header[2] != PageFile::PAGE_SIZE || header[4] < 0 || header[5] < 0 ||
+      (header[4] > 0 && (header[3] <= 0 || header[3] >= pf.endPid()))) {
+    pf.close();
+    return RC_INVALID_FILE_FORMAT;
+  }
+
+  rootPid = header[4] > 0 ? header[3] : -1;
+  treeHeight = header[4];
+  entryCount = header[5];
+
+  if (!loadHeader(&header[HEADER_FIELDS])) {
+    pf.close();
+    return RC_INVALID_FILE_FORMAT;
+  }
+
+  return 0;
+}
+
+RC EntryTree::close()
+{
+  RC rc = 0;
+
+  if (writable) rc = writeHeader();
+
+  leafPid = 0;
+  RC closeRc = pf.close();
+  return rc < 0 ? rc : closeRc;
+}
+
+RC EntryTree::writeHeader()
+{
+  char page[PageFile::PAGE_SIZE];
+  vector<int> header(HEADER_FIELDS + extraFields);
+
+  header[0] = magic;
+  header[1] = formatVersion;
+  header[2] = PageFile::PAGE_SIZE;
+  header[3] = rootPid;
+  header[4] = treeHeight;
+  header[5] = entryCount;
+  saveHeader(&header[HEADER_FIELDS]);
+
+  memset(page, 0, PageFile::PAGE_SIZE);
+  memcpy(page, &header[0], header.size() * sizeof(int));
+  return pf.write(0, page);
+}
+
+RC EntryTree::readNode(PageId pid, bool leaf, Node& node)
+{
+  char page[PageFile::PAGE_SIZE];
+  RC rc;
+
+  node.entries.clear();
+  node.link = 0;
+
+  if ((rc = pf.read(pid, page)) < 0) return rc;
+
+  unsigned short count, bytes;
+  memcpy(&count, page, sizeof(count));
+  memcpy(&bytes, page + sizeof(count), sizeof(bytes));
+  memcpy(&node.link, page + 2 * sizeof(unsigned short), sizeof(PageId));
+
+  if (bytes > NODE_CAPACITY) return RC_INVALID_FILE_FORMAT;
+
+  const char* p = page + NODE_HEADER;
+  const char* end = p + bytes;
+
+  node.entries.resize(count);
+  for (int i = 0; i < count; i++) {
+    TreeEntry& e = node.entries[i];
+
+    e.pid = 0;
+    if ((p = decode(p, end, e, leaf)) == NULL) {
+      node.entries.clear();
+      return RC_INVALID_FILE_FORMAT;
+    }
+  }
+
+  return 0;
+}
+
+RC EntryTree::writeNode(PageId pid, bool leaf, const Node& node)
+{
+  char page[PageFile::PAGE_SIZE];
+  char* p = page + NODE_HEADER;
+
+  memset(page, 0, PageFile::PAGE_SIZE);
+
+  for (unsigned i = 0; i < node.entries.size(); i++) {
+    const TreeEntry& e = node.entries[i];
+
+    if (p - page + entryBytes(e, leaf) > PageFile::PAGE_SIZE) return RC_NODE_FULL;
+    p = encode(p, e, leaf);
+  }
+
+  unsigned short count = node.entries.size();
+  unsigned short bytes = p - (page + NODE_HEADER);
+  memcpy(page, &count, sizeof(count));
+  memcpy(page + sizeof(count), &bytes, sizeof(bytes));
+  memcpy(page + 2 * sizeof(unsigned short), &node.link, sizeof(PageId));
+
+  return pf.write(pid, page);
+}
+
+RC EntryTree::insertEntry(const TreeEntry& entry)
+{
+  RC rc;
+
+  if (!writable) return RC_INVALID_FILE_MODE;
+
+  // the leaf kept for readEntry() may change
+  leafPid = 0;
+
+  // the first entry makes the root a leaf
+  if (rootPid < 0) {
+    Node root;
+    root.link = 0;
+    root.entries.push_back(entry);
+    root.entries[0].pid = 0;
+
+    rootPid = pf.endPid();
+    if ((rc = writeNode(rootPid, true, root)) < 0) return rc;
+
+    treeHeight = 1;
+    entryCount = 1;
+    return 0;
+  }
+
+  bool split;
+  TreeEntry up;
+  if ((rc = insertInto(rootPid, treeHeight, entry, split, up)) < 0) return rc;
+
+  // a split root gets a new root above it
+  if (split) {
+    Node root;
+    root.link = rootPid;
+    root.entries.push_back(up);
+
+    PageId pid = pf.endPid();
+    if ((rc = writeNode(pid, false, root)) < 0) return rc;
+
+    rootPid = pid;
+    treeHeight++;
+  }
+
+  entryCount++;
+  return 0;
+}
+
+RC EntryTree::insertInto(PageId pid, int level, const TreeEntry& entry, bool& split, TreeEntry& up)
+{
+  bool leaf = (level == 1);
+  Node node;
+  RC rc;
+
+  split = false;
+  if ((rc = readNode(pid, leaf, node)) < 0) return rc;
+
+  // the entries in front of the position are not larger than the new one
+  vector<TreeEntry>& e = node.entries;
+  int pos = 0;
+  while (pos < (int) e.size() && !less(entry, e[pos])) pos++;
+
+  if (leaf) {
+    e.insert(e.begin() + pos, entry);
+    e[pos].pid = 0;
+  }
+  else {
+    bool childSplit;
+    TreeEntry childUp;
+    PageId child = (pos == 0) ? node.link : e[pos - 1].pid;
+
+    if ((rc = insertInto(child, level - 1, entry, childSplit, childUp)) < 0) return rc;
+    if (!childSplit) return 0;
+
+    e.insert(e.begin() + pos, childUp);
+  }
+
+  int bytes = 0;
+  for (unsigned i = 0; i < e.size(); i++) bytes += entryBytes(e[i], leaf);
+
+  if (bytes <= NODE_CAPACITY) return writeNode(pid, leaf, node);
+
+  // an entry appended behind all others goes alone into the new leaf, so
+  // that a load in index order leaves full leaves behind; otherwise split
+  // where the bytes are divided most evenly
+  int mid = 0, left = 0;
+  if (leaf && pos == (int) e.size() - 1 && node.link == 0)
+    mid = pos;
+  else {
+    while (mid < (int) e.size() - 1 && left + entryBytes(e[mid], leaf) <= bytes / 2)
+      left += entryBytes(e[mid++], leaf);
+    if (mid == 0) mid = 1;
+  }
+
+  Node sibling;
+  PageId siblingPid = pf.endPid();
+
+  if (leaf) {
+    sibling.entries.assign(e.begin() + mid, e.end());
+    sibling.link = node.link;
+    node.link = siblingPid;
+    e.resize(mid);
+
+    separator(e.back(), sibling.entries[0], up);
+  }
+  else {
+    // the middle separator moves up; its child becomes the sibling's first
+    up = e[mid];
+    sibling.link = e[mid].pid;
+    sibling.entries.assign(e.begin() + mid + 1, e.end());
+    e.resize(mid);
+  }
+  up.pid = siblingPid;
+
+  if ((rc = writeNode(siblingPid, leaf, sibling)) < 0) return rc;
+  if ((rc = writeNode(pid, leaf, node)) < 0) return rc;
+
+  split = true;
+  return 0;
+}
+
+RC EntryTree::locateEntry(const TreeEntry& probe, TreeCursor& cursor)
+{
+  Node node;
+  PageId pid = rootPid;
+  RC rc;
+
+  cursor.pid = 0;
+  cursor.eid = 0;
+
+  if (rootPid < 0) return 0;
+
+  for (int level = treeHeight; level > 1; level--) {
+    if ((rc = readNode(pid, false, node)) < 0) return rc;
+
+    int pos = 0;
+    while (pos < (int) node.entries.size() && !less(probe, node.entries[pos])) pos++;
+    pid = (pos == 0) ? node.link : node.entries[pos - 1].pid;
+  }
+
+  if ((rc = readNode(pid, true, leaf)) < 0) {
+    leafPid = 0;
+    return rc;
+  }
+  leafPid = pid;
+
+  int eid = 0;
+  while (eid < (int) leaf.entries.size() && less(leaf.entries[eid], probe)) eid++;
+
+  cursor.pid = pid;
+  cursor.eid = eid;
+  return 0;
+}
+
+RC EntryTree::readEntry(TreeCursor& cursor, const TreeEntry*& entry)
+{
+  RC rc;
+
+  for (;;) {
+    if (cursor.pid <= 0) return RC_END_OF_TREE;
+
+    if (cursor.pid != leafPid) {
+      if ((rc = readNode(cursor.pid, true, leaf)) < 0) {
+        leafPid = 0;
+        return rc;
+      }
+      leafPid = cursor.pid;
+    }
+
+    // nothing left in this leaf: continue with the next one
+    if (cursor.eid >= (int) leaf.entries.size()) {
+      cursor.pid = leaf.link;
+      cursor.eid = 0;
+      continue;
+    }
+
+    entry = &leaf.entries[cursor.eid++];
+    return 0;
+  }
+}
+
+double EntryTree::positionOf(const TreeEntry& probe)
+{
+  Node node;
+  PageId pid = rootPid;
+  double below = 0, share = 1;
+
+  if (rootPid < 0) return 0;
+
+  // every child of a node is taken to hold the same share of its entries
+  for (int level = treeHeight; level > 1; level--) {
+    if (readNode(pid, false, node) < 0) return below;
+
+    int pos = 0;
+    while (pos < (int) node.entries.size() && !less(probe, node.entries[pos])) pos++;
+
+    share /= node.entries.size() + 1;
+    below += share * pos;
+    pid = (pos == 0) ? node.link : node.entries[pos - 1].pid;
+  }
+
+  if (readNode(pid, true, node) < 0 || node.entries.empty()) return below;
+
+  int eid = 0;
+  while (eid < (int) node.entries.size() && less(node.entries[eid], probe)) eid++;
+
+  return below + share * eid / node.entries.size();
+}
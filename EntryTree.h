@@ -0,0 +1,177 @@
+/*
+ * B+tree of variable-length entries, shared by the value index and the
+ * covering index.
+ */
+
+#ifndef ENTRYTREE_H
+#define ENTRYTREE_H
+
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+#include <string>
+#include <vector>
+
+/**
+ * The position of an entry in the leaves of an EntryTree.
+ */
+typedef struct {
+  PageId pid;  // the leaf node, 0 past the last one
+  int    eid;  // the entry in the leaf
+} TreeCursor;
+
+/**
+ * An entry of an EntryTree. Each index uses the fields it needs: the
+ * value index (value, rid), the covering index (key, rid) with value and
+ * truncated in its leaves. pid is the child right of the separator in a
+ * non-leaf node.
+ */
+struct TreeEntry {
+  int         key;
+  std::string value;
+  bool        truncated;  // true if value is only a prefix of the record's value
+  RecordId    rid;
+  PageId      pid;
+};
+
+/**
+ * Implements a B+tree whose nodes hold as many entries as fit into their
+ * page. The tree code (paging, insert and split, locate and scan) lives
+ * here; a subclass supplies the entry codec: how an entry is ordered,
+ * stored in a page and turned into a separator, and which fields it adds
+ * to the metadata page.
+ *
+ * Tables are only appended to, so the tree has no remove(). It is not
+ * safe to use an open tree from several threads at the same time.
+ */
+class EntryTree {
+ public:
+  virtual ~EntryTree() {}
+
+  /**
+   * Close the index file.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * @return the number of entries in the tree
+   */
+  int getEntryCount() { return entryCount; }
+
+  /**
+   * @return the height of the tree, 0 if it is empty
+   */
+  int getTreeHeight() { return treeHeight; }
+
+  /**
+   * @return the number of pages of the index file
+   */
+  int getPageCount() { return pf.endPid(); }
+
+ protected:
+  /**
+   * @param magic[IN] the first word of the metadata page
+   * @param formatVersion[IN] the version of the file format
+   * @param extraFields[IN] the # ints the subclass adds to the metadata page
+   */
+  EntryTree(int magic, int formatVersion, int extraFields);
+
+  /**
+   * Open the index file in read or write mode.
+   * Under 'w' mode, the index file is created if it does not exist.
+   * @param indexname[IN] the name of the index file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error
+   */
+  RC openTree(const std::string& indexname, char mode);
+
+  /**
+   * Insert an entry.
+   * @param entry[IN] the entry; its pid is not used
+   * @return error code. 0 if no error
+   */
+  RC insertEntry(const TreeEntry& entry);
+
+  /**
+   * Find the first entry that is not smaller than probe.
+   * @param probe[IN] the entry to look for
+   * @param cursor[OUT] the cursor pointing to the entry
+   * @return error code. 0 if no error
+   */
+  RC locateEntry(const TreeEntry& probe, TreeCursor& cursor);
+
+  /**
+   * Read the entry at the cursor and move it to the next entry.
+   * @param cursor[IN/OUT] the cursor pointing to the entry to read
+   * @param entry[OUT] the entry, valid until the tree is used again
+   * @return error code. RC_END_OF_TREE after the last entry
+   */
+  RC readEntry(TreeCursor& cursor, const TreeEntry*& entry);
+
+  /**
+   * Estimate the share of entries smaller than probe from where it falls
+   * in the nodes on its path, reading one node per level.
+   * @param probe[IN] the entry to look for
+   * @return a number between 0 and 1
+   */
+  double positionOf(const TreeEntry& probe);
+
+  // the entry codec
+
+  // true if a is ordered in front of b
+  virtual bool less(const TreeEntry& a, const TreeEntry& b) const = 0;
+
+  // bytes e takes in a page
+  virtual int entryBytes(const TreeEntry& e, bool leaf) const = 0;
+
+  // store e at p and return the byte behind it
+  virtual char* encode(char* p, const TreeEntry& e, bool leaf) const = 0;
+
+  // read the entry at p into e; NULL if it does not end before end
+  virtual const char* decode(const char* p, const char* end, TreeEntry& e, bool leaf) const = 0;
+
+  // the separator sep with left < sep <= right between two leaves
+  virtual void separator(const TreeEntry& left, const TreeEntry& right, TreeEntry& sep) const = 0;
+
+  // the subclass's fields of the metadata page: written into fields,
+  // and checked when read back (false if they are not valid)
+  virtual void saveHeader(int* fields) const = 0;
+  virtual bool loadHeader(const int* fields) = 0;
+
+  // called by openTree() before a new index file is made; an error stops it
+  virtual RC createTree() { return 0; }
+
+  PageFile pf;        /// the PageFile used to store the index
+  bool   writable;    /// true if opened in 'w' mode
+  PageId rootPid;     /// the root node, -1 if the tree is empty
+  int    treeHeight;  /// the number of levels
+  int    entryCount;  /// # entries
+
+ private:
+  // a node; link is the next leaf of a leaf and the first child of a non-leaf node
+  struct Node {
+    PageId                 link;
+    std::vector<TreeEntry> entries;
+  };
+
+  RC readNode(PageId pid, bool leaf, Node& node);
+  RC writeNode(PageId pid, bool leaf, const Node& node);
+
+  // insert entry under the node pid at height level (1 is a leaf);
+  // a split of the node returns the new sibling and its separator in up
+  RC insertInto(PageId pid, int level, const TreeEntry& entry, bool& split, TreeEntry& up);
+
+  // write the metadata page
+  RC writeHeader();
+
+  int magic;          /// the first word of the metadata page
+  int formatVersion;  /// the version of the file format
+  int extraFields;    /// # ints of the subclass in the metadata page
+
+  // the leaf readEntry() read last, so a scan decodes each leaf once
+  PageId leafPid;     /// its PageId, 0 if none
+  Node   leaf;
+};
+
+#endif /* ENTRYTREE_H */
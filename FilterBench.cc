@@ -0,0 +1,99 @@
+/*
+ * Benchmark for the key filters of KeyFilter.
+ * A batch of random keys is filtered over and over by one thread with
+ * every instruction set the processor supports, for key ranges that
+ * pass few and many of the keys, and for a range with NE conditions. The masks of each instruction set are checked against
+ * those of the scalar filter.
+ *
+ * usage: filterbench [keys per batch, default: 1024] [batches]
+ */
+
+#include "KeyFilter.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <sys/time.h>
+
+using namespace std;
+
+static int batchSize = 1024;   // # keys filtered at a time, as in a query plan
+static int batchCount = 200000; // # batches filtered for each result
+
+static const int KEY_RANGE = 100000; // the keys lie in [0, KEY_RANGE)
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// a condition of the benchmark
+struct BenchFilter {
+  const char* name;
+  KeyFilter   filter;
+};
+
+// filter the keys batchCount times; returns the seconds taken
+static double runBench(const KeyFilter& filter, const vector<int>& keys,
+                       vector<uint64_t>& mask, unsigned& passed)
+{
+  unsigned n = keys.size();
+
+  passed = 0;
+  double btime = now();
+  for (int b = 0; b < batchCount; b++) {
+    filter.apply(&keys[0], n, &mask[0]);
+    passed += __builtin_popcountll(mask[b % mask.size()]);
+  }
+  return now() - btime;
+}
+
+int main(int argc, char* argv[])
+{
+  static const KeyFilter::Isa isas[] = { KeyFilter::SCALAR, KeyFilter::AVX2, KeyFilter::AVX512 };
+
+  if (argc > 1) batchSize = atoi(argv[1]);
+  if (argc > 2) batchCount = atoi(argv[2]);
+  if (batchSize <= 0 || batchCount <= 0) {
+    fprintf(stderr, "usage: %s [keys per batch] [batches]\n", argv[0]);
+    return 1;
+  }
+
+  vector<int> keys(batchSize);
+  unsigned int seed = 1;
+  for (int i = 0; i < batchSize; i++) keys[i] = rand_r(&seed) % KEY_RANGE;
+
+  BenchFilter filters[3];
+  filters[0].name = "key > 40000 AND key < 40100 (0.1%)";
+  filters[0].filter.addRange(40001, 40100);
+  filters[1].name = "key >= 25000 AND key < 75000 (50%)";
+  filters[1].filter.addRange(25000, 75000);
+  filters[2].name = "same, AND key <> 3 values";
+  filters[2].filter.addRange(25000, 75000);
+  for (int v = 0; v < 3; v++) filters[2].filter.addNotEqual(keys[v * 7 % batchSize]);
+
+  fprintf(stdout, "%d keys per batch, %d batches\n", batchSize, batchCount);
+
+  for (int f = 0; f < 3; f++) {
+    vector<uint64_t> expected((batchSize + 63) / 64), mask(expected.size());
+
+    KeyFilter::useIsa(KeyFilter::SCALAR);
+    filters[f].filter.apply(&keys[0], batchSize, &expected[0]);
+
+    fprintf(stdout, "%s\n", filters[f].name);
+    for (unsigned i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+      unsigned passed;
+
+      if (!KeyFilter::useIsa(isas[i])) continue;
+
+      double seconds = runBench(filters[f].filter, keys, mask, passed);
+      bool same = (mask == expected);
+      fprintf(stdout, "  %-8s %12.0f keys/sec per core (%.3f seconds)%s\n",
+              KeyFilter::isaName(), (double) batchSize * batchCount / seconds, seconds,
+              same ? "" : ", MASK DIFFERS FROM SCALAR");
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,25 @@
+/*
+ * Hashing of keys for the hash index and the Bloom filter.
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+/**
+ * Spread the bits of a key over 64 bits (the finalizer of MurmurHash3).
+ * Every input bit affects every output bit, so the low bits and the high
+ * bits of the result are both usable as a hash of the key.
+ * @param x[IN] the value to mix
+ * @return the mixed value
+ */
+inline unsigned long long hashMix(unsigned long long x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+#endif // HASH_H
@@ -0,0 +1,357 @@
+/*
+ * Linear hash index on the key column of a table.
+ */
+
+#include "HashIndex.h"
+#include "Hash.h"
+#include <cstring>
+
+using std::string;
+using std::vector;
+
+//Layout of an index file:
+//  page 0: the metadata (HashHeader)
+//  bucket page: [entry count (2 bytes)][unused (2 bytes)][next page of the chain, 0 if none]
+//               followed by the (key, RecordId) entries
+//Bucket b lives at roundStart[round of b] + (b - first bucket of the round).
+//Overflow pages and the pages of later rounds come after it in the file.
+
+static const int HASH_MAGIC = 0x48445831; // "HDX1"
+
+struct HashHeader {
+  int    magic;
+  int    formatVersion;
+  int    pageSize;
+  int    level;
+  int    nextSplit;
+  int    entryCount;
+  PageId freeList;
+  PageId endPid;
+  PageId roundStart[32];
+};
+
+static const int BUCKET_HEADER = 2 * sizeof(short) + sizeof(PageId);
+static const int ENTRY_SIZE = sizeof(int) + sizeof(RecordId);
+static const int BUCKET_CAPACITY = (PageFile::PAGE_SIZE - BUCKET_HEADER) / ENTRY_SIZE;
+
+//Split a bucket once the buckets are this full on average, in percent
+static const int SPLIT_FILL = 75;
+
+static int pageCount(const char* page)
+{
+  unsigned short n;
+  memcpy(&n, page, sizeof(n));
+  return n;
+}
+
+static PageId pageNext(const char* page)
+{
+  PageId next;
+  memcpy(&next, page + 2 * sizeof(short), sizeof(next));
+  return next;
+}
+
+static void setPage(char* page, int count, PageId next)
+{
+  unsigned short n = count;
+  memcpy(page, &n, sizeof(n));
+  memset(page + sizeof(n), 0, sizeof(n));
+  memcpy(page + 2 * sizeof(short), &next, sizeof(next));
+}
+
+HashIndex::HashIndex()
+{
+  writable = false;
+  level = 0;
+  nextSplit = 0;
+  bucketCount = 0;
+  entryCount = 0;
+  freeList = 0;
+  endPid = 0;
+  memset(roundStart, 0, sizeof(roundStart));
+}
+
+RC HashIndex::open(const string& indexname, char mode)
+{
+  char page[PageFile::PAGE_SIZE];
+  RC rc;
+
+  if ((rc = pf.open(indexname, mode)) < 0) return rc;
+
+  writable = (mode == 'w' || mode == 'W');
+  level = 0;
+  nextSplit = 0;
+  bucketCount = 1;
+  entryCount = 0;
+  freeList = 0;
+  memset(roundStart, 0, sizeof(roundStart));
+
+  // a new index starts with its metadata page and an empty bucket 0
+  if (pf.endPid() == 0) {
+    if (!writable) {
+      pf.close();
+      return RC_INVALID_FILE_FORMAT;
+    }
+    roundStart[0] = 1;
+    endPid = 2;
+    setPage(page, 0, 0);
+    if ((rc = pf.write(1, page)) < 0 || (rc = writeHeader()) < 0) pf.close();
+    return rc;
+  }
+
+  if ((rc = pf.read(0, page)) < 0) {
+    pf.close();
+    return rc;
+  }
+
+  HashHeader header;
+  memcpy(&header, page, sizeof(header));
+
+  if (header.magic != HASH_MAGIC || header.formatVersion != FORMAT_VERSION ||
+      header.pageSize != PageFile::PAGE_SIZE || header.level < 0 ||
+      header.level >= MAX_ROUNDS - 1 || header.nextSplit < 0 ||
+      header.nextSplit >= (1 << header.level)) {
+    pf.close();
+    return RC_INVALID_FILE_FORMAT;
+  }
+
+  level = header.level;
+  nextSplit = header.nextSplit;
+  bucketCount = (1 << level) + nextSplit;
+  entryCount = header.entryCount;
+  freeList = header.freeList;
+  endPid = header.endPid;
+  memcpy(roundStart, header.roundStart, sizeof(roundStart));
+
+  return 0;
+}
+
+RC HashIndex::close()
+{
+  RC rc = 0;
+
+  if (writable) rc = writeHeader();
+
+  RC closeRc = pf.close();
+  return rc < 0 ? rc : closeRc;
+}
+
+RC HashIndex::writeHeader()
+{
+  char page[PageFile::PAGE_SIZE];
+  HashHeader header;
+
+  header.magic = HASH_MAGIC;
+  header.formatVersion = FORMAT_VERSION;
+  header.pageSize = PageFile::PAGE_SIZE;
+  header.level = level;
+  header.nextSplit = nextSplit;
+  header.entryCount = entryCount;
+  header.freeList = freeList;
+  header.endPid = endPid;
+  memcpy(header.roundStart, roundStart, sizeof(roundStart));
+
+  memset(page, 0, PageFile::PAGE_SIZE);
+  memcpy(page, &header, sizeof(header));
+  return pf.write(0, page);
+}
+
+PageId HashIndex::bucketPid(int b)
+{
+  // bucket 0 is round 0; bucket b > 0 is in the round of its highest bit
+  int round = 0;
+  while ((b >> round) != 0) round++;
+
+  return roundStart[round] + b - (round > 0 ? 1 << (round - 1) : 0);
+}
+
+int HashIndex::bucketOf(int key)
+{
+  unsigned long long h = hashMix((unsigned) key);
+
+  // buckets before nextSplit have been split in this round already
+  int b = h & ((1ULL << level) - 1);
+  if (b < nextSplit) b = h & ((2ULL << level) - 1);
+
+  return b;
+}
+
+PageId HashIndex::allocatePid()
+{
+  char page[PageFile::PAGE_SIZE];
+
+  if (freeList > 0 && pf.read(freeList, page) == 0) {
+    PageId pid = freeList;
+    freeList = pageNext(page);
+    return pid;
+  }
+
+  return endPid++;
+}
+
+RC HashIndex::writeChain(const vector<PageId>& pages, const vector<Entry>& entries,
+                         int begin, int end)
+{
+  char page[PageFile::PAGE_SIZE];
+  RC rc;
+
+  // an empty bucket still keeps its first page
+  unsigned used = 0;
+  PageId pid = pages[used++];
+
+  do {
+    int n = end - begin;
+    if (n > BUCKET_CAPACITY) n = BUCKET_CAPACITY;
+
+    PageId next = 0;
+    if (begin + n < end) next = (used < pages.size()) ? pages[used++] : allocatePid();
+
+    setPage(page, n, next);
+    for (int i = 0; i < n; i++) {
+      char* p = page + BUCKET_HEADER + i * ENTRY_SIZE;
+      memcpy(p, &entries[begin + i].key, sizeof(int));
+      memcpy(p + sizeof(int), &entries[begin + i].rid, sizeof(RecordId));
+    }
+    if ((rc = pf.write(pid, page)) < 0) return rc;
+
+    begin += n;
+    pid = next;
+  } while (pid != 0);
+
+  // pages the chain no longer needs go on the free list
+  for (; used < pages.size(); used++) {
+    setPage(page, 0, freeList);
+    if ((rc = pf.write(pages[used], page)) < 0) return rc;
+    freeList = pages[used];
+  }
+
+  return 0;
+}
+
+RC HashIndex::insert(int key, const RecordId& rid)
+{
+  char page[PageFile::PAGE_SIZE];
+  RC rc;
+
+  if (!writable) return RC_INVALID_FILE_MODE;
+
+  // walk to the last page of the bucket's chain
+  PageId pid = bucketPid(bucketOf(key));
+  if ((rc = pf.read(pid, page)) < 0) return rc;
+
+  while (pageNext(page) != 0) {
+    pid = pageNext(page);
+    if ((rc = pf.read(pid, page)) < 0) return rc;
+  }
+
+  int n = pageCount(page);
+
+  // start an overflow page when the last one is full
+  if (n == BUCKET_CAPACITY) {
+    PageId next = allocatePid();
+    setPage(page, n, next);
+    if ((rc = pf.write(pid, page)) < 0) return rc;
+    pid = next;
+    n = 0;
+  }
+
+  char* p = page + BUCKET_HEADER + n * ENTRY_SIZE;
+  memcpy(p, &key, sizeof(int));
+  memcpy(p + sizeof(int), &rid, sizeof(RecordId));
+  setPage(page, n + 1, n == 0 ? 0 : pageNext(page));
+  if ((rc = pf.write(pid, page)) < 0) return rc;
+
+  entryCount++;
+
+  if ((long long) entryCount * 100 > (long long) bucketCount * BUCKET_CAPACITY * SPLIT_FILL)
+    return split();
+
+  return 0;
+}
+
+RC HashIndex::split()
+{
+  char page[PageFile::PAGE_SIZE];
+  RC rc;
+
+  if (level >= MAX_ROUNDS - 2) return 0;
+
+  // the first bucket of a round reserves the pages of the whole round
+  int newBucket = bucketCount;
+  if ((newBucket & (newBucket - 1)) == 0) {
+    roundStart[level + 1] = endPid;
+    endPid += newBucket;
+  }
+
+  // read the whole chain of the bucket being split
+  vector<PageId> pages;
+  vector<Entry> entries;
+  PageId pid = bucketPid(nextSplit);
+
+  while (pid != 0) {
+    if ((rc = pf.read(pid, page)) < 0) return rc;
+    pages.push_back(pid);
+
+    int n = pageCount(page);
+    for (int i = 0; i < n; i++) {
+      const char* p = page + BUCKET_HEADER + i * ENTRY_SIZE;
+      Entry e;
+      memcpy(&e.key, p, sizeof(int));
+      memcpy(&e.rid, p + sizeof(int), sizeof(RecordId));
+      entries.push_back(e);
+    }
+    pid = pageNext(page);
+  }
+
+  // keep the entries that stay first, in their order, then the ones that move
+  vector<Entry> moved;
+  int kept = 0;
+  for (unsigned i = 0; i < entries.size(); i++) {
+    if ((hashMix((unsigned) entries[i].key) >> level) & 1)
+      moved.push_back(entries[i]);
+    else
+      entries[kept++] = entries[i];
+  }
+  entries.resize(kept);
+
+  if ((rc = writeChain(pages, entries, 0, kept)) < 0) return rc;
+
+  vector<PageId> newPages(1, bucketPid(newBucket));
+  if ((rc = writeChain(newPages, moved, 0, moved.size())) < 0) return rc;
+
+  bucketCount++;
+  if (++nextSplit == (1 << level)) {
+    level++;
+    nextSplit = 0;
+  }
+
+  return 0;
+}
+
+RC HashIndex::lookup(int key, vector<RecordId>& rids)
+{
+  char page[PageFile::PAGE_SIZE];
+  RC rc;
+
+  rids.clear();
+
+  PageId pid = bucketPid(bucketOf(key));
+  while (pid != 0) {
+    if ((rc = pf.read(pid, page)) < 0) return rc;
+
+    int n = pageCount(page);
+    for (int i = 0; i < n; i++) {
+      const char* p = page + BUCKET_HEADER + i * ENTRY_SIZE;
+      int k;
+      memcpy(&k, p, sizeof(int));
+      if (k == key) {
+        RecordId rid;
+        memcpy(&rid, p + sizeof(int), sizeof(RecordId));
+        rids.push_back(rid);
+      }
+    }
+    pid = pageNext(page);
+  }
+
+  return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * Linear hash index on the key column of a table.
+ */
+
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+#include <string>
+#include <vector>
+
+/**
+ * Implements a linear hash index for bruinbase.
+ *
+ * Every bucket is one page, plus a chain of overflow pages if its entries
+ * do not fit. Buckets are split one at a time, in order, whenever the
+ * index gets too full, so the number of buckets grows with the entries.
+ * A bucket's page is found from the key without reading any other page
+ * besides the metadata page, so a lookup reads about one page.
+ *
+ * The index answers key = X only; it keeps no key order. It is not
+ * safe to use an open index from several threads at the same time.
+ */
+class HashIndex {
+ public:
+  HashIndex();
+
+  /**
+   * Open the index file in read or write mode.
+   * Under 'w' mode, the index file is created if it does not exist.
+   * @param indexname[IN] the name of the index file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& indexname, char mode);
+
+  /**
+   * Close the index file.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * Insert (key, RecordId) pair to the index.
+   * @param key[IN] the key for the value inserted into the index
+   * @param rid[IN] the RecordId for the record being inserted into the index
+   * @return error code. 0 if no error
+   */
+  RC insert(int key, const RecordId& rid);
+
+  /**
+   * Find all RecordIds with the key, in the order they were inserted.
+   * @param key[IN] the key to look up
+   * @param rids[OUT] the RecordIds of the key; empty if there are none
+   * @return error code. 0 if no error
+   */
+  RC lookup(int key, std::vector<RecordId>& rids);
+
+  /**
+   * @return the number of (key, rid) pairs in the index
+   */
+  int getEntryCount() { return entryCount; }
+
+  /**
+   * @return the number of buckets
+   */
+  int getBucketCount() { return bucketCount; }
+
+  // the format of the index file; a file with another version is not opened
+  static const int FORMAT_VERSION = 1;
+
+ private:
+  // the page of bucket b
+  PageId bucketPid(int b);
+
+  // the bucket a key belongs in
+  int bucketOf(int key);
+
+  // split the next bucket in line into itself and a new bucket
+  RC split();
+
+  // a page for an overflow chain: a freed one, or a new one at the end
+  PageId allocatePid();
+
+  // write entries [begin, end) as the chain of a bucket, reusing its pages
+  struct Entry {
+    int      key;
+    RecordId rid;
+  };
+  RC writeChain(const std::vector<PageId>& pages, const std::vector<Entry>& entries,
+                int begin, int end);
+
+  // write the metadata page
+  RC writeHeader();
+
+  PageFile pf;        /// the PageFile used to store the index
+  bool   writable;    /// true if opened in 'w' mode
+  int    level;       /// buckets 0 to 2^level - 1 existed when the round started
+  int    nextSplit;   /// the next bucket to split in this round
+  int    bucketCount; /// # buckets: 2^level + nextSplit
+  int    entryCount;  /// # (key, rid) pairs
+  PageId freeList;    /// first overflow page given back by a split, 0 if none
+  PageId endPid;      /// the first page not yet given to a bucket or a chain
+
+  // the first page of the buckets added in each round; round s > 0
+  // holds buckets 2^(s-1) to 2^s - 1, round 0 holds bucket 0
+  static const int MAX_ROUNDS = 32;
+  PageId roundStart[MAX_ROUNDS];
+};
+
+#endif /* HASHINDEX_H */
@@ -0,0 +1,278 @@
+/*
+ * Vectorized filtering of keys by the conditions on the key column.
+ */
+
+#include "KeyFilter.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include <immintrin.h>
+
+using std::string;
+using std::vector;
+
+//A kernel sets the bits of mask for the keys in [low, high]; the other
+//bits of the words it writes must be clear
+typedef void (*RangeKernel)(const int* keys, unsigned n, int low, int high, uint64_t* mask);
+
+//A kernel clears the bits of mask for the keys equal to v
+typedef void (*NotEqualKernel)(const int* keys, unsigned n, int v, uint64_t* mask);
+
+//The keys from i on are checked one at a time: all keys of the scalar
+//kernels, the last few of the others
+static void rangeFrom(unsigned i, const int* keys, unsigned n, int low, int high, uint64_t* mask)
+{
+  for (; i < n; i++)
+    mask[i / 64] |= (uint64_t) (keys[i] >= low && keys[i] <= high) << (i % 64);
+}
+
+static void notEqualFrom(unsigned i, const int* keys, unsigned n, int v, uint64_t* mask)
+{
+  for (; i < n; i++)
+    mask[i / 64] &= ~((uint64_t) (keys[i] == v) << (i % 64));
+}
+
+static void rangeScalar(const int* keys, unsigned n, int low, int high, uint64_t* mask)
+{
+  rangeFrom(0, keys, n, low, high, mask);
+}
+
+static void notEqualScalar(const int* keys, unsigned n, int v, uint64_t* mask)
+{
+  notEqualFrom(0, keys, n, v, mask);
+}
+
+//AVX2 compares 8 keys at a time; it has no <= on integers, so a key
+//passes unless low > key or key > high
+__attribute__((target("avx2")))
+static void rangeAvx2(const int* keys, unsigned n, int low, int high, uint64_t* mask)
+{
+  __m256i lo = _mm256_set1_epi32(low);
+  __m256i hi = _mm256_set1_epi32(high);
+  unsigned i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i k = _mm256_loadu_si256((const __m256i*) (keys + i));
+    __m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(lo, k), _mm256_cmpgt_epi32(k, hi));
+    unsigned bits = ~_mm256_movemask_ps(_mm256_castsi256_ps(out)) & 0xff;
+    mask[i / 64] |= (uint64_t) bits << (i % 64);
+  }
+  rangeFrom(i, keys, n, low, high, mask);
+}
+
+__attribute__((target("avx2")))
+static void notEqualAvx2(const int* keys, unsigned n, int v, uint64_t* mask)
+{
+  __m256i value = _mm256_set1_epi32(v);
+  unsigned i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i k = _mm256_loadu_si256((const __m256i*) (keys + i));
+    unsigned bits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(k, value)));
+    mask[i / 64] &= ~((uint64_t) bits << (i % 64));
+  }
+  notEqualFrom(i, keys, n, v, mask);
+}
+
+//AVX-512 compares 16 keys at a time straight into a bit mask
+__attribute__((target("avx512f")))
+static void rangeAvx512(const int* keys, unsigned n, int low, int high, uint64_t* mask)
+{
+  __m512i lo = _mm512_set1_epi32(low);
+  __m512i hi = _mm512_set1_epi32(high);
+  unsigned i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m512i k = _mm512_loadu_si512((const void*) (keys + i));
+    __mmask16 bits = _mm512_cmpge_epi32_mask(k, lo) & _mm512_cmple_epi32_mask(k, hi);
+    mask[i / 64] |= (uint64_t) bits << (i % 64);
+  }
+  rangeFrom(i, keys, n, low, high, mask);
+}
+
+__attribute__((target("avx512f")))
+static void notEqualAvx512(const int* keys, unsigned n, int v, uint64_t* mask)
+{
+  __m512i value = _mm512_set1_epi32(v);
+  unsigned i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m512i k = _mm512_loadu_si512((const void*) (keys + i));
+    __mmask16 bits = _mm512_cmpeq_epi32_mask(k, value);
+    mask[i / 64] &= ~((uint64_t) bits << (i % 64));
+  }
+  notEqualFrom(i, keys, n, v, mask);
+}
+
+//The keys of an IN list describe() prints
+static const int DESCRIBED_KEYS = 8;
+
+//The kernels all filters run with; chosen by the first filter made
+static bool chosen = false;
+static KeyFilter::Isa isa = KeyFilter::SCALAR;
+static RangeKernel rangeKernel = rangeScalar;
+static NotEqualKernel notEqualKernel = notEqualScalar;
+
+static void chooseIsa()
+{
+  if (chosen) return;
+  if (!KeyFilter::useIsa(KeyFilter::AVX512) && !KeyFilter::useIsa(KeyFilter::AVX2))
+    KeyFilter::useIsa(KeyFilter::SCALAR);
+}
+
+KeyFilter::KeyFilter()
+{
+  none = false;
+  low = INT_MIN;
+  high = INT_MAX;
+  hasKeys = false;
+  chooseIsa();
+}
+
+void KeyFilter::addRange(long long lo, long long hi)
+{
+  if (lo >= hi || lo > high || hi <= low) {
+    none = true;
+    return;
+  }
+  low = (int) std::max(lo, (long long) low);
+  high = (int) std::min(hi - 1, (long long) high);
+}
+
+void KeyFilter::addNotEqual(int v)
+{
+  if (std::find(ne.begin(), ne.end(), v) == ne.end()) ne.push_back(v);
+}
+
+void KeyFilter::addKeys(const vector<int>& keys)
+{
+  // a key must be in every list
+  if (!hasKeys)
+    in = keys;
+  else {
+    vector<int> both;
+    std::set_intersection(in.begin(), in.end(), keys.begin(), keys.end(), std::back_inserter(both));
+    in.swap(both);
+  }
+  hasKeys = true;
+
+  if (in.empty())
+    none = true;
+  else
+    addRange(in.front(), (long long) in.back() + 1);
+}
+
+void KeyFilter::apply(const int* keys, unsigned n, uint64_t* mask) const
+{
+  memset(mask, 0, (n + 63) / 64 * sizeof(uint64_t));
+  if (none) return;
+
+  rangeKernel(keys, n, low, high, mask);
+  for (unsigned i = 0; i < ne.size(); i++)
+    if (ne[i] >= low && ne[i] <= high) notEqualKernel(keys, n, ne[i], mask);
+
+  if (!hasKeys) return;
+  for (unsigned w = 0; w < (n + 63) / 64; w++) {
+    for (uint64_t bits = mask[w]; bits != 0; bits &= bits - 1) {
+      unsigned i = w * 64 + __builtin_ctzll(bits);
+      if (!std::binary_search(in.begin(), in.end(), keys[i])) mask[w] &= ~((uint64_t) 1 << (i % 64));
+    }
+  }
+}
+
+string KeyFilter::describe() const
+{
+  char buf[64];
+  string text;
+
+  if (none) return "no key";
+
+  // the IN keys in the range stand for the range; a long list is cut short
+  if (hasKeys) {
+    vector<int>::const_iterator first = std::lower_bound(in.begin(), in.end(), low);
+    vector<int>::const_iterator last = std::upper_bound(first, in.end(), high);
+
+    if (first == last) return "no key";
+    if (last - first == 1) {
+      snprintf(buf, sizeof(buf), "key = %d", *first);
+      text = buf;
+    }
+    else {
+      text = "key IN (";
+      for (vector<int>::const_iterator k = first; k != last && k - first < DESCRIBED_KEYS; k++) {
+        snprintf(buf, sizeof(buf), "%s%d", k != first ? ", " : "", *k);
+        text += buf;
+      }
+      if (last - first > DESCRIBED_KEYS) {
+        snprintf(buf, sizeof(buf), ", ... %d keys in all", (int) (last - first));
+        text += buf;
+      }
+      text += ")";
+    }
+  }
+  else {
+    if (low == high)
+      snprintf(buf, sizeof(buf), "key = %d", low);
+    else if (low > INT_MIN && high < INT_MAX)
+      snprintf(buf, sizeof(buf), "key >= %d AND key <= %d", low, high);
+    else if (low > INT_MIN)
+      snprintf(buf, sizeof(buf), "key >= %d", low);
+    else if (high < INT_MAX)
+      snprintf(buf, sizeof(buf), "key <= %d", high);
+    else
+      buf[0] = '\0';
+    text = buf;
+  }
+
+  for (unsigned i = 0; i < ne.size(); i++) {
+    snprintf(buf, sizeof(buf), "%skey <> %d", text.empty() ? "" : " AND ", ne[i]);
+    text += buf;
+  }
+  return text;
+}
+
+bool KeyFilter::supports(Isa isa)
+{
+  switch (isa) {
+    case AVX512:
+      return __builtin_cpu_supports("avx512f");
+    case AVX2:
+      return __builtin_cpu_supports("avx2");
+    default:
+      return true;
+  }
+}
+
+bool KeyFilter::useIsa(Isa isa)
+{
+  if (!supports(isa)) return false;
+
+  switch (isa) {
+    case AVX512:
+      rangeKernel = rangeAvx512;
+      notEqualKernel = notEqualAvx512;
+      break;
+    case AVX2:
+      rangeKernel = rangeAvx2;
+      notEqualKernel = notEqualAvx2;
+      break;
+    default:
+      rangeKernel = rangeScalar;
+      notEqualKernel = notEqualScalar;
+      break;
+  }
+  ::isa = isa;
+  chosen = true;
+  return true;
+}
+
+const char* KeyFilter::isaName()
+{
+  chooseIsa();
+  switch (isa) {
+    case AVX512: return "AVX-512";
+    case AVX2:   return "AVX2";
+    default:     return "scalar";
+  }
+}
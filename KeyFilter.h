@@ -0,0 +1,90 @@
+/*
+ * Vectorized filtering of keys by the conditions on the key column.
+ */
+
+#ifndef KEYFILTER_H
+#define KEYFILTER_H
+
+#include <stdint.h>
+#include <climits>
+#include <string>
+#include <vector>
+
+/**
+ * The conditions on the key column of a WHERE clause, compiled into a
+ * range [low, high], a list of keys ruled out by NE and the sorted keys
+ * of IN lists. apply() checks an array of keys at a time and sets a bit
+ * for every key that passes. The range and NE checks use AVX-512 or AVX2
+ * instructions if the processor has them, and plain C++ otherwise; a key
+ * in the range is then looked up in the IN keys by binary search.
+ */
+class KeyFilter {
+ public:
+  // the instruction sets a filter can be run with
+  enum Isa { SCALAR, AVX2, AVX512 };
+
+  // a filter that every key passes
+  KeyFilter();
+
+  /**
+   * Keep only the keys in [lo, hi), where the bounds may lie outside of
+   * the int range.
+   */
+  void addRange(long long lo, long long hi);
+
+  /**
+   * Rule out a key (key <> v).
+   */
+  void addNotEqual(int v);
+
+  /**
+   * Keep only the keys of an IN list.
+   * @param keys[IN] the keys, sorted and each once
+   */
+  void addKeys(const std::vector<int>& keys);
+
+  /**
+   * @return true if every key passes
+   */
+  bool passesAll() const { return !none && low == INT_MIN && high == INT_MAX && ne.empty() && !hasKeys; }
+
+  /**
+   * @return the conditions, or "" if every key passes
+   */
+  std::string describe() const;
+
+  /**
+   * Check n keys.
+   * @param keys[IN] the keys, one after another
+   * @param n[IN] the number of keys
+   * @param mask[OUT] (n + 63) / 64 words; bit i % 64 of word i / 64 is set
+   *        if keys[i] passes, the bits behind the last key are clear
+   */
+  void apply(const int* keys, unsigned n, uint64_t* mask) const;
+
+  /**
+   * @return true if the processor runs the filter with isa
+   */
+  static bool supports(Isa isa);
+
+  /**
+   * Run all filters with isa from now on, instead of the best one the
+   * processor supports.
+   * @return false if the processor does not support isa
+   */
+  static bool useIsa(Isa isa);
+
+  /**
+   * @return the name of the instruction set the filters run with
+   */
+  static const char* isaName();
+
+ private:
+  bool none;            /// true if no key passes
+  int  low, high;       /// the range of keys that pass
+  std::vector<int> ne;  /// the keys that do not pass
+  bool hasKeys;         /// true if only the keys in in pass
+  std::vector<int> in;  /// the keys of the IN lists, sorted
+};
+
+#endif /* KEYFILTER_H */
@@ -0,0 +1,720 @@
+/*
+ * Operators that a SELECT statement is executed with.
+ */
+
+#include "Operator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+using std::string;
+using std::vector;
+
+void Operator::limitBatch(unsigned n)
+{
+  batchLimit = std::max(n, 1u);
+  if (input) input->limitBatch(n);
+}
+
+RC Operator::run(Operator* op)
+{
+  vector<Tuple> batch;
+  RC rc;
+
+  do {
+    if ((rc = op->next(batch)) < 0) return rc;
+  } while (!batch.empty());
+
+  return 0;
+}
+
+void Operator::explain(const Operator* op, FILE* out)
+{
+  for (int depth = 0; op; op = op->input, depth++)
+    fprintf(out, "%*s%s\n", 2 * depth, "", op->describe().c_str());
+}
+
+//The key range [lo, hi) as conditions
+static string rangeText(long long lo, long long hi)
+{
+  char buf[64];
+
+  if (lo >= hi)
+    return "no key";
+  if (hi == lo + 1)
+    snprintf(buf, sizeof(buf), "key = %lld", lo);
+  else if (lo > INT_MIN && hi <= INT_MAX)
+    snprintf(buf, sizeof(buf), "key >= %lld AND key < %lld", lo, hi);
+  else if (lo > INT_MIN)
+    snprintf(buf, sizeof(buf), "key >= %lld", lo);
+  else if (hi <= INT_MAX)
+    snprintf(buf, sizeof(buf), "key < %lld", hi);
+  else
+    return "all keys";
+  return buf;
+}
+
+//Key ranges as conditions
+static string rangesText(const KeyRanges& ranges)
+{
+  string text;
+
+  if (ranges.empty()) return "no key";
+  for (unsigned i = 0; i < ranges.size(); i++) {
+    if (i > 0) text += " OR ";
+    text += rangeText(ranges[i].first, ranges[i].second);
+  }
+  return text;
+}
+
+//The first key of a scan from lo, and whether any key is as large as lo
+static bool startKey(long long lo, int& key)
+{
+  if (lo > INT_MAX) return false;
+  key = (int) std::max(lo, (long long) INT_MIN);
+  return true;
+}
+
+TableScan::TableScan(const RecordFile& rf, long long lo, long long hi, bool clustered,
+                     const vector<int>& zoneMin, const vector<int>& zoneMax)
+  : rf(rf), lo(lo), hi(hi), clustered(clustered), zoneMin(zoneMin), zoneMax(zoneMax)
+{
+  started = false;
+  done = (lo >= hi);
+  rid.pid = rid.sid = 0;
+}
+
+RC TableScan::findKeyPage(PageId& pid)
+{
+  PageId low = 0, high = rf.endRid().pid;
+  RecordId first;
+  int key;
+  string value;
+  RC rc;
+
+  if (rf.endRid().sid == 0) high--;
+
+  // the first key of page low is smaller than lo, or low is page 0
+  while (low < high) {
+    first.pid = low + (high - low + 1) / 2;
+    first.sid = 0;
+    if ((rc = rf.read(first, key, value)) < 0) return rc;
+
+    if (key < lo)
+      low = first.pid;
+    else
+      high = first.pid - 1;
+  }
+
+  pid = std::max(low, 0);
+  return 0;
+}
+
+RC TableScan::next(vector<Tuple>& batch)
+{
+  Tuple t;
+  RC rc;
+
+  batch.clear();
+
+  // a table in key order holds the key range on consecutive pages
+  if (!started) {
+    started = true;
+    if (!done && clustered && lo > INT_MIN && (rc = findKeyPage(rid.pid)) < 0) {
+      done = true;
+      return rc;
+    }
+  }
+
+  t.hasKey = t.hasValue = true;
+
+  // a batch holds the rest of a page at most, so that a plan that stops
+  // early reads no page it does not need
+  while (!done && batch.empty()) {
+    if (!(rid < rf.endRid())) {
+      done = true;
+      break;
+    }
+
+    // skip a zone whose keys all lie outside of the range
+    if (!zoneMin.empty() && rid.sid == 0 && rid.pid % ZONE_PAGES == 0) {
+      unsigned zone = rid.pid / ZONE_PAGES;
+      if (zone < zoneMin.size() && (zoneMax[zone] < lo || zoneMin[zone] >= hi)) {
+        rid.pid += ZONE_PAGES;
+        continue;
+      }
+    }
+
+    PageId pid = rid.pid;
+    while (rid < rf.endRid() && rid.pid == pid && batch.size() < batchLimit) {
+      if ((rc = rf.read(rid, t.key, t.value)) < 0) {
+        done = true;
+        return rc;
+      }
+      t.rid = rid;
+      ++rid;
+
+      if (t.key >= lo && t.key < hi)
+        batch.push_back(t);
+      else if (clustered && t.key >= hi) {
+        done = true;
+        break;
+      }
+    }
+  }
+
+  return 0;
+}
+
+string TableScan::describe() const
+{
+  string text = "TableScan (" + rangeText(lo, hi);
+  if (clustered) text += ", in key order";
+  if (!zoneMin.empty()) text += ", skipping zones by the zone map";
+  return text + ")";
+}
+
+IndexScan::IndexScan(BTreeIndex& tree, const KeyRanges& ranges)
+  : tree(tree), ranges(ranges)
+{
+  range = 0;
+  started = false;
+  done = ranges.empty();
+}
+
+RC IndexScan::next(vector<Tuple>& batch)
+{
+  Tuple t;
+  int key;
+
+  batch.clear();
+
+  if (!started) {
+    started = true;
+    if (!done && (!startKey(ranges[0].first, key) || tree.locate(key, cursor) != 0)) done = true;
+  }
+
+  // the scan ends where readForward() fails
+  t.hasKey = true;
+  t.hasValue = false;
+  while (!done && batch.size() < batchLimit) {
+    if (tree.readForward(cursor, t.key, t.rid) != 0) {
+      done = true;
+      break;
+    }
+
+    // past the end of a range, the scan goes on in the range of the key,
+    // or jumps to the next range if the key lies before it
+    if (t.key >= ranges[range].second) {
+      while (range < ranges.size() && t.key >= ranges[range].second) range++;
+      if (range == ranges.size()) {
+        done = true;
+        break;
+      }
+      if (t.key < ranges[range].first) {
+        if (!startKey(ranges[range].first, key) || tree.seek(key, cursor) != 0) done = true;
+        continue;
+      }
+    }
+    batch.push_back(t);
+  }
+
+  return 0;
+}
+
+string IndexScan::describe() const
+{
+  return "IndexScan (B+tree, " + rangesText(ranges) + ")";
+}
+
+HashScan::HashScan(HashIndex& hash, int key)
+  : hash(hash), key(key)
+{
+  started = false;
+  pos = 0;
+}
+
+RC HashScan::next(vector<Tuple>& batch)
+{
+  Tuple t;
+  RC rc;
+
+  batch.clear();
+
+  // one bucket page holds all RecordIds of the key
+  if (!started) {
+    started = true;
+    if ((rc = hash.lookup(key, rids)) < 0) {
+      rids.clear();
+      return rc;
+    }
+  }
+
+  t.key = key;
+  t.hasKey = true;
+  t.hasValue = false;
+  for (; pos < rids.size() && batch.size() < batchLimit; pos++) {
+    t.rid = rids[pos];
+    batch.push_back(t);
+  }
+
+  return 0;
+}
+
+string HashScan::describe() const
+{
+  return "HashScan (" + rangeText(key, (long long) key + 1) + ")";
+}
+
+ValueScan::ValueScan(ValueIndex& vindex, const string& low, const string& high, bool hasHigh)
+  : vindex(vindex), low(low), high(high), hasHigh(hasHigh)
+{
+  started = false;
+  done = (hasHigh && low >= high);
+}
+
+RC ValueScan::next(vector<Tuple>& batch)
+{
+  Tuple t;
+  RC rc;
+
+  batch.clear();
+
+  if (!started) {
+    started = true;
+    if (!done && (rc = vindex.locate(low, cursor)) < 0) {
+      done = true;
+      return rc;
+    }
+  }
+
+  t.key = 0;
+  t.hasKey = false;
+  t.hasValue = true;
+  while (!done && batch.size() < batchLimit) {
+    if ((rc = vindex.readForward(cursor, t.value, t.rid)) < 0) {
+      done = true;
+      if (rc != RC_END_OF_TREE) return rc;
+      break;
+    }
+    if (hasHigh && t.value >= high) {
+      done = true;
+      break;
+    }
+    batch.push_back(t);
+  }
+
+  return 0;
+}
+
+string ValueScan::describe() const
+{
+  string text = "ValueScan (value >= '" + low + "'";
+  if (hasHigh) text += " AND value < '" + high + "'";
+  return text + ")";
+}
+
+CoverScan::CoverScan(CoveringIndex& cover, const KeyRanges& ranges)
+  : cover(cover), ranges(ranges)
+{
+  range = 0;
+  started = false;
+  done = ranges.empty();
+}
+
+RC CoverScan::next(vector<Tuple>& batch)
+{
+  Tuple t;
+  bool truncated;
+  int key;
+  RC rc;
+
+  batch.clear();
+
+  if (!started) {
+    started = true;
+    if (!done && !startKey(ranges[0].first, key)) done = true;
+    if (!done && (rc = cover.locate(key, cursor)) < 0) {
+      done = true;
+      return rc;
+    }
+  }
+
+  t.hasKey = true;
+  while (!done && batch.size() < batchLimit) {
+    if ((rc = cover.readForward(cursor, t.key, t.rid, t.value, truncated)) < 0) {
+      done = true;
+      if (rc != RC_END_OF_TREE) return rc;
+      break;
+    }
+
+    // past the end of a range, the scan goes on in the range of the key,
+    // or jumps to the next range if the key lies before it
+    if (t.key >= ranges[range].second) {
+      while (range < ranges.size() && t.key >= ranges[range].second) range++;
+      if (range == ranges.size()) {
+        done = true;
+        break;
+      }
+      if (t.key < ranges[range].first) {
+        if (!startKey(ranges[range].first, key)) done = true;
+        else if ((rc = cover.locate(key, cursor)) < 0) {
+          done = true;
+          return rc;
+        }
+        continue;
+      }
+    }
+    t.hasValue = !truncated;
+    batch.push_back(t);
+  }
+
+  return 0;
+}
+
+string CoverScan::describe() const
+{
+  return "CoverScan (covering index, " + rangesText(ranges) + ")";
+}
+
+int Fetch::prefetchDepth = SqlEngine::DEFAULT_PREFETCH_DEPTH;
+
+Fetch::Fetch(Operator* input, const RecordFile& rf, bool needValue)
+  : Operator(input), rf(rf), needValue(needValue)
+{
+}
+
+static bool ridLess(const Tuple* t1, const Tuple* t2)
+{
+  return t1->rid < t2->rid;
+}
+
+RC Fetch::next(vector<Tuple>& batch)
+{
+  vector<Tuple*> order;
+  RC rc;
+
+  if ((rc = input->next(batch)) < 0) return rc;
+
+  for (unsigned i = 0; i < batch.size(); i++)
+    if (!batch[i].hasKey || (needValue && !batch[i].hasValue)) order.push_back(&batch[i]);
+  sort(order.begin(), order.end(), ridLess);
+
+  // the pages to read, each once and in order
+  vector<PageId> pages;
+  for (unsigned i = 0; i < order.size(); i++)
+    if (pages.empty() || pages.back() != order[i]->rid.pid) pages.push_back(order[i]->rid.pid);
+
+  // while a page is read, the next prefetchDepth pages are being read in the background
+  unsigned page = 0, prefetched = 0;
+  for (unsigned i = 0; i < order.size(); i++) {
+    Tuple& t = *order[i];
+
+    if (i > 0 && t.rid.pid != order[i - 1]->rid.pid) page++;
+    for (; prefetched < pages.size() && prefetched <= page + prefetchDepth; prefetched++)
+      if (prefetched > page) rf.prefetch(pages[prefetched]);
+
+    if ((rc = rf.read(t.rid, t.key, t.value)) < 0) return rc;
+    t.hasKey = t.hasValue = true;
+  }
+
+  return 0;
+}
+
+string Fetch::describe() const
+{
+  char buf[96];
+  snprintf(buf, sizeof(buf), "Fetch (%s of the table in RecordId order, prefetching %d pages)",
+           needValue ? "tuples" : "keys", prefetchDepth);
+  return buf;
+}
+
+// whether a comparison of a with b meets the comparator C; C is known
+// when the template is compiled, so the switch disappears
+template <SelCond::Comparator C, class T>
+static inline bool compare(const T& a, const T& b)
+{
+  switch (C) {
+    case SelCond::EQ: return a == b;
+    case SelCond::NE: return a != b;
+    case SelCond::LT: return a < b;
+    case SelCond::GT: return a > b;
+    case SelCond::LE: return a <= b;
+    case SelCond::GE: return a >= b;
+  }
+  return false;
+}
+
+template <SelCond::Comparator C>
+void Predicate::checkValue(const Term& term, const vector<Tuple>& batch, vector<unsigned>& sel)
+{
+  unsigned n = 0;
+
+  for (unsigned i = 0; i < sel.size(); i++)
+    if (compare<C>(strcmp(batch[sel[i]].value.c_str(), term.value.c_str()), 0)) sel[n++] = sel[i];
+  sel.resize(n);
+}
+
+Predicate::Predicate(const vector<SelCond>& cond)
+{
+  // the checks by comparator, in the order of SelCond::Comparator
+  static const Check valueChecks[] = {
+    checkValue<SelCond::EQ>, checkValue<SelCond::NE>, checkValue<SelCond::LT>,
+    checkValue<SelCond::GT>, checkValue<SelCond::LE>, checkValue<SelCond::GE>
+  };
+
+  for (unsigned i = 0; i < cond.size(); i++) {
+    Term term;
+
+    if (cond[i].attr == 1 && cond[i].comp == SelCond::IN)
+      keyFilter.addKeys(cond[i].keys);
+    else if (cond[i].attr == 1) {
+      long long v = atoi(cond[i].value);
+
+      switch (cond[i].comp) {
+        case SelCond::EQ: keyFilter.addRange(v, v + 1); break;
+        case SelCond::NE: keyFilter.addNotEqual((int) v); break;
+        case SelCond::LT: keyFilter.addRange(INT_MIN, v); break;
+        case SelCond::GT: keyFilter.addRange(v + 1, (long long) INT_MAX + 1); break;
+        case SelCond::LE: keyFilter.addRange(INT_MIN, v + 1); break;
+        case SelCond::GE: keyFilter.addRange(v, (long long) INT_MAX + 1); break;
+        default: break;
+      }
+    }
+    else if (cond[i].attr == 2) {
+      // an equality leaves the fewest tuples and NE the most
+      term.rank = (cond[i].comp == SelCond::EQ) ? 0 : (cond[i].comp == SelCond::NE) ? 2 : 1;
+      term.value = cond[i].value;
+      term.comp = cond[i].comp;
+      term.check = valueChecks[cond[i].comp];
+      terms.push_back(term);
+    }
+  }
+
+  stable_sort(terms.begin(), terms.end(), rankLess);
+}
+
+bool Predicate::rankLess(const Term& t1, const Term& t2)
+{
+  return t1.rank < t2.rank;
+}
+
+void Predicate::select(const vector<Tuple>& batch, vector<unsigned>& sel)
+{
+  // the keys are checked first, as integers and many at a time
+  if (!keyFilter.passesAll() && !sel.empty()) {
+    unsigned n = sel.size();
+
+    keys.resize(n);
+    mask.resize((n + 63) / 64);
+    for (unsigned i = 0; i < n; i++) keys[i] = batch[sel[i]].key;
+    keyFilter.apply(&keys[0], n, &mask[0]);
+
+    // keep the selected tuples whose bit is set
+    unsigned kept = 0;
+    for (unsigned w = 0; w < mask.size(); w++) {
+      for (uint64_t bits = mask[w]; bits != 0; bits &= bits - 1)
+        sel[kept++] = sel[w * 64 + __builtin_ctzll(bits)];
+    }
+    sel.resize(kept);
+  }
+
+  for (unsigned i = 0; i < terms.size() && !sel.empty(); i++)
+    terms[i].check(terms[i], batch, sel);
+}
+
+string Predicate::describe() const
+{
+  static const char* comparators[] = { "=", "<>", "<", ">", "<=", ">=" };
+  string text = keyFilter.describe();
+
+  for (unsigned i = 0; i < terms.size(); i++) {
+    if (!text.empty()) text += " AND ";
+    text += string("value ") + comparators[terms[i].comp] + " '" + terms[i].value + "'";
+  }
+  return text;
+}
+
+Filter::Filter(Operator* input, const SelDnf& cond)
+  : Operator(input)
+{
+  for (unsigned i = 0; i < cond.size(); i++)
+    predicates.push_back(Predicate(cond[i]));
+}
+
+RC Filter::next(vector<Tuple>& batch)
+{
+  RC rc;
+
+  // a batch without a match is not passed on, as an empty one ends the plan
+  for (;;) {
+    if ((rc = input->next(batch)) < 0) return rc;
+    if (batch.empty()) return 0;
+
+    sel.resize(batch.size());
+    for (unsigned i = 0; i < sel.size(); i++) sel[i] = i;
+
+    // every list of conditions checks the tuples no list before it passed
+    if (predicates.size() == 1)
+      predicates[0].select(batch, sel);
+    else {
+      rest.swap(sel);
+      sel.clear();
+      for (unsigned i = 0; i < predicates.size() && !rest.empty(); i++) {
+        part = rest;
+        predicates[i].select(batch, part);
+        if (part.empty()) continue;
+
+        unsigned mid = sel.size();
+        sel.insert(sel.end(), part.begin(), part.end());
+        inplace_merge(sel.begin(), sel.begin() + mid, sel.end());
+
+        unsigned kept = 0;
+        for (unsigned j = 0, k = 0; j < rest.size(); j++) {
+          if (k < part.size() && part[k] == rest[j]) k++;
+          else rest[kept++] = rest[j];
+        }
+        rest.resize(kept);
+      }
+    }
+
+    for (unsigned i = 0; i < sel.size(); i++)
+      if (sel[i] != i) batch[i] = batch[sel[i]];
+    batch.resize(sel.size());
+    if (!batch.empty()) return 0;
+  }
+}
+
+string Filter::describe() const
+{
+  if (predicates.size() == 1)
+    return "Filter (" + predicates[0].describe() + ")";
+
+  string text;
+  for (unsigned i = 0; i < predicates.size(); i++) {
+    if (i > 0) text += " OR ";
+    text += "(" + predicates[i].describe() + ")";
+  }
+  return "Filter (" + text + ")";
+}
+
+Limit::Limit(Operator* input, int n)
+  : Operator(input), n(n), left(n)
+{
+  limitBatch(n);
+}
+
+RC Limit::next(vector<Tuple>& batch)
+{
+  RC rc;
+
+  batch.clear();
+  if (left <= 0) return 0;
+
+  if ((rc = input->next(batch)) < 0) return rc;
+
+  if ((int) batch.size() > left) batch.resize(left);
+  left -= batch.size();
+  return 0;
+}
+
+string Limit::describe() const
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "Limit (%d)", n);
+  return buf;
+}
+
+Project::Project(Operator* input, int attr)
+  : Operator(input), attr(attr)
+{
+}
+
+RC Project::next(vector<Tuple>& batch)
+{
+  RC rc;
+
+  if ((rc = input->next(batch)) < 0) return rc;
+
+  // only SELECT value and SELECT * show the value
+  if (attr != 2 && attr != 3) {
+    for (unsigned i = 0; i < batch.size(); i++) {
+      batch[i].value.clear();
+      batch[i].hasValue = false;
+    }
+  }
+  return 0;
+}
+
+string Project::describe() const
+{
+  return (attr == 2 || attr == 3) ? "Project (key, value)" : "Project (key)";
+}
+
+Output::Output(Operator* input, int attr)
+  : Operator(input), attr(attr)
+{
+}
+
+RC Output::next(vector<Tuple>& batch)
+{
+  RC rc;
+
+  if ((rc = input->next(batch)) < 0) return rc;
+
+  for (unsigned i = 0; i < batch.size(); i++) {
+    switch (attr) {
+      case 1:  // SELECT key
+        fprintf(stdout, "%d\n", batch[i].key);
+        break;
+      case 2:  // SELECT value
+        fprintf(stdout, "%s\n", batch[i].value.c_str());
+        break;
+      case 3:  // SELECT *
+        fprintf(stdout, "%d '%s'\n", batch[i].key, batch[i].value.c_str());
+        break;
+    }
+  }
+  return 0;
+}
+
+string Output::describe() const
+{
+  static const char* columns[] = { "", "key", "value", "*" };
+  return string("Output (SELECT ") + columns[attr] + ")";
+}
+
+Count::Count(Operator* input)
+  : Operator(input)
+{
+  count = 0;
+  minKey = maxKey = 0;
+}
+
+RC Count::next(vector<Tuple>& batch)
+{
+  RC rc;
+
+  if ((rc = input->next(batch)) < 0) return rc;
+
+  for (unsigned i = 0; i < batch.size(); i++) {
+    if (count == 0 || batch[i].key < minKey) minKey = batch[i].key;
+    if (count == 0 || batch[i].key > maxKey) maxKey = batch[i].key;
+    count++;
+  }
+  return 0;
+}
+
+string Count::describe() const
+{
+  return "Count (count(*), min(key), max(key))";
+}
+
+bool Count::getMinMax(int& minKey, int& maxKey)
+{
+  minKey = this->minKey;
+  maxKey = this->maxKey;
+  return count > 0;
+}
@@ -0,0 +1,394 @@
+/*
+ * Operators that a SELECT statement is executed with.
+ */
+
+#ifndef OPERATOR_H
+#define OPERATOR_H
+
+#include "Bruinbase.h"
+#include "SqlEngine.h"
+#include "RecordFile.h"
+#include "BTreeIndex.h"
+#include "HashIndex.h"
+#include "ValueIndex.h"
+#include "CoveringIndex.h"
+#include "KeyFilter.h"
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * A tuple passed between operators. An index may not know the whole
+ * record: hasKey and hasValue tell whether key and value are those of
+ * the record at rid.
+ */
+struct Tuple {
+  int         key;
+  std::string value;
+  RecordId    rid;
+  bool        hasKey;
+  bool        hasValue;
+};
+
+/**
+ * Key ranges [first, second), disjoint and in ascending order.
+ */
+typedef std::vector<std::pair<long long, long long> > KeyRanges;
+
+/**
+ * An operator of a query plan. Every call of next() hands over the next
+ * batch of tuples, and pulls as many batches from the operator's input
+ * as that takes, so a plan is run by calling next() on its last operator
+ * until the batch comes back empty.
+ *
+ * An operator owns its input and deletes it. The files and indexes the
+ * scans read are opened and closed by whoever builds the plan.
+ */
+class Operator {
+ public:
+  // the most tuples in a batch
+  static const unsigned BATCH_SIZE = 1024;
+
+  Operator(Operator* input = 0) : input(input), batchLimit(BATCH_SIZE) {}
+  virtual ~Operator() { delete input; }
+
+  /**
+   * Produce the next batch of tuples.
+   * @param batch[OUT] the tuples; empty once there are no more
+   * @return error code. 0 if no error
+   */
+  virtual RC next(std::vector<Tuple>& batch) = 0;
+
+  /**
+   * Tell the operator that no more than n tuples of a batch will be used,
+   * so that a scan does not read further ahead than that. It is passed on
+   * to the input.
+   * @param n[IN] the most tuples to produce in a batch
+   */
+  virtual void limitBatch(unsigned n);
+
+  /**
+   * @return what the operator does, in one line
+   */
+  virtual std::string describe() const = 0;
+
+  /**
+   * Print a plan: every operator on a line, above its input.
+   * @param op[IN] the last operator of the plan
+   * @param out[IN] the stream to print to
+   */
+  static void explain(const Operator* op, FILE* out);
+
+  /**
+   * Run a plan: pull batches from op until it has no more.
+   * @param op[IN] the last operator of the plan
+   * @return error code. 0 if no error
+   */
+  static RC run(Operator* op);
+
+ protected:
+  Operator* input;       /// the operator the tuples come from, 0 for a scan
+  unsigned  batchLimit;  /// the most tuples a scan puts into a batch
+};
+
+/**
+ * Reads the table in RecordId order. Zones of pages whose keys all lie
+ * outside of [lo, hi) are skipped; in a table stored in key order the
+ * scan starts at the first page that may hold lo and stops at hi.
+ */
+class TableScan : public Operator {
+ public:
+  // pages in a zone of the zone map
+  static const int ZONE_PAGES = 4;
+
+  /**
+   * @param rf[IN] the table
+   * @param lo[IN] the smallest key the plan needs
+   * @param hi[IN] the keys the plan needs are smaller than hi
+   * @param clustered[IN] true if the table is stored in key order
+   * @param zoneMin[IN] the smallest key of every zone; empty if there is no zone map
+   * @param zoneMax[IN] the largest key of every zone
+   */
+  TableScan(const RecordFile& rf, long long lo, long long hi, bool clustered,
+            const std::vector<int>& zoneMin, const std::vector<int>& zoneMax);
+
+  RC next(std::vector<Tuple>& batch);
+  std::string describe() const;
+
+ private:
+  // the last page whose first key is smaller than lo (binary search)
+  RC findKeyPage(PageId& pid);
+
+  const RecordFile& rf;
+  long long lo, hi;
+  bool clustered;
+  const std::vector<int>& zoneMin;
+  const std::vector<int>& zoneMax;
+  bool started;  /// true once rid is set
+  bool done;     /// true once no tuple is left
+  RecordId rid;  /// the next tuple to read
+};
+
+/**
+ * Reads the (key, rid) pairs of the B+tree index with a key in one of
+ * the ranges, in key order. The values are not read. The ranges are
+ * walked in one pass: a range that starts past the entry the scan has
+ * come to is looked for in the leaf the scan is in, and located from the
+ * root if it lies beyond, so the leaves between two ranges are not read,
+ * and no leaf is read twice.
+ */
+class IndexScan : public Operator {
+ public:
+  IndexScan(BTreeIndex& tree, const KeyRanges& ranges);
+
+  RC next(std::vector<Tuple>& batch);
+  std::string describe() const;
+
+ private:
+  BTreeIndex& tree;
+  KeyRanges ranges;
+  unsigned range;  /// the range the scan is in
+  bool started;
+  bool done;
+  IndexCursor cursor;
+};
+
+/**
+ * Reads the RecordIds of one key from the hash index.
+ */
+class HashScan : public Operator {
+ public:
+  HashScan(HashIndex& hash, int key);
+
+  RC next(std::vector<Tuple>& batch);
+  std::string describe() const;
+
+ private:
+  HashIndex& hash;
+  int key;
+  bool started;
+  std::vector<RecordId> rids;  /// the RecordIds of key
+  unsigned pos;                /// the next one to pass on
+};
+
+/**
+ * Reads the (value, rid) pairs of the value index with a value in
+ * [low, high), or from low on without hasHigh, in value order.
+ */
+class ValueScan : public Operator {
+ public:
+  ValueScan(ValueIndex& vindex, const std::string& low, const std::string& high, bool hasHigh);
+
+  RC next(std::vector<Tuple>& batch);
+  std::string describe() const;
+
+ private:
+  ValueIndex& vindex;
+  std::string low, high;
+  bool hasHigh;
+  bool started;
+  bool done;
+  ValueCursor cursor;
+};
+
+/**
+ * Reads the entries of the covering index with a key in one of the
+ * ranges, in key order and in one pass; a range that starts past the
+ * entry the scan has come to is located from the root. A value cut short
+ * in the index is marked as unknown.
+ */
+class CoverScan : public Operator {
+ public:
+  CoverScan(CoveringIndex& cover, const KeyRanges& ranges);
+
+  RC next(std::vector<Tuple>& batch);
+  std::string describe() const;
+
+ private:
+  CoveringIndex& cover;
+  KeyRanges ranges;
+  unsigned range;  /// the range the scan is in
+  bool started;
+  bool done;
+  CoverCursor cursor;
+};
+
+/**
+ * Reads the records of the tuples whose key, or value if it is needed,
+ * is unknown. The records of a batch are read in RecordId order, so that
+ * each table page is read once however the tuples are spread over the
+ * table, while the next pages of the batch are prefetched; the tuples
+ * keep their order.
+ */
+class Fetch : public Operator {
+ public:
+  /**
+   * @param input[IN] the operator the tuples come from
+   * @param rf[IN] the table
+   * @param needValue[IN] true if the plan needs the values
+   */
+  Fetch(Operator* input, const RecordFile& rf, bool needValue);
+
+  RC next(std::vector<Tuple>& batch);
+  std::string describe() const;
+
+  // the batches of the input are kept full: the fewer batches, the
+  // fewer times a table page is read
+  void limitBatch(unsigned n) { batchLimit = n; }
+
+  // table pages asked to be read ahead of the one being read
+  static int prefetchDepth;
+
+ private:
+  const RecordFile& rf;
+  bool needValue;
+};
+
+/**
+ * The conditions of a WHERE clause compiled for checking batches of
+ * tuples. The conditions on key go into a KeyFilter, which checks the
+ * keys of a batch with vector instructions. Every condition on value
+ * becomes a term with a check made for its comparator; the terms are
+ * checked one after another on a selection vector, the selective ones
+ * first, so that a later term only sees the tuples the earlier ones left.
+ */
+class Predicate {
+ public:
+  /**
+   * @param cond[IN] the conditions, ANDed together
+   */
+  Predicate(const std::vector<SelCond>& cond);
+
+  /**
+   * Narrow a selection vector to the tuples that meet all conditions.
+   * @param batch[IN] the tuples
+   * @param sel[IN/OUT] the positions in batch of the tuples to check;
+   *        those of the tuples that meet all conditions are kept, in order
+   */
+  void select(const std::vector<Tuple>& batch, std::vector<unsigned>& sel);
+
+  /**
+   * @return the conditions in the order they are checked
+   */
+  std::string describe() const;
+
+ private:
+  struct Term;
+
+  // narrows a selection vector to the tuples that meet one term
+  typedef void (*Check)(const Term& term, const std::vector<Tuple>& batch,
+                        std::vector<unsigned>& sel);
+
+  // a compiled condition on value
+  struct Term {
+    std::string value;  // the literal
+    SelCond::Comparator comp;
+    int         rank;   // terms are checked from the smallest rank on
+    Check       check;
+  };
+
+  // the check of a term with comparator C
+  template <SelCond::Comparator C>
+  static void checkValue(const Term& term, const std::vector<Tuple>& batch, std::vector<unsigned>& sel);
+
+  static bool rankLess(const Term& t1, const Term& t2);
+
+  KeyFilter keyFilter;
+  std::vector<Term> terms;
+
+  // the keys of the selected tuples, one after another, and the bits of
+  // those that pass keyFilter
+  std::vector<int> keys;
+  std::vector<uint64_t> mask;
+};
+
+/**
+ * Passes on the tuples that meet the conditions of a WHERE clause. With
+ * ORed lists of conditions, a tuple that meets one list is not checked
+ * against the lists after it.
+ */
+class Filter : public Operator {
+ public:
+  Filter(Operator* input, const SelDnf& cond);
+
+  RC next(std::vector<Tuple>& batch);
+  std::string describe() const;
+
+ private:
+  std::vector<Predicate> predicates;  /// one for each list of conditions
+  std::vector<unsigned> sel;          /// the selection vector of the batch
+  std::vector<unsigned> rest, part;   /// the tuples left to check, and those a list passes
+};
+
+/**
+ * Passes on the first n tuples, and asks its input for no more.
+ */
+class Limit : public Operator {
+ public:
+  Limit(Operator* input, int n);
+
+  RC next(std::vector<Tuple>& batch);
+  std::string describe() const;
+
+ private:
+  int n;     /// the tuples to pass on
+  int left;  /// the tuples still to pass on
+};
+
+/**
+ * Drops the columns the result does not show, so that later batches
+ * carry less.
+ */
+class Project : public Operator {
+ public:
+  /**
+   * @param input[IN] the operator the tuples come from
+   * @param attr[IN] the SELECT clause (1: key, 2: value, 3: *, 4: count(*), 5: min(key), 6: max(key))
+   */
+  Project(Operator* input, int attr);
+
+  RC next(std::vector<Tuple>& batch);
+  std::string describe() const;
+
+ private:
+  int attr;
+};
+
+/**
+ * Prints the tuples (SELECT key, value or *).
+ */
+class Output : public Operator {
+ public:
+  Output(Operator* input, int attr);
+
+  RC next(std::vector<Tuple>& batch);
+  std::string describe() const;
+
+ private:
+  int attr;
+};
+
+/**
+ * Counts the tuples and finds their smallest and largest key, for
+ * count(*), min(key) and max(key). The result is read once next() has
+ * returned an empty batch.
+ */
+class Count : public Operator {
+ public:
+  Count(Operator* input);
+
+  RC next(std::vector<Tuple>& batch);
+  std::string describe() const;
+
+  int getCount() { return count; }
+
+  // false if there was no tuple
+  bool getMinMax(int& minKey, int& maxKey);
+
+ private:
+  int count;
+  int minKey, maxKey;
+};
+
+#endif /* OPERATOR_H */
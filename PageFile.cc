@@ -18,7 +18,9 @@ using std::string;
 
 int PageFile::readCount = 0;
 int PageFile::writeCount = 0;
-int PageFile::cacheClock = 1;
+int PageFile::prefetchCount = 0;
+volatile int PageFile::cacheClock = 1;
+pthread_mutex_t PageFile::cacheMutex = PTHREAD_MUTEX_INITIALIZER;
 struct PageFile::cacheStruct PageFile::readCache[PageFile::CACHE_COUNT];
 
 PageFile::PageFile() 
@@ -76,13 +78,17 @@ RC PageFile::close()
   if (::close(fd) < 0) return RC_FILE_CLOSE_FAILED;
 
   // evict all cached pages for this file
+  pthread_mutex_lock(&cacheMutex);
   for (int i = 0; i < CACHE_COUNT; i++) {
     if (readCache[i].fd == fd && readCache[i].lastAccessed != 0) {
+       beginChange(i);
        readCache[i].fd = 0;
        readCache[i].pid = 0;
        readCache[i].lastAccessed = 0;
+       endChange(i);
     }
   }
+  pthread_mutex_unlock(&cacheMutex);
 
   // set the fd and epid to the initial state
   fd = -1; 
@@ -102,23 +108,26 @@ RC PageFile::seek(PageId pid) const
 
 RC PageFile::write(PageId pid, const void* buffer)
 {
-  RC rc;
   if (pid < 0) return RC_INVALID_PID; 
 
-  // seek to the location of the page
-  if ((rc = seek(pid)) < 0) return rc;
+  // write the buffer to the disk page.
+  // pwrite() does not move the shared file cursor, so concurrent
+  // readers and writers of the same file do not interfere.
+  if (::pwrite(fd, buffer, PAGE_SIZE, (off_t)pid * PAGE_SIZE) < 0) {
+    return RC_FILE_WRITE_FAILED;
+  }
 
-  // write the buffer to the disk page
-  if (::write(fd, buffer, PAGE_SIZE) < 0) return RC_FILE_WRITE_FAILED;
+  pthread_mutex_lock(&cacheMutex);
 
   // if the page is in read cache, invalidate it
   for (int i = 0; i < CACHE_COUNT; i++) {
     if (readCache[i].fd == fd && readCache[i].pid == pid &&
         readCache[i].lastAccessed != 0) {
+       beginChange(i);
        readCache[i].fd = 0;
        readCache[i].pid = 0;
        readCache[i].lastAccessed = 0;
-       break;
+       endChange(i);
     }
   }
 
@@ -128,30 +137,90 @@ RC PageFile::write(PageId pid, const void* buffer)
   // increase page write count
   writeCount++;
 
+  pthread_mutex_unlock(&cacheMutex);
+
   return 0;
 }
 
-RC PageFile::read(PageId pid, void* buffer) const
+bool PageFile::readCached(PageId pid, void* buffer) const
 {
-  RC rc;
+  for (int i = 0; i < CACHE_COUNT; i++) {
+    cacheStruct& frame = readCache[i];
+    if (frame.fd != fd || frame.pid != pid || frame.lastAccessed == 0) continue;
+
+    // the page has a single frame. if it is being changed, or changes
+    // while it is copied, read() looks again under the lock
+    unsigned version = frame.version;
+    __sync_synchronize();
+    int accessed = frame.lastAccessed;
+    if ((version & 1) || frame.fd != fd || frame.pid != pid || accessed == 0) return false;
+
+    memcpy(buffer, frame.buffer, PAGE_SIZE);
+    __sync_synchronize();
+    if (frame.version != version) return false;
 
-  if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
+    // every tick is unique, so this fails if the frame was refilled or
+    // emptied meanwhile, or another reader touched it. the most recently
+    // used frame stays so without a tick
+    if (accessed != cacheClock)
+      __sync_bool_compare_and_swap(&frame.lastAccessed, accessed, __sync_add_and_fetch(&cacheClock, 1));
+    return true;
+  }
+  return false;
+}
+
+RC PageFile::read(PageId pid, void* buffer) const
+{
+  if (pid < 0 || pid >= epid) return RC_INVALID_PID;
 
   //
   // if the page is in cache, read it from there
   //
+  if (readCached(pid, buffer)) return 0;
+
+  pthread_mutex_lock(&cacheMutex);
+
+  // no frame changes while the lock is held
   for (int i = 0; i < CACHE_COUNT; i++) {
     if (readCache[i].fd == fd && readCache[i].pid == pid && 
         readCache[i].lastAccessed != 0) {
        memcpy(buffer, readCache[i].buffer, PAGE_SIZE);
-       readCache[i].lastAccessed = ++cacheClock;
+       readCache[i].lastAccessed = __sync_add_and_fetch(&cacheClock, 1);
+       pthread_mutex_unlock(&cacheMutex);
        return 0;
     }
   }
 
-  // seek to the page
-  if ((rc = seek(pid)) < 0) return rc;
-  
+  // read the page without holding the lock, so that other threads can
+  // use the cache while we wait for the disk
+  int writeStamp = writeCount;
+  pthread_mutex_unlock(&cacheMutex);
+
+  if (::pread(fd, buffer, PAGE_SIZE, (off_t)pid * PAGE_SIZE) < 0) {
+    return RC_FILE_READ_FAILED;
+  }
+
+  pthread_mutex_lock(&cacheMutex);
+
+  // increase the page read count
+  readCount++;
+
+  // a page written while we were reading may be stale: do not cache it
+  if (writeCount != writeStamp) {
+    pthread_mutex_unlock(&cacheMutex);
+    return 0;
+  }
+
+  // another thread may have cached the page meanwhile: keep a single copy,
+  // so that write() never leaves a stale one behind
+  for (int i = 0; i < CACHE_COUNT; i++) {
+    if (readCache[i].fd == fd && readCache[i].pid == pid && 
+        readCache[i].lastAccessed != 0) {
+      pthread_mutex_unlock(&cacheMutex);
+      return 0;
+    }
+  }
+
   // find the cache slot to evict
   int toEvict = 0; 
   for (int i = 0; i < CACHE_COUNT; i++) {
@@ -163,18 +232,36 @@ RC PageFile::read(PageId pid, void* buffer) const
       toEvict = i;
     }
   }
+
+  // keep a copy of the page in the cache
+  beginChange(toEvict);
   readCache[toEvict].fd = fd;
   readCache[toEvict].pid = pid;
-  readCache[toEvict].lastAccessed = ++cacheClock;
- 
-  // read the page to cache first and copy it to the buffer
-  if (::read(fd, readCache[toEvict].buffer, PAGE_SIZE) < 0) {
-    return RC_FILE_READ_FAILED;
+  readCache[toEvict].lastAccessed = __sync_add_and_fetch(&cacheClock, 1);
+  memcpy(readCache[toEvict].buffer, buffer, PAGE_SIZE);
+  endChange(toEvict);
+
+  pthread_mutex_unlock(&cacheMutex);
+
+  return 0;
+}
+
+RC PageFile::prefetch(PageId pid) const
+{
+  if (pid < 0 || pid >= epid) return RC_INVALID_PID;
+
+  // a frame changed meanwhile costs a needless hint at most, so the
+  // cache is looked at without the lock
+  for (int i = 0; i < CACHE_COUNT; i++) {
+    if (readCache[i].fd == fd && readCache[i].pid == pid &&
+        readCache[i].lastAccessed != 0) {
+      return 0;
+    }
   }
-  memcpy(buffer, readCache[toEvict].buffer, PAGE_SIZE);
 
-  // increase the page read count
-  readCount++;
+  __sync_fetch_and_add(&prefetchCount, 1);
 
+  // only a hint: the read happens in the background, or not at all
+  posix_fadvise(fd, (off_t)pid * PAGE_SIZE, PAGE_SIZE, POSIX_FADV_WILLNEED);
   return 0;
 }
@@ -11,12 +11,17 @@
 #define PAGEFILE_H
 
 #include <string>
+#include <pthread.h>
 #include "Bruinbase.h"
 
 typedef int PageId;
 
 /**
- * read/write a file in the unit of a page
+ * read/write a file in the unit of a page.
+ * read() and write() may be called from multiple threads at the same time.
+ * a mutex protects the page counters and every change to the shared LRU
+ * cache; a read() that finds its page in the cache takes no lock, but
+ * copies the page optimistically and checks the version of its frame.
  */
 class PageFile {
  public:
@@ -48,6 +53,15 @@ class PageFile {
    * @return error code. 0 if no error
    */
   RC read(PageId pid, void *buffer) const;
+
+  /**
+   * ask the operating system to start reading a disk page in the
+   * background, so that a read() of the page soon after does not wait
+   * for the disk. a page in the cache is not asked for.
+   * @param pid[IN] the page that is going to be read
+   * @return error code. 0 if no error
+   */
+  RC prefetch(PageId pid) const;
   
   /**
    * write the memory buffer to the disk page.
@@ -76,6 +90,11 @@ class PageFile {
    */
   static int getPageWriteCount() { return writeCount; }
 
+  /**
+   * @return the total # of pages prefetch() asked for
+   */
+  static int getPagePrefetchCount() { return prefetchCount; }
+
  protected:
   /**
    * move the file cursor to the beginning of a page.
@@ -94,19 +113,39 @@ class PageFile {
   //
   static const int CACHE_COUNT = 10;
 
-  static int cacheClock; // clock tick counter for LRU policy
+  static volatile int cacheClock; // clock tick counter for LRU policy
+
+  static pthread_mutex_t cacheMutex; // serializes changes to the cache, and the counters
 
   // the actual cache data structure
   static struct cacheStruct {
+    volatile unsigned version; // odd while the frame is being changed
     int    fd;              // file id of the cached page
     PageId pid;             // page id of the cached page
-    int    lastAccessed;    // the last time the cached page was accessed
+    volatile int lastAccessed; // the last time the cached page was accessed
                             //   (lastAccessed == 0) means that the buffer is empty
     char buffer[PAGE_SIZE]; // the buffer used for caching
   } readCache[CACHE_COUNT];
 
+  /**
+   * find the page in the cache and copy it to buffer without the lock.
+   * @param pid[IN] the page to find
+   * @param buffer[OUT] pointer to memory buffer
+   * @return true if the page was in the cache
+   */
+  bool readCached(PageId pid, void* buffer) const;
+
+  /**
+   * make the version of a cache frame odd before it is changed, and even
+   * again after. the caller holds cacheMutex.
+   * @param i[IN] the frame
+   */
+  static void beginChange(int i) { __sync_fetch_and_add(&readCache[i].version, 1); }
+  static void endChange(int i)   { __sync_fetch_and_add(&readCache[i].version, 1); }
+
   static int readCount;  // total # of page reads 
   static int writeCount; // total # of page writes 
+  static int prefetchCount; // total # of pages asked for by prefetch()
 };
   
 #endif // PAGEFILE_H
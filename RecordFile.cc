@@ -184,6 +184,13 @@ RC RecordFile::read(const RecordId& rid, int& key, string& value) const
   return 0;
 }
 
+RC RecordFile::prefetch(PageId pid) const
+{
+  if (pid < 0 || pid > erid.pid) return RC_INVALID_RID;
+
+  return pf.prefetch(pid);
+}
+
 RC RecordFile::append(int key, const std::string& value, RecordId& rid)
 {
   RC   rc;
@@ -79,6 +79,14 @@ class RecordFile {
    */
   RC read(const RecordId& rid, int& key, std::string& value) const;
 
+  /**
+   * start reading the page of the records in the background, so that
+   * reading them soon after does not wait for the disk.
+   * @param pid[IN] the page of the records that are going to be read
+   * @return error code. 0 if no error
+   */
+  RC prefetch(PageId pid) const;
+
   /**
    * append a new record at the end of the file.
    * note that RecordFile does not have write() function.
@@ -13,8 +13,19 @@
 #include "Bruinbase.h"
 #include "SqlEngine.h"
 #include "BTreeIndex.h"
+#include "BloomFilter.h"
+#include "HashIndex.h"
+#include "ValueIndex.h"
+#include "CoveringIndex.h"
+#include "Operator.h"
 #include <string.h>
 #include <stdlib.h>
+#include <climits>
+#include <cmath>
+#include <algorithm>
+#include <map>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -22,6 +33,507 @@ using namespace std;
 extern FILE* sqlin;
 int sqlparse(void);
 
+// the number of index entries with a key smaller than bound,
+// where bound may lie outside of the int range
+static RC rankOf(BTreeIndex& tree, long long bound, int& count)
+{
+  if (bound <= INT_MIN) {
+    count = 0;
+    return 0;
+  }
+  if (bound > INT_MAX) {
+    count = tree.getEntryCount();
+    return 0;
+  }
+  return tree.rank((int) bound, count);
+}
+
+// turn the conditions on the key (but NE) into a key range [lo, hi);
+// an IN list bounds it by its smallest and its largest key
+static void keyBounds(const vector<SelCond>& cond, long long& lo, long long& hi)
+{
+  lo = (long long) INT_MIN;
+  hi = (long long) INT_MAX + 1;
+
+  for (unsigned i = 0; i < cond.size(); i++) {
+    if (cond[i].attr != 1) continue;
+
+    if (cond[i].comp == SelCond::IN) {
+      lo = std::max(lo, (long long) cond[i].keys.front());
+      hi = std::min(hi, (long long) cond[i].keys.back() + 1);
+      continue;
+    }
+
+    long long v = atoi(cond[i].value);
+    switch (cond[i].comp) {
+      case SelCond::EQ:
+        lo = std::max(lo, v);
+        hi = std::min(hi, v + 1);
+        break;
+      case SelCond::GT:
+        lo = std::max(lo, v + 1);
+        break;
+      case SelCond::GE:
+        lo = std::max(lo, v);
+        break;
+      case SelCond::LT:
+        hi = std::min(hi, v);
+        break;
+      case SelCond::LE:
+        hi = std::min(hi, v + 1);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+// turn the conditions on the value (but NE) into a value range [lo, hi),
+// where hi is unbounded unless hasHigh. v + "\x01" is the first string
+// after v, as values hold no '\0'.
+// returns false if there are no such conditions.
+static bool valueBounds(const vector<SelCond>& cond, string& lo, string& hi, bool& hasHigh)
+{
+  bool found = false;
+
+  lo = "";
+  hasHigh = false;
+
+  for (unsigned i = 0; i < cond.size(); i++) {
+    if (cond[i].attr != 2 || cond[i].comp == SelCond::NE) continue;
+
+    string v = cond[i].value;
+    string next = v + "\x01";
+    found = true;
+
+    switch (cond[i].comp) {
+      case SelCond::EQ:
+        lo = std::max(lo, v);
+        hi = hasHigh ? std::min(hi, next) : next;
+        hasHigh = true;
+        break;
+      case SelCond::GT:
+        lo = std::max(lo, next);
+        break;
+      case SelCond::GE:
+        lo = std::max(lo, v);
+        break;
+      case SelCond::LT:
+        hi = hasHigh ? std::min(hi, v) : v;
+        hasHigh = true;
+        break;
+      case SelCond::LE:
+        hi = hasHigh ? std::min(hi, next) : next;
+        hasHigh = true;
+        break;
+      default:
+        break;
+    }
+  }
+
+  return found;
+}
+
+// narrow the key ranges to the keys of the IN lists on key that lie in
+// them, a range of one key each. the ranges and the keys are both sorted,
+// so they are walked side by side.
+static void keepInKeys(const vector<SelCond>& cond, KeyRanges& ranges)
+{
+  for (unsigned i = 0; i < cond.size(); i++) {
+    if (cond[i].attr != 1 || cond[i].comp != SelCond::IN) continue;
+
+    const vector<int>& keys = cond[i].keys;
+    KeyRanges kept;
+    unsigned j = 0;
+    for (unsigned k = 0; k < keys.size() && j < ranges.size(); k++) {
+      while (j < ranges.size() && ranges[j].second <= keys[k]) j++;
+      if (j < ranges.size() && ranges[j].first <= keys[k])
+        kept.push_back(make_pair((long long) keys[k], (long long) keys[k] + 1));
+    }
+    ranges.swap(kept);
+  }
+}
+
+// take the keys of the NE conditions on key out of the key ranges, so
+// that the ranges hold exactly the keys the conditions on key leave
+static void cutNotEqualKeys(const vector<SelCond>& cond, KeyRanges& ranges)
+{
+  for (unsigned i = 0; i < cond.size(); i++) {
+    if (cond[i].attr != 1 || cond[i].comp != SelCond::NE) continue;
+
+    long long v = atoi(cond[i].value);
+    KeyRanges cut;
+    for (unsigned j = 0; j < ranges.size(); j++) {
+      if (v < ranges[j].first || v >= ranges[j].second)
+        cut.push_back(ranges[j]);
+      else {
+        if (ranges[j].first < v) cut.push_back(make_pair(ranges[j].first, v));
+        if (v + 1 < ranges[j].second) cut.push_back(make_pair(v + 1, ranges[j].second));
+      }
+    }
+    ranges.swap(cut);
+  }
+}
+
+// true if key lies in one of the key ranges
+static bool inRanges(const KeyRanges& ranges, int key)
+{
+  for (unsigned i = 0; i < ranges.size(); i++)
+    if (key >= ranges[i].first && key < ranges[i].second) return true;
+  return false;
+}
+
+// sort key ranges and merge those that overlap or touch
+static void mergeRanges(KeyRanges& ranges)
+{
+  unsigned kept = 0;
+
+  sort(ranges.begin(), ranges.end());
+  for (unsigned i = 0; i < ranges.size(); i++) {
+    if (kept > 0 && ranges[i].first <= ranges[kept - 1].second)
+      ranges[kept - 1].second = std::max(ranges[kept - 1].second, ranges[i].second);
+    else
+      ranges[kept++] = ranges[i];
+  }
+  ranges.resize(kept);
+}
+
+// count(*) for conditions on the key alone without reading the leaves:
+// the counts kept in the non-leaf nodes give rank(hi) - rank(lo) for each
+// of the disjoint key ranges [lo, hi) of the conditions. without
+// conditions, the entry count in the metadata page is the answer.
+// returns false if the counts cannot be read.
+static bool countKeyRanges(BTreeIndex& tree, const KeyRanges& ranges, int& count)
+{
+  int below, upto;
+
+  count = 0;
+  for (unsigned i = 0; i < ranges.size(); i++) {
+    if (rankOf(tree, ranges[i].first, below) != 0 || rankOf(tree, ranges[i].second, upto) != 0)
+      return false;
+    count += upto - below;
+  }
+  return true;
+}
+
+// Bloom filters read so far, by table, with the file state they were read at
+struct CachedBloom {
+  BloomFilter filter;
+  time_t      mtime;
+  off_t       size;
+};
+static map<string, CachedBloom> bloomCache;
+
+// false if the Bloom filter of table rules key out. the filter is read
+// once and kept in memory, so that ruling a key out reads no page at all.
+// a table without a filter may contain every key.
+static bool bloomMayContain(const string& table, int key)
+{
+  string filename = table + ".blm";
+  struct stat st;
+
+  if (stat(filename.c_str(), &st) != 0) {
+    bloomCache.erase(table);
+    return true;
+  }
+
+  map<string, CachedBloom>::iterator it = bloomCache.find(table);
+  if (it == bloomCache.end() || it->second.mtime != st.st_mtime || it->second.size != st.st_size) {
+    CachedBloom& cached = bloomCache[table];
+    cached.mtime = st.st_mtime;
+    cached.size = st.st_size;
+    if (cached.filter.read(filename) != 0) cached.filter = BloomFilter();
+    it = bloomCache.find(table);
+  }
+
+  return it->second.filter.mayContain(key);
+}
+
+// drop the ranges of one key that the Bloom filter of table rules out;
+// ruledOut is set if there was one
+static void cutRuledOutKeys(const string& table, KeyRanges& ranges, bool& ruledOut)
+{
+  unsigned kept = 0;
+
+  for (unsigned i = 0; i < ranges.size(); i++) {
+    if (ranges[i].second == ranges[i].first + 1 && !bloomMayContain(table, (int) ranges[i].first))
+      ruledOut = true;
+    else
+      ranges[kept++] = ranges[i];
+  }
+  ranges.resize(kept);
+}
+
+// build the Bloom filter of table from all keys in its index
+static RC buildBloom(const string& table, BTreeIndex& tree, int rate)
+{
+  BloomFilter filter;
+  IndexCursor c;
+  int key;
+  RecordId rid;
+
+  filter.create(tree.getDistinctKeyCount(), rate);
+
+  if (tree.locate(INT_MIN, c) == 0) {
+    while (tree.readForward(c, key, rid) == 0)
+      filter.add(key);
+  }
+
+  bloomCache.erase(table);
+  return filter.write(table + ".blm");
+}
+
+
+// the metadata of a table, kept in tablename.tbm. a table without the
+// file is not known to be in key order and has no zone map.
+struct TableInfo {
+  bool clustered;      // the tuples are stored in key order
+  int  maxKey;         // the largest key, if the table has tuples
+  vector<int> zoneMin; // the smallest key in each zone of ZONE_PAGES pages
+  vector<int> zoneMax; // the largest key in each zone
+  int  zones;          // # zones in tablename.tbm, -1 until its header is read
+
+  TableInfo() : clustered(false), maxKey(INT_MIN), zones(-1) {}
+};
+
+// layout of tablename.tbm:
+//   page 0: [magic][clustered][largest key][# zones]
+//   page 1, 2, ...: the (smallest key, largest key) of each zone
+static const int TABLE_INFO_MAGIC = 0x54424d31; // "TBM1"
+static const int ZONE_PAGES = TableScan::ZONE_PAGES;
+static const int ZONES_PER_PAGE = PageFile::PAGE_SIZE / (2 * sizeof(int));
+
+// the number of zones of table pages
+static int zoneCount(const RecordFile& rf)
+{
+  int pages = rf.endRid().pid + (rf.endRid().sid > 0 ? 1 : 0);
+  return (pages + ZONE_PAGES - 1) / ZONE_PAGES;
+}
+
+// count the tuple at rid into the zone map
+static void addToZone(TableInfo& info, const RecordId& rid, int key)
+{
+  unsigned zone = rid.pid / ZONE_PAGES;
+
+  if (zone >= info.zoneMin.size()) {
+    info.zoneMin.resize(zone + 1, key);
+    info.zoneMax.resize(zone + 1, key);
+  }
+  info.zoneMin[zone] = std::min(info.zoneMin[zone], key);
+  info.zoneMax[zone] = std::max(info.zoneMax[zone], key);
+}
+
+// read the zones of the next page of the zone map into info
+static RC readZonePage(PageFile& pf, TableInfo& info)
+{
+  char page[PageFile::PAGE_SIZE];
+  int first = info.zoneMin.size();
+  RC rc;
+
+  if ((rc = pf.read(1 + first / ZONES_PER_PAGE, page)) < 0) return rc;
+
+  for (int i = first; i < info.zones && (i == first || i % ZONES_PER_PAGE != 0); i++) {
+    int zone[2];
+    memcpy(zone, page + (i % ZONES_PER_PAGE) * sizeof(zone), sizeof(zone));
+    info.zoneMin.push_back(zone[0]);
+    info.zoneMax.push_back(zone[1]);
+  }
+  return 0;
+}
+
+// read the metadata of a table from its .tbm file, open in pf: the header
+// unless info holds it already, and the zone map with zones. the file is
+// kept open while a query is planned, so that no page is read twice.
+static RC readTableInfo(PageFile& pf, TableInfo& info, bool zones)
+{
+  char page[PageFile::PAGE_SIZE];
+  RC rc = 0;
+
+  if (info.zones < 0) {
+    int header[4];
+
+    info.clustered = false;
+    info.maxKey = INT_MIN;
+    info.zoneMin.clear();
+    info.zoneMax.clear();
+
+    if ((rc = pf.read(0, page)) < 0) return rc;
+
+    memcpy(header, page, sizeof(header));
+    if (header[0] != TABLE_INFO_MAGIC || header[3] < 0) return RC_INVALID_FILE_FORMAT;
+
+    info.clustered = (header[1] != 0);
+    info.maxKey = header[2];
+    info.zones = header[3];
+  }
+
+  while (zones && (int) info.zoneMin.size() < info.zones) {
+    if ((rc = readZonePage(pf, info)) < 0) {
+      info.zoneMin.clear();
+      info.zoneMax.clear();
+      break;
+    }
+  }
+
+  return rc;
+}
+
+// read the zone map of a table into info, a page at a time, while the
+// rest of the map plus the zones a table scan of [lo, hi) reads, at least
+// minScan pages, may still come to fewer than limit pages. the map is
+// left out once they cannot, or on an error.
+static void readZoneMap(PageFile& pf, TableInfo& info, long long lo, long long hi,
+                        double minScan, double limit)
+{
+  double mapPages = (info.zones + ZONES_PER_PAGE - 1) / ZONES_PER_PAGE;
+  double scanPages = 0;
+
+  while (mapPages + std::max(scanPages, minScan) < limit && (int) info.zoneMin.size() < info.zones) {
+    unsigned first = info.zoneMin.size();
+    if (readZonePage(pf, info) < 0) break;
+    for (unsigned z = first; z < info.zoneMin.size(); z++)
+      if (info.zoneMax[z] >= lo && info.zoneMin[z] < hi) scanPages += ZONE_PAGES;
+  }
+
+  if ((int) info.zoneMin.size() != info.zones || mapPages + std::max(scanPages, minScan) >= limit) {
+    info.zoneMin.clear();
+    info.zoneMax.clear();
+  }
+}
+
+// read all metadata of table
+static RC readTableInfo(const string& table, TableInfo& info)
+{
+  PageFile pf;
+  RC rc;
+
+  if ((rc = pf.open(table + ".tbm", 'r')) < 0) return rc;
+
+  rc = readTableInfo(pf, info, true);
+  pf.close();
+  return rc;
+}
+
+static RC writeTableInfo(const string& table, const TableInfo& info)
+{
+  PageFile pf;
+  char page[PageFile::PAGE_SIZE];
+  int header[4] = { TABLE_INFO_MAGIC, info.clustered, info.maxKey, (int) info.zoneMin.size() };
+  RC rc;
+
+  memset(page, 0, PageFile::PAGE_SIZE);
+  memcpy(page, header, sizeof(header));
+
+  if ((rc = pf.open(table + ".tbm", 'w')) < 0) return rc;
+  rc = pf.write(0, page);
+
+  for (unsigned i = 0; rc == 0 && i < info.zoneMin.size(); i++) {
+    int zone[2] = { info.zoneMin[i], info.zoneMax[i] };
+    memcpy(page + (i % ZONES_PER_PAGE) * sizeof(zone), zone, sizeof(zone));
+
+    if ((i + 1) % ZONES_PER_PAGE == 0 || i + 1 == info.zoneMin.size()) {
+      rc = pf.write(1 + i / ZONES_PER_PAGE, page);
+      memset(page, 0, PageFile::PAGE_SIZE);
+    }
+  }
+
+  RC closeRc = pf.close();
+  return rc < 0 ? rc : closeRc;
+}
+
+// lines of a CLUSTERED load that are sorted in memory at a time; a longer
+// load file is sorted in runs of this many lines that are merged afterwards
+static const unsigned SORT_RUN_LINES = 1 << 16;
+
+struct SortLine {
+  int    key;
+  string line;
+};
+
+static bool sortLineLess(const SortLine& l1, const SortLine& l2)
+{
+  return l1.key < l2.key;
+}
+
+// write the lines of loadfile to sortedfile, ordered by key. lines with
+// the same key keep their order, as they would in an unsorted load.
+// remove the run files of sortLoadFile()
+static void removeRuns(const vector<string>& runFiles)
+{
+  for (unsigned i = 0; i < runFiles.size(); i++)
+    unlink(runFiles[i].c_str());
+}
+
+static RC sortLoadFile(const string& loadfile, const string& sortedfile)
+{
+  ifstream in(loadfile.c_str());
+  vector<SortLine> run;
+  vector<string> runFiles;
+  SortLine s;
+  string value;
+  bool more = true;
+
+  if (!in.is_open()) return RC_FILE_OPEN_FAILED;
+
+  // sort the file in runs; a file that fits into one run is done here
+  while (more) {
+    run.clear();
+    while (run.size() < SORT_RUN_LINES && (more = !getline(in, s.line).fail())) {
+      SqlEngine::parseLoadLine(s.line, s.key, value);
+      run.push_back(s);
+    }
+    if (run.empty() && !runFiles.empty()) break;
+
+    stable_sort(run.begin(), run.end(), sortLineLess);
+
+    char suffix[16];
+    sprintf(suffix, ".%d", (int) runFiles.size());
+    runFiles.push_back(!more && runFiles.empty() ? sortedfile : sortedfile + suffix);
+
+    ofstream out(runFiles.back().c_str());
+    for (unsigned i = 0; i < run.size(); i++)
+      out << run[i].line << '\n';
+    if (!out) {
+      removeRuns(runFiles);
+      return RC_FILE_WRITE_FAILED;
+    }
+  }
+
+  if (runFiles.size() == 1 && runFiles[0] == sortedfile) return 0;
+
+  // merge the runs, taking the earlier run first among equal keys
+  vector<ifstream*> runs;
+  vector<string> heads(runFiles.size());
+  map<pair<int, int>, int> next; // (key, run) of the head line of each run
+  ofstream out(sortedfile.c_str());
+  RC rc = 0;
+
+  for (unsigned i = 0; i < runFiles.size(); i++) {
+    runs.push_back(new ifstream(runFiles[i].c_str()));
+    if (!runs[i]->is_open()) rc = RC_FILE_READ_FAILED;
+    else if (getline(*runs[i], heads[i])) {
+      SqlEngine::parseLoadLine(heads[i], s.key, value);
+      next[make_pair(s.key, (int) i)] = i;
+    }
+  }
+
+  while (rc == 0 && !next.empty()) {
+    int i = next.begin()->second;
+    next.erase(next.begin());
+
+    out << heads[i] << '\n';
+    if (getline(*runs[i], heads[i])) {
+      SqlEngine::parseLoadLine(heads[i], s.key, value);
+      next[make_pair(s.key, i)] = i;
+    }
+  }
+  if (rc == 0 && !out) rc = RC_FILE_WRITE_FAILED;
+
+  for (unsigned i = 0; i < runs.size(); i++) delete runs[i];
+  removeRuns(runFiles);
+
+  return rc;
+}
 
 RC SqlEngine::run(FILE* commandline)
 {
@@ -35,356 +547,434 @@ RC SqlEngine::run(FILE* commandline)
   return 0;
 }
 
-RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
+void SqlEngine::setPrefetchDepth(int depth)
+{
+  Fetch::prefetchDepth = std::max(depth, 0);
+}
+
+// the cost model of select(): the table and index pages each way of
+// finding the tuples of a query is estimated to read
+
+// the pages, out of pages, that k tuples at random RecordIds lie on
+static double pagesTouched(double k, double pages)
+{
+  if (k <= 0 || pages <= 0) return 0;
+  return pages * (1 - pow(1 - 1 / pages, k));
+}
+
+// the table pages read to fetch k tuples an index finds, a batch at a time
+// in RecordId order. the tuples of a key range of a table in key order
+// lie on consecutive pages.
+static double fetchCost(double k, double pages, bool consecutive)
+{
+  if (k <= 0) return 0;
+  if (consecutive) return ceil(k / RecordFile::RECORDS_PER_PAGE) + 1;
+
+  double batch = std::min(k, (double) Operator::BATCH_SIZE);
+  return ceil(k / batch) * pagesTouched(batch, pages);
+}
+
+// the tuples with a key in [lo, hi): counted in the B+tree if it is open;
+// otherwise the keys are taken to be spread evenly between the smallest
+// and the largest key of the zone map, or a third of the tuples to match
+static double keyRangeRows(BTreeIndex& tree, bool treeOpen, const TableInfo& info,
+                           long long lo, long long hi, double rows)
+{
+  int below, upto;
+
+  if (lo <= INT_MIN && hi > INT_MAX) return rows;
+
+  if (treeOpen && rankOf(tree, lo, below) == 0 && rankOf(tree, hi, upto) == 0)
+    return std::max(upto - below, 0);
+
+  if (info.zoneMin.empty()) return rows / 3;
+
+  double minKey = *min_element(info.zoneMin.begin(), info.zoneMin.end());
+  double maxKey = *max_element(info.zoneMax.begin(), info.zoneMax.end());
+  double overlap = std::min((double) hi, maxKey + 1) - std::max((double) lo, minKey);
+  return rows * std::max(overlap, 0.0) / (maxKey - minKey + 1);
+}
+
+// the ways select() finds the tuples of a query, which the cost model
+// chooses from
+enum Access { TABLE_SCAN, INDEX_SCAN, COVER_SCAN, VALUE_SCAN, ACCESS_COUNT };
+
+RC SqlEngine::select(int attr, const string& table, const SelDnf& conds, bool explain)
 {
   RecordFile rf;   // RecordFile containing the table
-  RecordId   rid;  // record cursor for table scanning
-  IndexCursor c;  // cursor for navigating through the tree
   BTreeIndex tree; // BTree for indexing
-  
+  HashIndex  hash; // hash index for key equality
+  ValueIndex vindex; // index on value
+  CoveringIndex cover; // index on key that includes value
+  TableInfo  info; // whether the table is stored in key order, and its zone map
+  PageFile   tbm;  // tablename.tbm, open while the query is planned
+  SelDnf     cond; // the lists of conditions that may match a tuple
+  KeyRanges  ranges; // the key ranges of those lists, merged
+  long long  lo, hi; // the smallest key of the ranges, and the end of the last one
+  string lowValue, highValue; // the range [lowValue, highValue) of value conditions
+  bool   hasHighValue;
+
   RC     rc;
-  int    key;     
-  string value;
   int    count = 0;
-  int    diff;
+  bool   found = false; // true once a key for min(key)/max(key) is known
+  int    result = 0;    // the min(key)/max(key)
+  int    startReads = PageFile::getPageReadCount(); // to count the reads that plan the query
 
   // open the table file
   if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
   fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
   return rc;
   }
-  
-  SelCond temp; //temporary variable for storing selection condition
-  bool hasCond = false; //use to check if any valid select conditions exist
-    //if false, we skip the B+ tree indexing altogether
-  bool hasValueCond = false; //use to check if any value select conditions exist
-    //if false, we skip the rf.read to save reads and only increment count
-  bool usesIndex = false; //assume B+ tree is not used (used for closing index file)
-  
-  //boolean, min, and max values for filtering the key, if applicable
-  bool condGE = false; //true means key is >= min
-  bool condLE = false; //true means key is <= max
-  int max = -1;
-  int min = -1;
-  int eqVal = -1; //if not -1, the key must be equal to this
-  
-  //keep track of the index of a vital select condition
-  int condIndex = -1;
-  
-  //check if any value conditions are conflicting
-  bool valueConflict = false;
-  std::string valEq = "";
-  
-  //go through all SelConds in parameter to determine conditions
-  for(int i=0; i<cond.size(); i++)
-  {
-    temp = cond[i];
-    int tempVal = atoi(temp.value); //store the int-form value of the select condition
-     
-    //we only have to worry about conditions on keys that don't involve NE
-    //all other select conditions will be considered outside of the B+ Tree
-    if(temp.attr==1 && temp.comp!=SelCond::NE)
-    {
-      hasCond = true; //if we ever hit a valid condition, set this to true
-      
-      if(temp.comp==SelCond::EQ) //if there's ever an equality on key, that is the only select condition; break
-      {
-        eqVal = tempVal;
-        condIndex = i;
-        break;
-      }
-      else if(temp.comp==SelCond::GE) //key >= min
-      {
-        if(tempVal > min || min==-1) //if the tempVal min is larger than our current min (or it's uninitialized), set GE
-        {
-          condGE = true;
-          min = tempVal;
-        }
-      }
-      else if(temp.comp==SelCond::GT) //key > min
-      {
-        if(tempVal >= min || min==-1) //if the tempVal min is larger than or equal to our current min (or it's uninitialized), set GT
-        {
-          condGE = false;
-          min = tempVal;
-        }
-      }
-      else if(temp.comp==SelCond::LE) //key <= max
-      {
-        if(tempVal < max || max==-1) //if the tempVal max is smaller than our current max (or it's uninitialized), set LE
-        {
-          condLE = true;
-          max = tempVal;
-        }
-      }
-      else if(temp.comp==SelCond::LT) //key < max
-      {
-        if(tempVal <= max || max==-1) //if the tempVal max is smaller than or equal to our current max (or it's uninitialized), set LT
-        {
-          condLE = false;
-          max = tempVal;
-        }
-      }
-    }
-    else if(temp.attr==2) //if we hit a value condition, update hasValueCond and check for contradictions
-    {
-      hasValueCond = true;
-      
-      if(temp.comp==SelCond::EQ) //check on value equality
-      {
-        if(valEq=="" || strcmp(value.c_str(), cond[i].value)==0) //if no value equality conditions have been specified yet or this condition is the same as one before
-          valEq=tempVal;
-        else
-          valueConflict = true;
-      }
+
+  // a list of conditions that contradict each other matches no tuple, and
+  // neither does an equality on a key the Bloom filter rules out
+  bool bloomRuledOut = false;
+  for (unsigned i = 0; i < conds.size(); i++) {
+    keyBounds(conds[i], lo, hi);
+    if (lo >= hi || (valueBounds(conds[i], lowValue, highValue, hasHighValue) &&
+                     hasHighValue && lowValue >= highValue))
+      continue;
+    if (hi == lo + 1 && !bloomMayContain(table, (int) lo)) {
+      bloomRuledOut = true;
+      continue;
     }
+
+    KeyRanges listRanges(1, make_pair(lo, hi));
+    keepInKeys(conds[i], listRanges);
+    cutNotEqualKeys(conds[i], listRanges);
+    if (listRanges.size() > 1) cutRuledOutKeys(table, listRanges, bloomRuledOut);
+    if (listRanges.empty()) continue;
+
+    cond.push_back(conds[i]);
+    ranges.insert(ranges.end(), listRanges.begin(), listRanges.end());
   }
-  
-  //the next two if-statements give the query a chance to end early (if there are no tuple matches)
-  //check if the conditions are already impossible
-  if(valueConflict || (max!=-1 && min!=-1 && max<min))
-    goto end_select_early;
-    
-  //similarly, if max=min but there is neither less-than-equal or greater-than-equal, no results
-  if(max!=-1 && min!=-1 && !condGE && !condLE && max==min)
-    goto end_select_early;
-  
-  //if the index file does not exist, use normal select
-  //similarly, unless we are interested in a count(*) without conditions, an empty condition array means we use normal select
-  //we do this because using "select count(*) from table" could offer a speedup using the index tfile
-  if(tree.open(table + ".idx", 'r')!=0 || (!hasCond && attr!=4))
-  {
-    // scan the table file from the beginning
-    rid.pid = rid.sid = 0;
-    count = 0;
-    while (rid < rf.endRid()) {
-    // read the tuple
-    if ((rc = rf.read(rid, key, value)) < 0) {
-      fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-      goto exit_select;
+  mergeRanges(ranges);
+  lo = ranges.empty() ? 0 : ranges.front().first;
+  hi = ranges.empty() ? 0 : ranges.back().second;
+
+  bool hasCond = !cond.empty(); // every list bounds the key range by a condition on key (but NE)
+  bool hasValueCond = false;    // a condition on value must be checked on every tuple
+  for (unsigned i = 0; i < cond.size(); i++) {
+    bool bounded = false;
+    for (unsigned j = 0; j < cond[i].size(); j++) {
+      if (cond[i][j].attr == 1 && cond[i][j].comp != SelCond::NE)
+        bounded = true;
+      else if (cond[i][j].attr == 2)
+        hasValueCond = true;
     }
+    hasCond = hasCond && bounded;
+  }
+  bool noCond = (cond.size() == 1 && cond[0].empty());
 
-    // check the conditions on the tuple
-    for (unsigned i = 0; i < cond.size(); i++) {
-      // compute the difference between the tuple value and the condition value
-      switch (cond[i].attr) {
-      case 1:
-    diff = key - atoi(cond[i].value);
-    break;
-      case 2:
-    diff = strcmp(value.c_str(), cond[i].value);
-    break;
-      }
+  // the values are read only to print them or to check conditions on them
+  bool needValue = (attr == 2 || attr == 3 || hasValueCond);
 
-      // skip the tuple if any condition is not met
-      switch (cond[i].comp) {
-        case SelCond::EQ:
-        if (diff != 0) goto next_tuple;
-        break;
-        case SelCond::NE:
-        if (diff == 0) goto next_tuple;
-        break;
-        case SelCond::GT:
-        if (diff <= 0) goto next_tuple;
-        break;
-        case SelCond::LT:
-        if (diff >= 0) goto next_tuple;
-        break;
-        case SelCond::GE:
-        if (diff < 0) goto next_tuple;
-        break;
-        case SelCond::LE:
-        if (diff > 0) goto next_tuple;
-        break;
+  // the value index serves a single list of conditions
+  bool hasValueRange = (cond.size() == 1 && valueBounds(cond[0], lowValue, highValue, hasHighValue));
+
+  // the plan is a scan followed by operators; it is not needed if the
+  // answer is known without reading a tuple
+  Operator* scan = 0;
+  const char* answer = 0;  // how the answer is known then
+  bool keyOrdered = false; // the scan returns the tuples in key order
+  bool fetch = false;      // the scan leaves out columns the plan needs
+  bool treeOpen = false, hashOpen = false, vindexOpen = false, coverOpen = false;
+  double cost[ACCESS_COUNT]; // the estimated page reads, < 0 if not possible
+  int planReads = 0;         // the pages read to plan the query
+  bool estimated = false;    // the costs of the access paths were estimated
+  Access access = TABLE_SCAN;
+
+  for (int i = 0; i < ACCESS_COUNT; i++) cost[i] = -1;
+
+  if (cond.empty())
+    answer = (bloomRuledOut && conds.size() == 1) ? "the Bloom filter rules the key out" : "no tuple meets the conditions";
+
+  // an equality on key is answered from the hash index if the table has
+  // one: one bucket page, then only the tuples with that key
+  else if (ranges.size() == 1 && hi == lo + 1 && hash.open(table + ".hdx", 'r') == 0) {
+    hashOpen = true;
+    scan = new HashScan(hash, (int) lo);
+    keyOrdered = true;
+    fetch = needValue;
+  }
+
+  // the B+tree index counts the tuples of the key ranges for the cost
+  // model, and finds them without reading the table if the keys are all
+  // the query needs. on key conditions alone, it answers count(*) from its
+  // entry counts, and min(key) or max(key) from its header if the smallest
+  // or the largest key meets the conditions. it is opened for this
+  // statement only, so not in resident mode (see BTreeIndex::open()).
+  else {
+    if ((hasCond || !needValue) && tree.open(table + ".idx", 'r') == 0)
+      treeOpen = true;
+
+    if (treeOpen && !hasValueCond && attr == 4 && countKeyRanges(tree, ranges, count))
+      answer = "count(*) from the entry counts of the B+tree";
+    else if (treeOpen && !hasValueCond && (attr == 5 || attr == 6) &&
+             (tree.getEntryCount() == 0 || inRanges(ranges, (attr == 5) ? tree.getMinKey() : tree.getMaxKey()))) {
+      answer = "min(key) and max(key) from the header of the B+tree";
+      if (tree.getEntryCount() > 0) {
+        result = (attr == 5) ? tree.getMinKey() : tree.getMaxKey();
+        found = true;
       }
     }
+  }
 
-    // the condition is met for the tuple. 
-    // increase matching tuple counter
-    count++;
+  // otherwise the cost model weighs the scans that can find the tuples
+  if (!answer && !scan) {
+    bool bounded = (lo > INT_MIN || hi <= INT_MAX);
 
-    // print the tuple 
-    switch (attr) {
-      case 1:  // SELECT key
-        fprintf(stdout, "%d\n", key);
-        break;
-      case 2:  // SELECT value
-        fprintf(stdout, "%s\n", value.c_str());
-        break;
-      case 3:  // SELECT *
-        fprintf(stdout, "%d '%s'\n", key, value.c_str());
-        break;
-    }
+    // the header of tablename.tbm tells whether the table is in key order.
+    // a zone map that does not match the table is not used.
+    bool tbmOpen = (tbm.open(table + ".tbm", 'r') == 0);
+    if (!tbmOpen || readTableInfo(tbm, info, false) != 0 || info.zones != zoneCount(rf))
+      info.zones = 0;
+    bool inKeyOrder = hasCond && info.clustered;
 
-    // move to the next tuple
-    next_tuple:
-    ++rid;
+    if (hasCond && cover.open(table + ".cdx", 'r') == 0)
+      coverOpen = true;
+    if (hasValueRange && hi != lo + 1 && vindex.open(table + ".vdx", 'r') == 0)
+      vindexOpen = true;
+
+    double rows = (double) rf.endRid().pid * RecordFile::RECORDS_PER_PAGE + rf.endRid().sid;
+    double pages = std::max(rf.endRid().pid + (rf.endRid().sid > 0 ? 1 : 0), 1);
+
+    // an index reads at least the leaves of the key ranges, the levels above
+    // them and, if it needs their values, the tuples. a table of as few
+    // pages, or one without an index, is scanned without estimates.
+    double minIndex = pages;
+    if (treeOpen)
+      minIndex = std::min(minIndex, tree.getTreeHeight() - 1.0 + ranges.size() + (needValue ? 1 : 0));
+    if (coverOpen)
+      minIndex = std::min(minIndex, cover.getTreeHeight() - 1.0 + ranges.size());
+    if (vindexOpen)
+      minIndex = std::min(minIndex, (double) vindex.getTreeHeight());
+    estimated = (minIndex < pages);
+
+    // a table in key order finds a key range by binary search, so its zone
+    // map is never read. a table scan without estimates reads it while it
+    // may leave out more pages than it takes. without a B+tree to count the
+    // tuples of the key range, the zone map is read up front to estimate
+    // them for the other indexes.
+    if (bounded && !inKeyOrder && info.zones > 0) {
+      if (!estimated)
+        readZoneMap(tbm, info, lo, hi, 0, pages);
+      else if (!treeOpen && readTableInfo(tbm, info, true) != 0) {
+        info.zoneMin.clear();
+        info.zoneMax.clear();
+      }
     }
-  }
-  else //otherwise, table's index file exists!
-  {
-  //initialize variables (rid doesn't really matter here)
-  count = 0;
-  rid.pid = rid.sid = 0;
-  usesIndex = true; //set this in order to close index properly
-  
-  //set the starting position for IndexCursor c
-  if(eqVal!=-1) //key must be eqVal
-    tree.locate(eqVal, c);
-  else if(min!=-1 && !condGE) //key must be greater than min
-    tree.locate(min+1, c);
-  else if(min!=-1 && condGE) //key must be at least min
-    tree.locate(min, c);
-  else
-    tree.locate(0, c);
-  
-  while(tree.readForward(c, key, rid)==0)
-  {
-    if(!hasValueCond && attr==4) //no need to read from disk for value
-    {
-      if(eqVal!=-1 && key!=eqVal) //if there is a condition on key equality that doesn't match, we are done
-        goto end_select_early;
-      
-      if(max!=-1) //if there is a condition on LT or LE that fails, we are done
-      {
-        if(condLE && key>max)
-          goto end_select_early;
-        else if(!condLE && key>=max)
-          goto end_select_early;
+
+    if (estimated) {
+      // a key among several probes (an IN list) counts as the average number
+      // of entries of a key, so that the estimate does not descend the B+tree
+      // for each of them
+      double keyRows = 0;
+      for (unsigned i = 0; i < ranges.size(); i++) {
+        if (ranges.size() > 1 && ranges[i].second == ranges[i].first + 1 && treeOpen && tree.getDistinctKeyCount() > 0)
+          keyRows += (double) tree.getEntryCount() / tree.getDistinctKeyCount();
+        else
+          keyRows += keyRangeRows(tree, treeOpen, info, ranges[i].first, ranges[i].second, rows);
       }
-      
-      if(min!=-1) //if there is a condition on GT or GE that fails, we are done
-      {
-        if(condGE && key<min)
-          goto end_select_early;
-        else if(!condGE && key<=min)
-          goto end_select_early;
+
+      // a table scan reads from the first key range to the end of the last.
+      // min(key) on a scan in key order stops at the first tuple in the
+      // range. conditions on value are taken to leave a match on every page,
+      // but an index has the tuples of a whole batch fetched by then.
+      double scanRows = keyRows;
+      double tableRows = (ranges.size() == 1) ? keyRows : keyRangeRows(tree, treeOpen, info, lo, hi, rows);
+      if (attr == 5) {
+        scanRows = std::min(keyRows, hasValueCond ? (double) Operator::BATCH_SIZE : 1.0);
+        tableRows = std::min(tableRows, hasValueCond ? (double) RecordFile::RECORDS_PER_PAGE : 1.0);
       }
-      
-      //if key passes all of the conditions, increment count and jump to next cycle in while loop
-      //in doing this if-statement, we save many reads from record file
-      count++;
-      continue;
-    }
-  
-    // read the tuple (same as given code)
-    if ((rc = rf.read(rid, key, value)) < 0) {
-      fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-      goto exit_select;
-    }
 
-    // check the conditions on the tuple (modified from given code)
-    for (unsigned i = 0; i < cond.size(); i++)
-    {
-      // compute the difference between the tuple value and the condition value
-      switch (cond[i].attr)
-      {
-        //if condition on key
-        case 1:
-          diff = key - atoi(cond[i].value);
-          break;
-        //if condition on value
-        case 2:
-          diff = strcmp(value.c_str(), cond[i].value);
-          break;
+      // the B+tree reads the leaves of the ranges and, unless the keys are
+      // all it needs, the tuples. a range after the first is located from
+      // the root again, whose upper levels are still in the cache.
+      if (treeOpen && tree.getEntryCount() > 0) {
+        cost[INDEX_SCAN] = tree.getTreeHeight() - 1 + (int) ranges.size() - 1 +
+                           ceil(scanRows / tree.getEntryCount() * tree.getLeafCount()) +
+                           (needValue ? fetchCost(scanRows, pages, info.clustered) : 0);
+      }
+
+      // the covering index reads its leaves and the tuples whose value it cut short
+      if (coverOpen && cover.getEntryCount() > 0) {
+        double truncated = needValue ? scanRows * cover.getTruncatedCount() / cover.getEntryCount() : 0;
+        cost[COVER_SCAN] = cover.getTreeHeight() - 1 + (int) ranges.size() - 1 +
+                           ceil(scanRows / cover.getEntryCount() * cover.getPageCount()) +
+                           fetchCost(truncated, pages, info.clustered);
+      }
+
+      // the value index reads its leaves of the value range and every tuple in it
+      if (vindexOpen && vindex.getEntryCount() > 0) {
+        double valueRows = ((hasHighValue ? vindex.position(highValue) : 1.0) - vindex.position(lowValue)) * vindex.getEntryCount();
+        cost[VALUE_SCAN] = vindex.getTreeHeight() - 1 +
+                           ceil(valueRows / vindex.getEntryCount() * vindex.getPageCount()) +
+                           fetchCost(valueRows, pages, false);
       }
 
-      //skip the tuple if any condition is not met
-      //for less than (LT) or less than or equal (LE) conditions on keys, once one of them fails, we are done
-      //since the tree index is sorted, every key afterwards is also going to fail the condition
-      //the same applies with EQ, since once we're past the key that was equal, everything else will fail also
-      switch (cond[i].comp)
-      {
-        case SelCond::EQ:
-          if (diff != 0)
-          {
-            if(cond[i].attr==1)
-              goto end_select_early;
-            goto continue_while;
-          }
-          break;
-        case SelCond::NE:
-          if (diff == 0) goto continue_while; //if keys ever match when they're not supposed to, break out of for-loop and wait for next cursor
-          break;
-        case SelCond::GT:
-          if (diff <= 0) goto continue_while; //if !(key > cond value), break out of for-loop and wait for next cursor
-          break;
-        case SelCond::LT:
-          if (diff >= 0)
-          {
-            if(cond[i].attr==1) //if this ever fails on a key, everything else after will fail anyway, so we end
-              goto end_select_early;
-            goto continue_while;
-          }
-          break;
-        case SelCond::GE:
-          if (diff < 0) goto continue_while; //if !(key >= cond value), break out of for-loop and wait for next cursor
-          break;
-        case SelCond::LE:
-          if (diff > 0)
-          {
-            if(cond[i].attr==1) //if this ever fails on a key, everything else after will fail anyway, so we end
-              goto end_select_early;
-            goto continue_while;
-          }
-          break;
+      double best = pages;  // the cheapest index, or a scan of every page
+      for (int i = TABLE_SCAN + 1; i < ACCESS_COUNT; i++)
+        if (cost[i] >= 0 && cost[i] < best) best = cost[i];
+
+      // a table in key order holds a key range on consecutive pages, the
+      // first of which is found by binary search. otherwise the zone map
+      // leaves out the zones of pages whose keys all lie outside of the
+      // range. with a B+tree it is read only as long as its pages and the
+      // zones of the range, whole zones of the tuples the B+tree counts at
+      // least, can still come to fewer than the cheapest index reads.
+      if (inKeyOrder)
+        cost[TABLE_SCAN] = (lo > INT_MIN ? ceil(log2(pages)) : 0) + fetchCost(tableRows, pages, true);
+      else {
+        if (bounded && treeOpen && info.zones > 0) {
+          double minScan = ceil(tableRows / RecordFile::RECORDS_PER_PAGE / ZONE_PAGES) * ZONE_PAGES;
+          readZoneMap(tbm, info, lo, hi, std::min(minScan, pages), best);
+        }
+        cost[TABLE_SCAN] = info.zoneMin.empty() ? pages : 0;
+        for (unsigned z = 0; z < info.zoneMin.size(); z++)
+          if (info.zoneMax[z] >= lo && info.zoneMin[z] < hi) cost[TABLE_SCAN] += ZONE_PAGES;
+        cost[TABLE_SCAN] = std::min(cost[TABLE_SCAN], pages);
       }
     }
 
-    // the condition is met for the tuple. 
-    // increase matching tuple counter
-    count++;
+    if (tbmOpen) tbm.close();
 
-    // print the tuple 
-    switch (attr)
-    {
-      case 1:  // SELECT key
-        fprintf(stdout, "%d\n", key);
+    // the pages read so far to plan the query are part of every estimate
+    planReads = PageFile::getPageReadCount() - startReads;
+    for (int i = 0; i < ACCESS_COUNT; i++)
+      if (cost[i] >= 0) cost[i] += planReads;
+
+    for (int i = 0; i < ACCESS_COUNT; i++)
+      if (cost[i] >= 0 && cost[i] < cost[access]) access = (Access) i;
+
+    switch (access) {
+      case INDEX_SCAN:
+        scan = new IndexScan(tree, ranges);
+        keyOrdered = true;
+        fetch = needValue;
+        break;
+      case COVER_SCAN:
+        scan = new CoverScan(cover, ranges);
+        keyOrdered = true;
+        fetch = needValue;
         break;
-      case 2:  // SELECT value
-        fprintf(stdout, "%s\n", value.c_str());
+      case VALUE_SCAN:
+        scan = new ValueScan(vindex, lowValue, highValue, hasHighValue);
+        fetch = true;
         break;
-      case 3:  // SELECT *
-        fprintf(stdout, "%d '%s'\n", key, value.c_str());
+      default:
+        keyOrdered = hasCond && info.clustered;
+        scan = new TableScan(rf, lo, hi, keyOrdered, info.zoneMin, info.zoneMax);
         break;
     }
-    
-    continue_while:
-    cout << ""; //do nothing; we use this to jump to the next while cycle
   }
+
+  rc = 0;
+  if (scan) {
+    Operator* plan = scan;
+    Count* counter = 0;
+
+    if (fetch)
+      plan = new Fetch(plan, rf, needValue);
+    if (!noCond)
+      plan = new Filter(plan, cond);
+
+    // keys come in order, so the first match holds the min(key)
+    if (attr == 5 && keyOrdered)
+      plan = new Limit(plan, 1);
+
+    plan = new Project(plan, attr);
+    if (attr < 4)
+      plan = new Output(plan, attr);
+    else
+      plan = counter = new Count(plan);
+
+    if (explain) {
+      static const char* names[] = { "table scan", "index scan", "covering index scan", "value index scan" };
+
+      const char* separator = "";
+
+      Operator::explain(plan, stdout);
+      if (hashOpen)
+        fprintf(stdout, "  -- key equality goes to the hash index without estimates\n");
+      else if (!estimated)
+        fprintf(stdout, "  -- the table scan is the only access path, so it goes without estimates\n");
+      else {
+        fprintf(stdout, "  -- estimated page reads, %d of them to plan the query: ", planReads);
+        for (int i = 0; i < ACCESS_COUNT; i++) {
+          if (cost[i] < 0) continue;
+          fprintf(stdout, "%s%s %.0f%s", separator, (i == INDEX_SCAN && !needValue) ? "index-only scan" : names[i],
+                  cost[i], (i == access) ? " (chosen)" : "");
+          separator = ", ";
+        }
+        fprintf(stdout, "\n");
+      }
+    }
+    else if ((rc = Operator::run(plan)) < 0)
+      fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+    else if (counter) {
+      int minKey, maxKey;
+
+      count = counter->getCount();
+      found = counter->getMinMax(minKey, maxKey);
+      result = (attr == 5) ? minKey : maxKey;
+    }
+    delete plan;
   }
-  
-  end_select_early: //use to leave the while loop in case some tuple fails select conditions
-  
-  // print matching tuple count if "select count(*)"
-  if (attr == 4) {
-    fprintf(stdout, "%d\n", count);
+  else if (explain)
+    fprintf(stdout, "No scan: %s\n", answer);
+
+  if (rc == 0 && !explain) {
+    // print matching tuple count if "select count(*)"
+    if (attr == 4) {
+      fprintf(stdout, "%d\n", count);
+    }
+    // print min(key) or max(key) if there was a matching tuple
+    if ((attr == 5 || attr == 6) && found) {
+      fprintf(stdout, "%d\n", result);
+    }
   }
-  rc = 0;
 
-  // close the table file and return
-  exit_select:
-  
-  if(usesIndex)
-  tree.close(); //close the index file if applicable
-  
+  // close the index files and the table file
+  if (treeOpen) tree.close();
+  if (hashOpen) hash.close();
+  if (vindexOpen) vindex.close();
+  if (coverOpen) cover.close();
+
   rf.close();
   return rc;
 }
 
-RC SqlEngine::load(const string& table, const string& loadfile, bool index)
+RC SqlEngine::load(const string& table, const string& loadfile, bool index, int bloomRate, bool hashIndex, bool clustered)
 {
   RecordFile rf;   // RecordFile containing the table
   RecordId   rid;  // record cursor for table scanning
   RC     rc;
   BTreeIndex tree;  //BTreeIndex for indexing (if applicable)
+  HashIndex  hash;  //hash index for key equality (if applicable)
+  ValueIndex vindex; //index on value, kept up to date once created
+  CoveringIndex cover; //index on key with value, kept up to date once created
   
   string line; // string holding each line from loadfile
   int    key; // holds key as parsed from line's tuple pair
   string value; //holds value as parsed from line's tuple pair
   
+  //a clustered load appends the tuples in key order: sort the loadfile first
+  string sortedfile = table + ".srt";
+  if(clustered && (rc = sortLoadFile(loadfile, sortedfile)) < 0)
+  {
+    fprintf(stderr, "Error: loadfile %s cannot be %s\n", loadfile.c_str(),
+            rc==RC_FILE_OPEN_FAILED ? "opened" : "sorted");
+    unlink(sortedfile.c_str());
+    return rc;
+  }
+  
   //open loadfile as fstream
-  ifstream tableData(loadfile.c_str());
+  ifstream tableData((clustered ? sortedfile : loadfile).c_str());
+  
+  //the open stream still reads the sorted file once its name is gone
+  if(clustered)
+    unlink(sortedfile.c_str());
   
   //check that provided loadfile can be opened
   if(!tableData.is_open())
@@ -393,40 +983,144 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
   //open or create specified table file
   rc = rf.open(table + ".tbl", 'w');
   
-  //check index for making BTree
-  if(index)
+  //the table stays in key order as long as no new key is smaller than the
+  //largest one, and the zone map takes in the keys of the new tuples.
+  //the metadata is dropped until all tuples are in, so that a failed load
+  //leaves a table that is not known to be in key order and has no zone map
+  TableInfo info;
+  if((rf.endRid().pid>0 || rf.endRid().sid>0) &&
+     (readTableInfo(table, info)!=0 || (int) info.zoneMin.size()!=zoneCount(rf)))
+  {
+    //metadata that is missing or has no zone map is found from the tuples
+    info.zoneMin.clear();
+    info.zoneMax.clear();
+    info.clustered = true;
+    info.maxKey = INT_MIN;
+    for(rid.pid = rid.sid = 0; rid < rf.endRid(); ++rid)
+    {
+      if(rf.read(rid, key, value)!=0)
+        return RC_FILE_READ_FAILED;
+      if(key < info.maxKey)
+        info.clustered = false;
+      info.maxKey = std::max(info.maxKey, key);
+      addToZone(info, rid, key);
+    }
+  }
+  else if(rf.endRid().pid==0 && rf.endRid().sid==0)
   {
+    info.clustered = true;
+    info.maxKey = INT_MIN;
+  }
+  unlink((table + ".tbm").c_str());
+  
   //open and write to BTreeIndex as tablename.idx
-  tree.open(table + ".idx", 'w');
+  if(index)
+    tree.open(table + ".idx", 'w');
   
-  //get every line from loadfile
-    while(getline(tableData, line))
+  //open and write to the hash index as tablename.hdx; one made by an
+  //earlier load gets the new tuples too
+  if(!hashIndex)
+    hashIndex = (access((table + ".hdx").c_str(), F_OK)==0);
+  if(hashIndex && hash.open(table + ".hdx", 'w')==0 && hash.getEntryCount()==0)
+  {
+    //a new hash index starts with the tuples loaded before
+    for(rid.pid = rid.sid = 0; rid < rf.endRid(); ++rid)
     {
+      if(rf.read(rid, key, value)!=0 || hash.insert(key, rid)!=0)
+        return RC_FILE_WRITE_FAILED;
+    }
+  }
+  
+  //a Bloom filter made by an earlier load is rebuilt from the index at the
+  //rate it was made with; without the index, the new keys are added to it
+  BloomFilter bloom;
+  bool extendBloom = false;
+  if(bloomRate <= 0 && bloom.read(table + ".blm")==0)
+  {
+    if(index)
+      bloomRate = bloom.getRate();
+    else
+      extendBloom = true;
+  }
+  
+  //an index on value made by CREATE INDEX gets the new tuples too
+  bool valueIndex = (access((table + ".vdx").c_str(), F_OK)==0 && vindex.open(table + ".vdx", 'w')==0);
+  bool coverIndex = (access((table + ".cdx").c_str(), F_OK)==0 && cover.open(table + ".cdx", 'w')==0);
+  
+  //get every line from loadfile
+  while(getline(tableData, line))
+  {
     parseLoadLine(line, key, value);
-    if(rf.append(key, value, rid)!=0)
-      return RC_FILE_WRITE_FAILED;
+    if((rc = rf.append(key, value, rid))!=0)
+    {
+      if(index || hashIndex)
+        return RC_FILE_WRITE_FAILED;
+      continue;
+    }
+    
+    if(key < info.maxKey)
+      info.clustered = false;
+    info.maxKey = std::max(info.maxKey, key);
+    addToZone(info, rid, key);
     
     //insert (key, rid) pair into BTree for indexing
     //check for errors in the meantime
-    if(tree.insert(key, rid)!=0)
+    if(index && tree.insert(key, rid)!=0)
       return RC_FILE_WRITE_FAILED;
-    }
     
-    //tree.print();
+    if(hashIndex && hash.insert(key, rid)!=0)
+      return RC_FILE_WRITE_FAILED;
+    
+    if(extendBloom)
+      bloom.add(key);
+    
+    if(valueIndex && vindex.insert(value, rid)!=0)
+      return RC_FILE_WRITE_FAILED;
+    
+    if(coverIndex && cover.insert(key, rid, value)!=0)
+      return RC_FILE_WRITE_FAILED;
+  }
+  
+  if(valueIndex)
+    vindex.close();
+  
+  if(coverIndex)
+    cover.close();
+  
+  if(index)
+  {
+    //report how full the leaves ended up; a load sorted by key fills them up
+    fprintf(stderr, "  -- index %s.idx: height %d, %d leaves, %.1f%% full\n", table.c_str(),
+            tree.getTreeHeight(), tree.getLeafCount(), tree.getFillFactor()*100);
+    
+    //the filter covers all keys in the index, including those of earlier loads
+    if(bloomRate > 0 && buildBloom(table, tree, bloomRate)!=0)
+      fprintf(stderr, "Error: cannot write the Bloom filter %s.blm\n", table.c_str());
+    
+    //close the index tree and file
+    tree.close();
+  }
   
-  //close the index tree and file
-  tree.close();
+  if(hashIndex)
+  {
+    fprintf(stderr, "  -- index %s.hdx: %d buckets, %d entries\n", table.c_str(),
+            hash.getBucketCount(), hash.getEntryCount());
+    hash.close();
   }
-  else
+  
+  if(extendBloom)
   {
-    //get every line from loadfile
-    while(getline(tableData, line))
-    {
-    parseLoadLine(line, key, value);
-    rc = rf.append(key, value, rid);  
-    }
+    bloomCache.erase(table);
+    if(bloom.write(table + ".blm")!=0)
+      fprintf(stderr, "Error: cannot write the Bloom filter %s.blm\n", table.c_str());
   }
   
+  if(clustered && !info.clustered)
+    fprintf(stderr, "  -- table %s is not in key order: it held larger keys before\n", table.c_str());
+  
+  if(writeTableInfo(table, info)!=0)
+    fprintf(stderr, "Error: cannot write the metadata %s.tbm\n", table.c_str());
+  
   //close RecordFile and the loadfile
   rf.close();
   tableData.close();
@@ -434,6 +1128,68 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
   return rc;
 }
 
+RC SqlEngine::createIndex(const string& table, int attr, int prefixLength)
+{
+  RecordFile rf;   // RecordFile containing the table
+  RecordId   rid;  // record cursor for table scanning
+  ValueIndex vindex;
+  CoveringIndex cover;
+  RC     rc;
+  int    key;
+  string value;
+  
+  //the plain key index comes with LOAD ... WITH INDEX
+  if(attr==1 && prefixLength<0)
+  {
+    fprintf(stderr, "Error: an index on key is made by LOAD ... WITH INDEX, or must INCLUDE (value)\n");
+    return RC_INVALID_ATTRIBUTE;
+  }
+  if(attr==2 && prefixLength>=0)
+  {
+    fprintf(stderr, "Error: only an index on key can INCLUDE (value)\n");
+    return RC_INVALID_ATTRIBUTE;
+  }
+  if(prefixLength>RecordFile::MAX_VALUE_LENGTH)
+    prefixLength = RecordFile::MAX_VALUE_LENGTH;
+  
+  if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
+    fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+    return rc;
+  }
+  
+  //build the index from scratch
+  string indexname = table + (attr==1 ? ".cdx" : ".vdx");
+  unlink(indexname.c_str());
+  if((rc = (attr==1 ? cover.open(indexname, 'w', prefixLength) : vindex.open(indexname, 'w'))) < 0)
+  {
+    fprintf(stderr, "Error: cannot create the index %s\n", indexname.c_str());
+    rf.close();
+    return rc;
+  }
+  
+  for(rid.pid = rid.sid = 0; rid < rf.endRid(); ++rid)
+  {
+    if((rc = rf.read(rid, key, value)) < 0 ||
+       (rc = (attr==1 ? cover.insert(key, rid, value) : vindex.insert(value, rid))) < 0)
+    {
+      fprintf(stderr, "Error: while indexing table %s\n", table.c_str());
+      break;
+    }
+  }
+  
+  fprintf(stderr, "  -- index %s: height %d, %d entries\n", indexname.c_str(),
+          attr==1 ? cover.getTreeHeight() : vindex.getTreeHeight(),
+          attr==1 ? cover.getEntryCount() : vindex.getEntryCount());
+  
+  //an incomplete index would miss tuples
+  RC closeRc = (attr==1 ? cover.close() : vindex.close());
+  if(rc < 0 || closeRc < 0)
+    unlink(indexname.c_str());
+  
+  rf.close();
+  return rc < 0 ? rc : closeRc;
+}
+
 RC SqlEngine::parseLoadLine(const string& line, int& key, string& value)
 {
     const char *s;
@@ -19,10 +19,18 @@
  */
 struct SelCond {
   int attr;     // attribute: 1 - key column,  2 - value column
-  enum Comparator { EQ, NE, LT, GT, LE, GE } comp;
-  char* value;  // the value to compare
+  enum Comparator { EQ, NE, LT, GT, LE, GE, IN } comp;
+  char* value;  // the value to compare, 0 for IN
+  std::vector<int> keys;  // IN on key: the keys of the list, sorted, each once
 };
 
+/**
+ * a WHERE clause in disjunctive normal form: the conditions of each list
+ * are ANDed together, and the lists are ORed. a SELECT without a WHERE
+ * clause has one empty list.
+ */
+typedef std::vector<std::vector<SelCond> > SelDnf;
+
 /**
  * the class that takes, parses, and executes the user commands.
  */
@@ -40,24 +48,70 @@ class SqlEngine {
 
   /**
    * executes a SELECT statement.
-   * all conditions in conds must be ANDed together.
    * the result of the SELECT is printed on screen.
+   * a cost model estimates the page reads of a table scan and of each
+   * index that can find the tuples, and the cheapest one is used.
+   * the key ranges of ORed conditions are merged, and an index scan
+   * walks them in key order, once. a query that needs no value, in its
+   * result or its conditions, may be answered from the B+tree alone.
    * @param attr[IN] attribute in the SELECT clause
-   * (1: key, 2: value, 3: *, 4: count(*))
+   * (1: key, 2: value, 3: *, 4: count(*), 5: min(key), 6: max(key))
    * @param table[IN] the table name in the FROM clause
-   * @param conds[IN] list of conditions in the WHERE clause
+   * @param conds[IN] the conditions in the WHERE clause
+   * @param explain[IN] true to print the plan (EXPLAIN SELECT) instead of
+   *        running it, with the page reads estimated for each way of
+   *        finding the tuples
    * @return error code. 0 if no error
    */
-  static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds);
+  static RC select(int attr, const std::string& table, const SelDnf& conds, bool explain = false);
 
   /**
    * load a table from a load file.
+   * with bloomRate > 0, a Bloom filter on all keys of the table is built
+   * next to the index (tablename.blm); it answers key = X conditions on
+   * absent keys without reading the index. a later load rebuilds it at the
+   * same rate, or adds its keys to it if it does not load the index.
+   * with hashIndex, a hash index on the key (tablename.hdx) is made; it
+   * answers key = X conditions. later loads add their tuples to it.
+   * with clustered, the tuples are appended in key order, sorting the load
+   * file first. a table whose tuples are all in key order is marked so in
+   * tablename.tbm, and select() finds a key range in it by its pages.
    * @param table[IN] the table name in the LOAD command
    * @param loadfile[IN] the file name of the load file
    * @param index[IN] true if "WITH INDEX" option was specified
+   * @param bloomRate[IN] 0, or N from "AND BLOOM [N]": allow one false positive in N lookups
+   * @param hashIndex[IN] true if "HASH INDEX" option was specified
+   * @param clustered[IN] true if "CLUSTERED" option was specified
    * @return error code. 0 if no error
    */
-  static RC load(const std::string& table, const std::string& loadfile, bool index);
+  static RC load(const std::string& table, const std::string& loadfile, bool index,
+                 int bloomRate = 0, bool hashIndex = false, bool clustered = false);
+
+  /**
+   * build an index on a column of an existing table; later loads add
+   * their tuples to it.
+   * an index on value is kept in tablename.vdx; select() uses it for
+   * conditions on value that leave fewer tuples than the conditions on key.
+   * an index on key must include value (CREATE INDEX ON t(key) INCLUDE (value)):
+   * it is kept in tablename.cdx with the first prefixLength bytes of each
+   * value, and select() answers key ranges from it without reading the table
+   * except for longer values.
+   * @param table[IN] the table name in the CREATE INDEX command
+   * @param attr[IN] the indexed column (1: key, 2: value)
+   * @param prefixLength[IN] the bytes of value to include, -1 for none
+   * @return error code. 0 if no error
+   */
+  static RC createIndex(const std::string& table, int attr, int prefixLength = -1);
+
+  /**
+   * set how many table pages an index scan asks to be read ahead of the
+   * page it reads (SET PREFETCH n). 0 turns prefetching off.
+   * @param depth[IN] the number of pages to prefetch
+   */
+  static void setPrefetchDepth(int depth);
+
+  // the prefetch depth until setPrefetchDepth() is called
+  static const int DEFAULT_PREFETCH_DEPTH = 8;
 
   /**
    * parse a line from the load file into the (key, value) pair.
@@ -5,27 +5,126 @@
 #include <unistd.h>
 #include <climits>
 #include <string>
+#include <algorithm>
 #include "Bruinbase.h"
 #include "SqlEngine.h" 
 #include "PageFile.h"
+#include "BloomFilter.h"
 
 int  sqllex(void);  
 void sqlerror(const char *str) { fprintf(stderr, "Error: %s\n", str); }
 extern "C" { int  sqlwrap() { return 1; } }
 
-static void runSelect(int attr, const char* table, const std::vector<SelCond>& conds)
+// a WHERE clause is put into disjunctive normal form as it is parsed.
+// every list of conditions holds its own copies of the values. ANDing two
+// clauses pairs up their lists, so their number is limited. an IN list on
+// key is a single condition holding its keys; on value, it becomes a list
+// for each of its values.
+static const unsigned MAX_CONDITION_LISTS = 1024;
+
+static void freeConditions(SelDnf* dnf)
+{
+  if (!dnf) return;
+  for (unsigned i = 0; i < dnf->size(); i++)
+    for (unsigned j = 0; j < (*dnf)[i].size(); j++)
+      free((*dnf)[i][j].value);
+  delete dnf;
+}
+
+// c1 OR c2: the lists of both. either is 0 after an error.
+static SelDnf* orConditions(SelDnf* c1, SelDnf* c2)
+{
+  if (!c1 || !c2) {
+    freeConditions(c1);
+    freeConditions(c2);
+    return 0;
+  }
+  if (c1->size() + c2->size() > MAX_CONDITION_LISTS) {
+    sqlerror("the WHERE clause has too many ORed conditions");
+    freeConditions(c1);
+    freeConditions(c2);
+    return 0;
+  }
+  c1->insert(c1->end(), c2->begin(), c2->end());
+  delete c2;
+  return c1;
+}
+
+// c1 AND c2: every list of c1 joined with every list of c2 (distributing
+// AND over OR). either is 0 after an error.
+static SelDnf* andConditions(SelDnf* c1, SelDnf* c2)
+{
+  SelDnf* dnf = 0;
+
+  if (c1 && c2 && c1->size() * c2->size() > MAX_CONDITION_LISTS)
+    sqlerror("the WHERE clause has too many ORed conditions");
+  else if (c1 && c2) {
+    dnf = new SelDnf;
+    for (unsigned i = 0; i < c1->size(); i++) {
+      for (unsigned j = 0; j < c2->size(); j++) {
+        std::vector<SelCond> list((*c1)[i]);
+        list.insert(list.end(), (*c2)[j].begin(), (*c2)[j].end());
+        for (unsigned k = 0; k < list.size(); k++)
+          if (list[k].value) list[k].value = strdup(list[k].value);
+        dnf->push_back(list);
+      }
+    }
+  }
+  freeConditions(c1);
+  freeConditions(c2);
+  return dnf;
+}
+
+// attr IN (values): one condition on key, or an equality on value for
+// each of the values ORed together. 0 after an error.
+static SelDnf* inConditions(int attr, std::vector<char*>* values)
+{
+  SelDnf* dnf = 0;
+
+  if (attr == 1) {
+    SelCond c = { attr, SelCond::IN, 0 };
+    for (unsigned i = 0; i < values->size(); i++) {
+      c.keys.push_back(atoi((*values)[i]));
+      free((*values)[i]);
+    }
+    std::sort(c.keys.begin(), c.keys.end());
+    c.keys.erase(std::unique(c.keys.begin(), c.keys.end()), c.keys.end());
+    dnf = new SelDnf(1, std::vector<SelCond>(1, c));
+  }
+  else if (values->size() > MAX_CONDITION_LISTS) {
+    sqlerror("the WHERE clause has too many ORed conditions");
+    for (unsigned i = 0; i < values->size(); i++) free((*values)[i]);
+  }
+  else {
+    dnf = new SelDnf;
+    for (unsigned i = 0; i < values->size(); i++) {
+      SelCond c = { attr, SelCond::EQ, (*values)[i] };
+      dnf->push_back(std::vector<SelCond>(1, c));
+    }
+  }
+  delete values;
+  return dnf;
+}
+
+static void runSelect(int attr, const char* table, const SelDnf& conds)
 {
   struct tms tmsbuf;
   clock_t btime, etime;
   int     bpagecnt, epagecnt;
+  int     bprefetch, eprefetch;
 
   btime = times(&tmsbuf);
   bpagecnt = PageFile::getPageReadCount();
+  bprefetch = PageFile::getPagePrefetchCount();
   SqlEngine::select(attr, table, conds);
   etime = times(&tmsbuf);
   epagecnt = PageFile::getPageReadCount();
+  eprefetch = PageFile::getPagePrefetchCount();
 
-  fprintf(stderr, "  -- %.3f seconds to run the select command. Read %d pages\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), epagecnt - bpagecnt);
+  if (eprefetch > bprefetch)
+    fprintf(stderr, "  -- %.3f seconds to run the select command. Read %d pages, %d of them prefetched\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), epagecnt - bpagecnt, eprefetch - bprefetch);
+  else
+    fprintf(stderr, "  -- %.3f seconds to run the select command. Read %d pages\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), epagecnt - bpagecnt);
 }
 
 %}
@@ -34,18 +133,21 @@ static void runSelect(int attr, const char* table, const std::vector<SelCond>& c
   int integer;
   char* string;
   SelCond* cond;
-  std::vector<SelCond>* conds;
+  SelDnf* conds;
+  std::vector<char*>* values;
 }
 
 %token SELECT FROM WHERE LOAD WITH INDEX QUIT COUNT AND OR 
+%token CREATE ON INCLUDE SET PREFETCH EXPLAIN BETWEEN IN MIN MAX HASH BLOOM CLUSTERED
 %token COMMA STAR LF
 %token <string> INTEGER STRING ID
 %token EQUAL NEQUAL LESS LESSEQUAL GREATER GREATEREQUAL 
 
-%type <integer> attributes attribute comparator
+%type <integer> attributes attribute comparator load_options load_option function
 %type <string> table value
 %type <cond> condition
-%type <conds> conditions
+%type <conds> conditions conjunction condition_group
+%type <values> value_list
 %%
 
 commands:
@@ -55,6 +157,8 @@ commands:
 
 command:
         load_command { fprintf(stdout, "Bruinbase> "); }
+	| create_command { fprintf(stdout, "Bruinbase> "); }
+	| set_command { fprintf(stdout, "Bruinbase> "); }
 	| select_command { fprintf(stdout, "Bruinbase> "); }
 	| quit_command
 	| error LF { fprintf(stdout, "Bruinbase> "); }
@@ -71,40 +175,131 @@ load_command:
 	  free($2);
 	  free($4);
 	}
-	| LOAD table FROM STRING WITH INDEX LF { 
-	  SqlEngine::load(std::string($2), std::string($4), true); 
+	| LOAD table FROM STRING WITH load_options LF { 
+	  if ($6 >= 0 && ($6 >> 3) > 0 && !($6 & 1)) sqlerror("BLOOM needs the INDEX option");
+	  else if ($6 >= 0) SqlEngine::load(std::string($2), std::string($4), $6 & 1, $6 >> 3, ($6 & 2) != 0, ($6 & 4) != 0); 
 	  free($2);
 	  free($4);
 	}
 	;
 
+/* an option list is 1 for INDEX, 2 for HASH INDEX, 4 for CLUSTERED and the
+   Bloom filter rate shifted left by three, or -1 after an error was reported */
+load_options:
+	load_option { $$ = $1; }
+	| load_options AND load_option {
+	  if ($1 < 0 || $3 < 0) $$ = -1;
+	  else if (($1 >> 3) > 0 && ($3 >> 3) > 0) {
+	    sqlerror("BLOOM is given twice");
+	    $$ = -1;
+	  }
+	  else $$ = $1 | $3;
+	}
+	;
+
+load_option:
+	INDEX { $$ = 1; }
+	| HASH INDEX { $$ = 2; }
+	| CLUSTERED { $$ = 4; }
+	| BLOOM { $$ = BloomFilter::DEFAULT_RATE << 3; }
+	| BLOOM INTEGER { 
+	  if (atoi($2) < 2) {
+	    sqlerror("the Bloom filter rate must be at least 2");
+	    $$ = -1;
+	  }
+	  else if (atoi($2) > (INT_MAX >> 3)) {
+	    sqlerror("the Bloom filter rate is too large");
+	    $$ = -1;
+	  }
+	  else $$ = atoi($2) << 3;
+	  free($2);
+	}
+	;
+
+/* CREATE INDEX ON table (attribute), with INCLUDE (value) for a covering index */
+create_command:
+	CREATE INDEX ON table '(' attribute ')' LF {
+	  if ($6 > 0) SqlEngine::createIndex(std::string($4), $6);
+	  free($4);
+	}
+	| CREATE INDEX ON table '(' attribute ')' INCLUDE '(' attribute ')' LF {
+	  if ($10 != 2) sqlerror("only value can be included");
+	  else if ($6 > 0) SqlEngine::createIndex(std::string($4), $6, RecordFile::MAX_VALUE_LENGTH);
+	  free($4);
+	}
+	| CREATE INDEX ON table '(' attribute ')' INCLUDE '(' attribute '(' INTEGER ')' ')' LF {
+	  if ($10 != 2) sqlerror("only value can be included");
+	  else if (atoi($12) < 1) sqlerror("the prefix of value must be at least 1 byte");
+	  else if ($6 > 0) SqlEngine::createIndex(std::string($4), $6, atoi($12));
+	  free($4);
+	  free($12);
+	}
+	;
+
+/* SET PREFETCH n: the pages an index scan reads ahead */
+set_command:
+	SET PREFETCH INTEGER LF {
+	  SqlEngine::setPrefetchDepth(atoi($3));
+	  free($3);
+	}
+	;
+
+/* EXPLAIN SELECT prints the plan */
 select_command:
 	SELECT attributes FROM table LF {
-   	        std::vector<SelCond> conds;
+   	        SelDnf conds(1);
 		runSelect($2, $4, conds);
 		free($4);
 	}
 	| SELECT attributes FROM table WHERE conditions LF {
-	        runSelect($2, $4, *$6);
+	        if ($6) runSelect($2, $4, *$6);
 	  	free($4);
-	  	for (unsigned i = 0; i < $6->size(); i++) {
-		    free((*$6)[i].value);
-		}
-	  	delete $6;
+	  	freeConditions($6);
+	}
+	| EXPLAIN SELECT attributes FROM table LF {
+	        SelDnf conds(1);
+		SqlEngine::select($3, $5, conds, true);
+		free($5);
+	}
+	| EXPLAIN SELECT attributes FROM table WHERE conditions LF {
+		if ($7) SqlEngine::select($3, $5, *$7, true);
+	  	free($5);
+	  	freeConditions($7);
 	}
 	;
 
+/* AND binds tighter than OR; a WHERE clause that could not be put into
+   disjunctive normal form is 0 */
 conditions:
+	conjunction { $$ = $1; }
+	| conditions OR conjunction { $$ = orConditions($1, $3); }
+	;
+
+conjunction:
+	condition_group { $$ = $1; }
+	| conjunction AND condition_group { $$ = andConditions($1, $3); }
+	;
+
+condition_group:
 	condition {
-	  std::vector<SelCond>* v = new std::vector<SelCond>;
-	  v->push_back(*$1);
-	  $$ = v;
+	  $$ = new SelDnf(1, std::vector<SelCond>(1, *$1));
           delete $1;
 	}
-	| conditions AND condition {
-	  $1->push_back(*$3);
+	| attribute BETWEEN value AND value {
+	  SelCond c[2] = { { $1, SelCond::GE, $3 }, { $1, SelCond::LE, $5 } };
+	  $$ = new SelDnf(1, std::vector<SelCond>(c, c + 2));
+	}
+	| attribute IN '(' value_list ')' { $$ = inConditions($1, $4); }
+	| '(' conditions ')' { $$ = $2; }
+	;
+
+/* the values of an IN list are collected, and the IN turns them into
+   conditions */
+value_list:
+	value { $$ = new std::vector<char*>(1, $1); }
+	| value_list COMMA value {
+	  $1->push_back($3);
 	  $$ = $1;
-          delete $3;
 	}
 	;
 
@@ -122,13 +317,31 @@ attributes:
 	attribute { $$ = $1; }
 	| STAR  { $$ = 3; }
 	| COUNT { $$ = 4; }
+	| function '(' attribute ')' {
+		$$ = 0;
+		if ($3 != 1) sqlerror("MIN and MAX are only supported on key");
+		else $$ = $1;
+	}
+	| ID '(' attribute ')' {
+		$$ = 0;
+		sqlerror("unknown function. neither min or max");
+		free($1);
+	}
+	;
+
+function:
+	MIN   { $$ = 5; }
+	| MAX { $$ = 6; }
 	;
 
 attribute:
 	ID { 
 		if (strcasecmp($1, "key") == 0) $$=1;
 		else if (strcasecmp($1, "value") == 0) $$=2;
-		else sqlerror("wrong attribute name. neither key or value");
+		else {
+		  sqlerror("wrong attribute name. neither key or value");
+		  $$ = 0;
+		}
 		free($1);
 	}
 
@@ -0,0 +1,142 @@
+/*
+ * Secondary B+tree index on the value column of a table.
+ */
+
+#include "ValueIndex.h"
+#include <cstring>
+
+using std::string;
+
+//Layout of an index file (see EntryTree.cc for the rest):
+//  page 0: the fields of EntryTree only
+//  leaf entries:     [value length (1 byte)][value][rid]
+//  non-leaf entries: [value length (1 byte)][value][rid][child pid]
+
+static const int VALUE_MAGIC = 0x56445831; // "VDX1"
+
+ValueIndex::ValueIndex()
+  : EntryTree(VALUE_MAGIC, FORMAT_VERSION, 0)
+{
+}
+
+RC ValueIndex::open(const string& indexname, char mode)
+{
+  return openTree(indexname, mode);
+}
+
+//Order (value, rid) pairs: by value, then by RecordId
+bool ValueIndex::less(const TreeEntry& a, const TreeEntry& b) const
+{
+  int c = a.value.compare(b.value);
+  return c < 0 || (c == 0 && a.rid < b.rid);
+}
+
+int ValueIndex::entryBytes(const TreeEntry& e, bool leaf) const
+{
+  return 1 + e.value.size() + sizeof(RecordId) + (leaf ? 0 : sizeof(PageId));
+}
+
+char* ValueIndex::encode(char* p, const TreeEntry& e, bool leaf) const
+{
+  *p++ = (char) e.value.size();
+  memcpy(p, e.value.data(), e.value.size());
+  p += e.value.size();
+  memcpy(p, &e.rid, sizeof(RecordId));
+  p += sizeof(RecordId);
+
+  if (!leaf) {
+    memcpy(p, &e.pid, sizeof(PageId));
+    p += sizeof(PageId);
+  }
+  return p;
+}
+
+const char* ValueIndex::decode(const char* p, const char* end, TreeEntry& e, bool leaf) const
+{
+  if (p >= end) return NULL;
+
+  int len = (unsigned char) *p;
+  if (p + 1 + len + sizeof(RecordId) + (leaf ? 0 : sizeof(PageId)) > end) return NULL;
+
+  e.key = 0;
+  e.truncated = false;
+  e.value.assign(p + 1, len);
+  p += 1 + len;
+  memcpy(&e.rid, p, sizeof(RecordId));
+  p += sizeof(RecordId);
+
+  if (!leaf) {
+    memcpy(&e.pid, p, sizeof(PageId));
+    p += sizeof(PageId);
+  }
+  return p;
+}
+
+//The shortest separator s with left < s <= right
+void ValueIndex::separator(const TreeEntry& left, const TreeEntry& right, TreeEntry& sep) const
+{
+  sep.key = 0;
+  sep.truncated = false;
+
+  if (left.value == right.value) {
+    sep.value = right.value;
+    sep.rid = right.rid;
+    return;
+  }
+
+  // the shortest prefix of the right value that is larger than the left one;
+  // with the smallest RecordId it is still not larger than the right entry
+  unsigned n = 1;
+  while (n < right.value.size() && right.value.compare(0, n, left.value) <= 0) n++;
+
+  sep.value = right.value.substr(0, n);
+  sep.rid.pid = -1;
+  sep.rid.sid = -1;
+}
+
+RC ValueIndex::insert(const string& value, const RecordId& rid)
+{
+  TreeEntry entry;
+  entry.key = 0;
+  entry.value = value.substr(0, RecordFile::MAX_VALUE_LENGTH);
+  entry.truncated = false;
+  entry.rid = rid;
+  entry.pid = 0;
+
+  return insertEntry(entry);
+}
+
+//A probe smaller than every entry with value
+static TreeEntry valueProbe(const string& value)
+{
+  TreeEntry probe;
+  probe.key = 0;
+  probe.value = value;
+  probe.truncated = false;
+  probe.rid.pid = -1;
+  probe.rid.sid = -1;
+  probe.pid = 0;
+  return probe;
+}
+
+RC ValueIndex::locate(const string& value, ValueCursor& cursor)
+{
+  return locateEntry(valueProbe(value), cursor);
+}
+
+RC ValueIndex::readForward(ValueCursor& cursor, string& value, RecordId& rid)
+{
+  const TreeEntry* e;
+  RC rc;
+
+  if ((rc = readEntry(cursor, e)) < 0) return rc;
+
+  value = e->value;
+  rid = e->rid;
+  return 0;
+}
+
+double ValueIndex::position(const string& value)
+{
+  return positionOf(valueProbe(value));
+}
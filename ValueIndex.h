@@ -0,0 +1,89 @@
+/*
+ * Secondary B+tree index on the value column of a table.
+ */
+
+#ifndef VALUEINDEX_H
+#define VALUEINDEX_H
+
+#include "EntryTree.h"
+#include <string>
+
+/**
+ * The position of an entry in the leaves of a ValueIndex.
+ */
+typedef TreeCursor ValueCursor;
+
+/**
+ * Implements a B+tree on the value column for bruinbase.
+ *
+ * The entries are (value, RecordId) pairs, sorted by value and then by
+ * RecordId, so all entries are different and a value may repeat. Nodes
+ * hold as many entries as fit into their page, since values differ in
+ * length; a separator in a non-leaf node is the shortest prefix of a
+ * value that tells its two children apart.
+ *
+ * Tables are only appended to, so the index has no remove(). It is not
+ * safe to use an open index from several threads at the same time.
+ */
+class ValueIndex : public EntryTree {
+ public:
+  ValueIndex();
+
+  /**
+   * Open the index file in read or write mode.
+   * Under 'w' mode, the index file is created if it does not exist.
+   * @param indexname[IN] the name of the index file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& indexname, char mode);
+
+  /**
+   * Insert (value, RecordId) pair to the index.
+   * @param value[IN] the value of the record
+   * @param rid[IN] the RecordId of the record
+   * @return error code. 0 if no error
+   */
+  RC insert(const std::string& value, const RecordId& rid);
+
+  /**
+   * Find the first entry whose value is larger than or equal to value.
+   * @param value[IN] the value to look for
+   * @param cursor[OUT] the cursor pointing to the entry
+   * @return error code. 0 if no error
+   */
+  RC locate(const std::string& value, ValueCursor& cursor);
+
+  /**
+   * Read the (value, rid) pair at the cursor and move it to the next entry.
+   * @param cursor[IN/OUT] the cursor pointing to the entry to read
+   * @param value[OUT] the value of the entry
+   * @param rid[OUT] the RecordId of the entry
+   * @return error code. RC_END_OF_TREE after the last entry
+   */
+  RC readForward(ValueCursor& cursor, std::string& value, RecordId& rid);
+
+  /**
+   * Estimate the share of entries with a value smaller than value from
+   * where it falls in the nodes on its path, reading one node per level.
+   * @param value[IN] the value to look for
+   * @return a number between 0 and 1
+   */
+  double position(const std::string& value);
+
+  // the format of the index file; a file with another version is not opened
+  static const int FORMAT_VERSION = 1;
+
+ protected:
+  // entries are (value, rid): leaf [value length (1 byte)][value][rid],
+  // non-leaf the same followed by [child pid]
+  bool less(const TreeEntry& a, const TreeEntry& b) const;
+  int entryBytes(const TreeEntry& e, bool leaf) const;
+  char* encode(char* p, const TreeEntry& e, bool leaf) const;
+  const char* decode(const char* p, const char* end, TreeEntry& e, bool leaf) const;
+  void separator(const TreeEntry& left, const TreeEntry& right, TreeEntry& sep) const;
+  void saveHeader(int*) const {}
+  bool loadHeader(const int*) { return true; }
+};
+
+#endif /* VALUEINDEX_H */
@@ -394,8 +394,8 @@ static void yy_fatal_error (yyconst char msg[]  );
 	*yy_cp = '\0'; \
 	(yy_c_buf_p) = yy_cp;
 
-#define YY_NUM_RULES 26
-#define YY_END_OF_BUFFER 27
+#define YY_NUM_RULES 27
+#define YY_END_OF_BUFFER 28
 /* This struct is not used in this scanner,
    but its presence is necessary. */
 struct yy_trans_info
@@ -405,7 +405,7 @@ struct yy_trans_info
 	};
 static yyconst flex_int16_t yy_accept[113] =
     {   0,
-        0,    0,   27,   26,   25,   23,   26,   26,   22,   21,
+        0,    0,   28,   26,   25,   23,   26,   26,   22,   21,
        26,   18,   24,   15,   12,   14,   20,   20,   20,   20,
        20,   20,   20,   20,   20,   20,   20,   20,   20,   20,
        20,   20,   20,   20,   20,   20,   20,   25,   23,    0,
@@ -565,6 +565,7 @@ char *sqltext;
 #line 1 "SqlParser.l"
 #line 2 "SqlParser.l"
 #include <cstring>
+#include <strings.h>
 #include "SqlEngine.h"
 #include "SqlParser.tab.h"
 
@@ -577,7 +578,28 @@ char* strlower(char* s)
         }
 	return s;
 }
-#line 581 "lex.sql.c"
+
+/* keywords without a rule of their own, in any case. a word is looked up
+   here before it is taken for an identifier */
+static const struct {
+	const char* word;
+	int         token;
+} keywords[] = {
+	{ "create", CREATE }, { "on", ON }, { "include", INCLUDE },
+	{ "set", SET }, { "prefetch", PREFETCH }, { "explain", EXPLAIN },
+	{ "between", BETWEEN }, { "in", IN }, { "min", MIN }, { "max", MAX },
+	{ "hash", HASH }, { "bloom", BLOOM }, { "clustered", CLUSTERED }
+};
+
+int identifier(const char* text)
+{
+	for (unsigned i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++)
+		if (strcasecmp(text, keywords[i].word) == 0) return keywords[i].token;
+
+	sqllval.string = strlower(strdup(text));
+	return ID;
+}
+#line 603 "lex.sql.c"
 
 #define INITIAL 0
 
@@ -795,10 +817,10 @@ YY_DECL
 		}
 
 	{
-#line 17 "SqlParser.l"
+#line 39 "SqlParser.l"
 
 
-#line 802 "lex.sql.c"
+#line 824 "lex.sql.c"
 
 	while ( /*CONSTCOND*/1 )		/* loops until end-of-file is reached */
 		{
@@ -857,137 +879,142 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 19 "SqlParser.l"
+#line 41 "SqlParser.l"
 return SELECT;
 	YY_BREAK
 case 2:
 YY_RULE_SETUP
-#line 20 "SqlParser.l"
+#line 42 "SqlParser.l"
 return FROM;
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 21 "SqlParser.l"
+#line 43 "SqlParser.l"
 return WHERE;
 	YY_BREAK
 case 4:
 YY_RULE_SETUP
-#line 22 "SqlParser.l"
+#line 44 "SqlParser.l"
 return LOAD;
 	YY_BREAK
 case 5:
 YY_RULE_SETUP
-#line 23 "SqlParser.l"
+#line 45 "SqlParser.l"
 return WITH;
 	YY_BREAK
 case 6:
 YY_RULE_SETUP
-#line 24 "SqlParser.l"
+#line 46 "SqlParser.l"
 return INDEX;
 	YY_BREAK
 case 7:
 YY_RULE_SETUP
-#line 25 "SqlParser.l"
+#line 47 "SqlParser.l"
 return QUIT;
 	YY_BREAK
 case 8:
 YY_RULE_SETUP
-#line 26 "SqlParser.l"
+#line 48 "SqlParser.l"
 return QUIT;
 	YY_BREAK
 case 9:
 YY_RULE_SETUP
-#line 27 "SqlParser.l"
+#line 49 "SqlParser.l"
 return COUNT;
 	YY_BREAK
 case 10:
 YY_RULE_SETUP
-#line 29 "SqlParser.l"
+#line 51 "SqlParser.l"
 return AND;
 	YY_BREAK
 case 11:
 YY_RULE_SETUP
-#line 30 "SqlParser.l"
+#line 52 "SqlParser.l"
 return OR;
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 31 "SqlParser.l"
+#line 53 "SqlParser.l"
 return EQUAL;
 	YY_BREAK
 case 13:
 YY_RULE_SETUP
-#line 32 "SqlParser.l"
+#line 54 "SqlParser.l"
 return NEQUAL;
 	YY_BREAK
 case 14:
 YY_RULE_SETUP
-#line 33 "SqlParser.l"
+#line 55 "SqlParser.l"
 return GREATER;
 	YY_BREAK
 case 15:
 YY_RULE_SETUP
-#line 34 "SqlParser.l"
+#line 56 "SqlParser.l"
 return LESS;
 	YY_BREAK
 case 16:
 YY_RULE_SETUP
-#line 35 "SqlParser.l"
+#line 57 "SqlParser.l"
 return GREATEREQUAL;
 	YY_BREAK
 case 17:
 YY_RULE_SETUP
-#line 36 "SqlParser.l"
+#line 58 "SqlParser.l"
 return LESSEQUAL;
 	YY_BREAK
 case 18:
 YY_RULE_SETUP
-#line 38 "SqlParser.l"
+#line 60 "SqlParser.l"
 sqllval.string = strdup(sqltext); return INTEGER;
 	YY_BREAK
 case 19:
 /* rule 19 can match eol */
 YY_RULE_SETUP
-#line 39 "SqlParser.l"
+#line 61 "SqlParser.l"
 sqllval.string = strdup(sqltext+1); sqllval.string[sqlleng-2] = 0; return STRING;
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
-#line 40 "SqlParser.l"
-sqllval.string = strlower(strdup(sqltext)); return ID;
+#line 62 "SqlParser.l"
+return identifier(sqltext);
 	YY_BREAK
 case 21:
 YY_RULE_SETUP
-#line 41 "SqlParser.l"
+#line 63 "SqlParser.l"
 return COMMA;
 	YY_BREAK
 case 22:
 YY_RULE_SETUP
-#line 42 "SqlParser.l"
+#line 64 "SqlParser.l"
 return STAR;
 	YY_BREAK
 case 23:
 /* rule 23 can match eol */
 YY_RULE_SETUP
-#line 43 "SqlParser.l"
+#line 65 "SqlParser.l"
 return LF;
 	YY_BREAK
 case 24:
 YY_RULE_SETUP
-#line 44 "SqlParser.l"
+#line 66 "SqlParser.l"
 /* ignore semicolon */
 	YY_BREAK
 case 25:
 YY_RULE_SETUP
-#line 45 "SqlParser.l"
+#line 67 "SqlParser.l"
 /* ignore white space */
 	YY_BREAK
 case 26:
 YY_RULE_SETUP
-#line 47 "SqlParser.l"
+#line 68 "SqlParser.l"
+return sqltext[0];
+	YY_BREAK
+case 27:
+YY_RULE_SETUP
+#line 70 "SqlParser.l"
 ECHO;
 	YY_BREAK
-#line 991 "lex.sql.c"
+#line 1018 "lex.sql.c"
 case YY_STATE_EOF(INITIAL):
 	yyterminate();
 
@@ -1988,7 +2015,7 @@ void sqlfree (void * ptr )
 
 #define YYTABLES_NAME "yytables"
 
-#line 47 "SqlParser.l"
+#line 70 "SqlParser.l"
 
 
 
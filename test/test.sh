@@ -1,10 +1,15 @@
 #!/bin/sh
 
-rm -f xsmall.tbl xsmall.idx
-rm -f small.tbl small.idx
-rm -f medium.tbl medium.idx
-rm -f large.tbl large.idx
-rm -f xlarge.tbl xlarge.idx
+rm -f xsmall.tbl xsmall.idx xsmall.tbm
+rm -f small.tbl small.idx small.tbm
+rm -f medium.tbl medium.idx medium.tbm
+rm -f large.tbl large.idx large.tbm
+rm -f xlarge.tbl xlarge.idx xlarge.tbm
+rm -f bloomed.tbl bloomed.idx bloomed.blm bloomed.tbm
+rm -f hashed.tbl hashed.hdx hashed.tbm
+rm -f valued.tbl valued.vdx valued.tbm
+rm -f covered.tbl covered.idx covered.cdx covered.tbm
+rm -f sorted.tbl sorted.tbm
 
 ./bruinbase < test.sql
 
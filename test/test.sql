@@ -20,3 +20,53 @@ SELECT COUNT(*) FROM xlarge
 SELECT * FROM xlarge WHERE key = 4240
 SELECT * FROM xlarge WHERE key > 400 AND key < 500 AND key > 100 AND key < 4000000
 
+SELECT MIN(key) FROM large WHERE key > 4500
+SELECT MAX(key) FROM large
+
+LOAD bloomed FROM 'medium.del' WITH INDEX AND BLOOM
+SELECT * FROM bloomed WHERE key = 489
+SELECT * FROM bloomed WHERE key = 490
+
+LOAD hashed FROM 'medium.del' WITH HASH INDEX
+SELECT * FROM hashed WHERE key = 4589
+SELECT COUNT(*) FROM hashed WHERE key = 4590
+
+LOAD valued FROM 'medium.del'
+CREATE INDEX ON valued(value)
+SELECT * FROM valued WHERE value >= 'Wa' AND value < 'Wi'
+
+LOAD covered FROM 'large.del' WITH INDEX
+CREATE INDEX ON covered(key) INCLUDE (value(12))
+SELECT * FROM covered WHERE key > 4500 AND key < 4600
+
+LOAD sorted FROM 'medium.del' WITH CLUSTERED
+SELECT * FROM sorted WHERE key > 4000 AND key < 4300
+
+SET PREFETCH 0
+SELECT COUNT(*) FROM xlarge WHERE key > 400 AND key < 500 AND value > 'B'
+SET PREFETCH 8
+SELECT COUNT(*) FROM xlarge WHERE key > 400 AND key < 500 AND value > 'B'
+
+EXPLAIN SELECT * FROM xlarge WHERE key = 4240
+EXPLAIN SELECT * FROM xlarge WHERE key > 400
+EXPLAIN SELECT COUNT(*) FROM large WHERE key > 4500
+
+SELECT * FROM medium WHERE key = 489 OR key = 4589
+SELECT * FROM medium WHERE (key < 500 OR key > 4500) AND value > 'V'
+
+SELECT * FROM medium WHERE key IN (4589, 489, 4590)
+SELECT * FROM large WHERE key BETWEEN 4500 AND 4530
+SELECT COUNT(*) FROM large WHERE key IN (4506, 4515, 4524, 4531, 4546) AND (value > 'Wh' OR value < 'Wb')
+
+SELECT key FROM large WHERE key > 4500
+SELECT COUNT(*) FROM large WHERE key > 4500 AND key <> 4506
+SELECT value FROM covered WHERE key > 4500 AND key < 4560
+
+LOAD hashed FROM 'large.del'
+SELECT * FROM hashed WHERE key = 4733
+
+LOAD bloomed FROM 'large.del' WITH INDEX
+SELECT * FROM bloomed WHERE key = 4733
+SELECT * FROM bloomed WHERE key = 4589
+SELECT * FROM bloomed WHERE key = 4734
+